@@ -15,113 +15,264 @@
 
 /*--------------------------------------------------------------------*/
 
+/* The children of one kind, directories or files, of a directory. A
+   directory with a single child of a kind, as each one along a chain
+   of directories has, keeps it inline, without a DynArray; the array is
+   only created when a sibling appears, and freed again when the
+   children drop back to one.
+
+   This takes the place of a path-compressed trie, which would merge
+   such a chain into one node labelled with the whole run of names.
+   Each node already keeps only its own name, so the array was all
+   that a link of a chain cost beyond its node, and without it a chain
+   of 6 directories and a file takes 635 rather than 923 bytes of
+   heap. A trie kept as a second engine, chosen when a tree is
+   initialized, was not built: the index, the cached listings, the
+   reclaimer, bulk loading, and the walk stack of ft.c all work on
+   Node_D and would each need a second version for it. */
+struct NodeD_Children
+{
+   /* the child, if there is exactly one, or NULL */
+   void* only;
+
+   /* the children in sorted order by name, if there are two or more,
+      or NULL */
+   DynArray_T array;
+};
+
 /* A dirNode represents a directory in the tree. */
 struct dirNode
 {
-   /* the full path of this directory */
-   char* path;
+   /* the name of this directory, the final component of its path;
+      the full path is rebuilt from the names of its ancestors.
+      The characters are stored in the same allocation as the node,
+      right after the struct */
+   char* name;
 
    /* the parent directory of this directory
       NULL for the root of the directory tree */
    Node_D parent;
 
    /* the subdirectories of this directory
-      stored in sorted order by pathname */
-   DynArray_T dirChildren;
+      stored in sorted order by name */
+   struct NodeD_Children dirChildren;
 
    /* the files stored of this directory
-      stored in sorted order by pathname */
-   DynArray_T fileChildren;
-   
+      stored in sorted order by name */
+   struct NodeD_Children fileChildren;
+
+   /* the cached FT_toString listing of the hierarchy rooted at this
+      directory, not '\0'-terminated, or NULL if it is not cached.
+      A directory without a listing is dirty; whenever a directory
+      is dirty, so are all of its ancestors */
+   char* listing;
+
+   /* the number of characters in listing */
+   size_t listingLength;
+
+   /* TRUE if this directory has been detached from its tree by
+      NodeD_detach, so that neither it nor any of its descendants has
+      a path any more */
+   boolean isDetached;
+   /* the number of references to this directory: one from its parent,
+      or from the tree if it is the root, and one more from each
+      snapshot of the tree that still shares it. A shared directory is
+      never changed; the tree copies it first with NodeD_unshare */
+   size_t refs;
 };
 
 /*--------------------------------------------------------------------*/
 
-/* Returns a path with contents n->path/dir
-   or NULL if there is an allocation error.
+/* Given a parent node and a directory string dir, returns a new
+   Node_D or NULL if any allocation error occurs in creating
+   the node or its fields.
+
+   The new structure is initialized to have dir as its name, so that
+   its path is the parent's path (if it exists) prefixed to dir,
+   separated by a slash. It is also initialized with its parent link
+   as the parent parameter value, but the parent itself is not changed
+   to link to the new dirNode.  The children links are initialized but
+   do not point to any children.
 
-   Allocates memory for the returned string,
-   which is then owned by the caller. */
-static char* NodeD_buildPath(Node_D n, const char* dir)
+   The node and its name take a single allocation; the children arrays
+   are not allocated until a second child of a kind is linked. */
+static Node_D NodeD_create(const char* dir, Node_D parent)
 {
-   char* path;
+   Node_D new;
 
+   assert(parent == NULL || CheckerFT_Dir_isValid(parent));
    assert(dir != NULL);
 
-   if(n == NULL)
-   {
-      path = malloc(strlen(dir)+1);
-   }
-   else
+   new = malloc(sizeof(struct dirNode) + strlen(dir) + 1);
+   if(new == NULL)
+      return NULL;
+
+   new->name = strcpy((char*) (new + 1), dir);
+   new->parent = parent;
+   new->dirChildren.only = NULL;
+   new->dirChildren.array = NULL;
+   new->fileChildren.only = NULL;
+   new->fileChildren.array = NULL;
+   new->listing = NULL;
+   new->listingLength = 0;
+   new->isDetached = FALSE;
+   new->refs = 1;
+
+   assert(CheckerFT_Dir_isValid(new));
+   return new;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the number of elements of children. */
+static size_t NodeD_getLength(struct NodeD_Children* children)
+{
+   assert(children != NULL);
+
+   if(children->array != NULL)
+      return DynArray_getLength(children->array);
+
+   return (children->only != NULL) ? 1 : 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns element i of children, which must exist. */
+static void* NodeD_getChild(struct NodeD_Children* children, size_t i)
+{
+   assert(children != NULL);
+   assert(i < NodeD_getLength(children));
+
+   if(children->array != NULL)
+      return DynArray_get(children->array, i);
+
+   return children->only;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Inserts child into children at index i, creating the array if child
+   is the second element. Returns TRUE on success or FALSE if there is
+   an allocation error, in which case children is unchanged. */
+static boolean NodeD_insertChild(struct NodeD_Children* children,
+                                 size_t i, void* child)
+{
+   DynArray_T array;
+
+   assert(children != NULL);
+   assert(child != NULL);
+   assert(i <= NodeD_getLength(children));
+
+   if(children->array != NULL)
+      return (boolean) DynArray_addAt(children->array, i, child);
+
+   if(children->only == NULL)
    {
-      path = malloc(strlen(n->path) + 1 + strlen(dir) + 1);
+      children->only = child;
+      return TRUE;
    }
-   
-   if(path == NULL)
+
+   array = DynArray_new(2);
+   if(array == NULL)
+      return FALSE;
+   (void) DynArray_set(array, i, child);
+   (void) DynArray_set(array, 1 - i, children->only);
+   children->only = NULL;
+   children->array = array;
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Removes element i, which must exist, from children and returns it,
+   going back to storing the last remaining element inline. */
+static void* NodeD_removeChild(struct NodeD_Children* children, size_t i)
+{
+   void* removed;
+
+   assert(children != NULL);
+   assert(i < NodeD_getLength(children));
+
+   if(children->array == NULL)
    {
-      return NULL;
+      removed = children->only;
+      children->only = NULL;
+      return removed;
    }
-   *path = '\0';
 
-   if(n != NULL)
+   removed = DynArray_removeAt(children->array, i);
+   if(DynArray_getLength(children->array) == 1)
    {
-      strcpy(path, n->path);
-      strcat(path, "/");
+      children->only = DynArray_get(children->array, 0);
+      DynArray_free(children->array);
+      children->array = NULL;
    }
-   strcat(path, dir);
-
-   return path;
+   return removed;
 }
 
 /*--------------------------------------------------------------------*/
 
-/* Given a parent node and a directory string dir, returns a new
-   Node_D or NULL if any allocation error occurs in creating
-   the node or its fields.
+/* Sets up children, whose old contents are discarded, to hold length
+   elements, which are then stored with NodeD_setChild. Returns TRUE on
+   success or FALSE if there is an allocation error. */
+static boolean NodeD_newChildren(struct NodeD_Children* children,
+                                 size_t length)
+{
+   assert(children != NULL);
 
-   The new structure is initialized to have its path as the parent's
-   path (if it exists) prefixed to the directory string parameter,
-   separated by a slash. It is also initialized with its parent link
-   as the parent parameter value, but the parent itself is not changed
-   to link to the new dirNode.  The children links are initialized but
-   do not point to any children. */
-static Node_D NodeD_create(const char* dir, Node_D parent)
+   children->only = NULL;
+   children->array = NULL;
+   if(length < 2)
+      return TRUE;
+
+   children->array = DynArray_new(length);
+   return (boolean) (children->array != NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Stores child as element i of children, set up by
+   NodeD_newChildren. */
+static void NodeD_setChild(struct NodeD_Children* children, size_t i,
+                           void* child)
 {
-   Node_D new;
-   char* newPath;
+   assert(children != NULL);
+   assert(child != NULL);
 
-   assert(parent == NULL || CheckerFT_Dir_isValid(parent));
-   assert(dir != NULL);
+   if(children->array != NULL)
+      (void) DynArray_set(children->array, i, child);
+   else
+      children->only = child;
+}
 
-   new = malloc(sizeof(struct dirNode));
-   if(new == NULL)
-      return NULL;
-   
-   newPath = NodeD_buildPath(parent, dir);
-   if(newPath == NULL) {
-      free(new);
-      return NULL;
-   }
+/*--------------------------------------------------------------------*/
 
-   new->path = newPath;
-   new->parent = parent;
-   new->dirChildren = DynArray_new(0);
-   if(new->dirChildren == NULL) {
-      free(new->path);
-      free(new);
-      return NULL;
-   }
+/* Frees the array of children, if it has one. The elements are not
+   freed. */
+static void NodeD_freeChildren(struct NodeD_Children* children)
+{
+   assert(children != NULL);
 
-   new->fileChildren = DynArray_new(0);
-   if(new->fileChildren == NULL) {
-      free(new->dirChildren);
-      free(new->path);
-      free(new);
-      return NULL;
-   }
+   if(children->array != NULL)
+      DynArray_free(children->array);
+   children->array = NULL;
+   children->only = NULL;
+}
 
-   assert(CheckerFT_Dir_isValid(new));
-   return new;
+/*--------------------------------------------------------------------*/
+
+/* Marks n and all of its ancestors dirty, discarding their cached
+   listings. The walk stops at the first dirty directory, since its
+   ancestors are dirty already. */
+static void NodeD_invalidate(Node_D n)
+{
+   while(n != NULL && n->listing != NULL)
+   {
+      free(n->listing);
+      n->listing = NULL;
+      n->listingLength = 0;
+      n = n->parent;
+   }
 }
 
 /*--------------------------------------------------------------------*/
@@ -140,15 +291,15 @@ static int NodeD_unlinkDirChild(Node_D parent, Node_D child)
    assert(CheckerFT_Dir_isValid(parent));
    assert(CheckerFT_Dir_isValid(child));
 
-   if(DynArray_bsearch(parent->dirChildren, child, &i,
-               (int (*)(const void*, const void*)) NodeD_compare) == 0)
+   if(!NodeD_findDirChild(parent, child->name, strlen(child->name), &i))
    {
       assert(CheckerFT_Dir_isValid(parent));
       assert(CheckerFT_Dir_isValid(child));
       return PARENT_CHILD_ERROR;
    }
 
-   (void) DynArray_removeAt(parent->dirChildren, i);
+   (void) NodeD_removeChild(&parent->dirChildren, i);
+   NodeD_invalidate(parent);
 
    assert(CheckerFT_Dir_isValid(parent));
    assert(CheckerFT_Dir_isValid(child));
@@ -160,48 +311,209 @@ static int NodeD_unlinkDirChild(Node_D parent, Node_D child)
 /* See NodeD.h for specification. */
 size_t NodeD_destroy(Node_D n)
 {
-   size_t i;
    size_t count = 0;
-   Node_D d;
+   size_t i;
+   Node_D curr;
+   Node_D child;
+   Node_D next;
    Node_D parent;
-   Node_F f;
+   Node_F file;
    int result;
 
    assert(n != NULL);
+   assert(n->refs > 0);
 
-   for(i = 0; i < DynArray_getLength(n->fileChildren);)
-   {
-      f = DynArray_get(n->fileChildren, i);
-      result = NodeD_unlinkFileChild(n, f);
+   /* Unlink the parent */
+   parent = NodeD_getParent(n);
+   if(parent != NULL) {
+      result = NodeD_unlinkDirChild(parent, n);
       assert(result == SUCCESS);
+   }
 
-      result = NodeF_removeFile(f);
-      f = NULL;
-      assert(result == SUCCESS);
+   /* A snapshot still shares n, so n and everything below it stay */
+   if(--n->refs != 0)
+      return 0;
 
+   /* Everything below n is going away, so nothing there is searched
+      for or unlinked one child at a time, and no listing is
+      invalidated. Free the hierarchy from the bottom up without
+      recursing: take the last child directory off the end of its
+      parent's array, which shifts nothing, and descend into it if
+      nothing else shares it; once a directory has no child directories
+      left, free its files in one pass, then its arrays and itself, and
+      go back to its parent */
+   curr = n;
+   while(curr != NULL)
+   {
+      if(NodeD_getNumDirChildren(curr) != 0)
+      {
+         child = NodeD_removeChild(&curr->dirChildren,
+                                   NodeD_getNumDirChildren(curr) - 1);
+         if(--child->refs == 0)
+         {
+            /* The tree may have moved child's parent link to its copy
+               of curr */
+            child->parent = curr;
+            curr = child;
+         }
+         continue;
+      }
+
+      for(i = 0; i < NodeD_getNumFileChildren(curr); i++)
+      {
+         file = NodeD_getChild(&curr->fileChildren, i);
+         if(!NodeF_isShared(file))
+            count++;
+         result = NodeF_removeFile(file);
+         assert(result == SUCCESS);
+      }
+
+      next = (curr == n) ? NULL : curr->parent;
+      NodeD_freeChildren(&curr->dirChildren);
+      NodeD_freeChildren(&curr->fileChildren);
+      free(curr->listing);
+      free(curr);
       count++;
+      curr = next;
+   }
+
+   return count;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+void NodeD_share(Node_D n)
+{
+   assert(n != NULL);
+
+   n->refs++;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+boolean NodeD_isShared(Node_D n)
+{
+   assert(n != NULL);
+
+   return (boolean) (n->refs > 1);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+Node_D NodeD_unshare(Node_D n)
+{
+   Node_D copy;
+   Node_D child;
+   Node_F file;
+   size_t numDirs;
+   size_t numFiles;
+   size_t i;
+
+   assert(n != NULL);
+   assert(n->refs > 1);
+   assert(n->parent == NULL || !NodeD_isShared(n->parent));
+
+   numDirs = NodeD_getNumDirChildren(n);
+   numFiles = NodeD_getNumFileChildren(n);
+
+   /* Allocate the copy and its arrays before changing anything */
+   copy = NodeD_create(n->name, n->parent);
+   if(copy == NULL)
+      return NULL;
+   if(!NodeD_newChildren(&copy->dirChildren, numDirs) ||
+      !NodeD_newChildren(&copy->fileChildren, numFiles))
+   {
+      NodeD_freeChildren(&copy->dirChildren);
+      NodeD_freeChildren(&copy->fileChildren);
+      free(copy);
+      return NULL;
    }
-   for(i = 0; i < DynArray_getLength(n->dirChildren);)
+
+   /* The children are shared by n and the copy from now on, and
+      belong to the copy as far as their links up are concerned */
+   for(i = 0; i < numDirs; i++)
+   {
+      child = NodeD_getChild(&n->dirChildren, i);
+      child->refs++;
+      child->parent = copy;
+      NodeD_setChild(&copy->dirChildren, i, child);
+   }
+   for(i = 0; i < numFiles; i++)
    {
-      d = DynArray_get(n->dirChildren, i);
-      count += NodeD_destroy(d);
+      file = NodeD_getChild(&n->fileChildren, i);
+      NodeF_share(file);
+      NodeD_setChild(&copy->fileChildren, i, file);
    }
+   for(i = 0; i < numFiles; i++)
+      (void) NodeF_linkFile(NodeD_getChild(&copy->fileChildren, i),
+                            copy);
 
-   /* Unlink the parent */
-   parent = NodeD_getParent(n);
-   if(parent != NULL) {
-      result = NodeD_unlinkDirChild(parent, n);
-      assert(result == SUCCESS);
+   /* The copy takes n's place in the parent, which was dirty already
+      or becomes so now that it has a dirty child */
+   if(n->parent != NULL)
+   {
+      (void) NodeD_findDirChild(n->parent, n->name, strlen(n->name),
+                                &i);
+      assert(NodeD_getChild(&n->parent->dirChildren, i) == n);
+      NodeD_setChild(&n->parent->dirChildren, i, copy);
+      NodeD_invalidate(n->parent);
    }
+   n->refs--;
 
-   DynArray_free(n->dirChildren);
-   DynArray_free(n->fileChildren);
-   free(n->path);
-   free(n);
-   n = NULL;
-   count++;
+   assert(CheckerFT_Dir_isValid(copy));
+   return copy;
+}
 
-   return count;
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+Node_F NodeD_unshareFile(Node_D parent, Node_F file, void* contents,
+                         size_t length, StoreFT_T store)
+{
+   Node_F copy;
+   size_t i;
+
+   assert(parent != NULL);
+   assert(file != NULL);
+   assert(!NodeD_isShared(parent));
+   assert(NodeF_isShared(file));
+
+   copy = NodeF_create(NodeF_getName(file), parent, contents, length,
+                       store);
+   if(copy == NULL)
+      return NULL;
+
+   (void) NodeD_findFileChild(parent, NodeF_getName(file),
+                              strlen(NodeF_getName(file)), &i);
+   assert(NodeD_getChild(&parent->fileChildren, i) == file);
+   NodeD_setChild(&parent->fileChildren, i, copy);
+   (void) NodeF_removeFile(file);
+
+   return copy;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+int NodeD_detach(Node_D n)
+{
+   int result;
+
+   assert(n != NULL);
+
+   if(n->parent != NULL)
+   {
+      result = NodeD_unlinkDirChild(n->parent, n);
+      if(result != SUCCESS)
+         return result;
+   }
+   n->parent = NULL;
+   n->isDetached = TRUE;
+
+   return SUCCESS;
 }
 
 /*--------------------------------------------------------------------*/
@@ -212,18 +524,92 @@ int NodeD_compare(Node_D node1, Node_D node2)
    assert(node1 != NULL);
    assert(node2 != NULL);
 
-   return strcmp(node1->path, node2->path);
+   return strcmp(node1->name, node2->name);
 }
 
 /*--------------------------------------------------------------------*/
 
 /* See NodeD.h for specification. */
-const char* NodeD_getPath(Node_D n)
+const char* NodeD_getName(Node_D n)
 {
    if (n == NULL)
       return NULL;
 
-   return n->path;
+   return n->name;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+size_t NodeD_getPathLength(Node_D n)
+{
+   size_t length;
+
+   assert(n != NULL);
+
+   length = strlen(n->name);
+   for(n = n->parent; n != NULL; n = n->parent)
+      length += strlen(n->name) + 1;
+
+   return length;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+char* NodeD_writePath(Node_D n, char* buf)
+{
+   char* end;
+   size_t nameLen;
+
+   assert(n != NULL);
+   assert(buf != NULL);
+
+   /* Fill buf from the end, one ancestor's name at a time */
+   end = buf + NodeD_getPathLength(n);
+   *end = '\0';
+   for(;;)
+   {
+      nameLen = strlen(n->name);
+      end -= nameLen;
+      memcpy(end, n->name, nameLen);
+
+      n = n->parent;
+      if(n == NULL)
+         break;
+      *--end = '/';
+   }
+   assert(end == buf);
+
+   return buf;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+boolean NodeD_hasPath(Node_D n, const char* path, size_t len)
+{
+   size_t nameLen;
+
+   assert(n != NULL);
+   assert(path != NULL);
+
+   /* Match n's ancestors' names against path from the end */
+   for(;;)
+   {
+      nameLen = strlen(n->name);
+      if(nameLen > len ||
+         strncmp(path + len - nameLen, n->name, nameLen) != 0)
+         return FALSE;
+      len -= nameLen;
+
+      if(n->parent == NULL)
+         return (boolean) (len == 0 && !n->isDetached);
+      n = n->parent;
+      if(len == 0 || path[len - 1] != '/')
+         return FALSE;
+      len--;
+   }
 }
 
 /*--------------------------------------------------------------------*/
@@ -234,8 +620,8 @@ size_t NodeD_getNumChildren(Node_D n)
    if(n == NULL)
       return 0;
 
-   return DynArray_getLength(n->dirChildren) +
-      DynArray_getLength(n->fileChildren);
+   return NodeD_getLength(&n->dirChildren) +
+      NodeD_getLength(&n->fileChildren);
 }
 
 /*--------------------------------------------------------------------*/
@@ -246,7 +632,7 @@ size_t NodeD_getNumFileChildren(Node_D n)
    if(n == NULL)
       return 0;
 
-   return DynArray_getLength(n->fileChildren);
+   return NodeD_getLength(&n->fileChildren);
 }
 
 /*--------------------------------------------------------------------*/
@@ -257,67 +643,132 @@ size_t NodeD_getNumDirChildren(Node_D n)
    if(n == NULL)
       return 0;
 
-   return DynArray_getLength(n->dirChildren);
+   return NodeD_getLength(&n->dirChildren);
 }
 
 /*--------------------------------------------------------------------*/
 
-/* Returns 1 if n has a child file with path,
+/* Returns 1 if n has a child file with name path,
    0 if it does not have such a child, and -1 if
-   there is an allocation error during search.
+   there is an allocation error during search (the search no longer
+   allocates, so this does not happen).
 
    If n does have such a child, and childID is not NULL, store the
    child's identifier in *childID. If n does not have such a child,
    store the identifier that such a child would have in *childID. */
 static int NodeD_hasFileChild(Node_D n, const char* path, size_t* childID)
 {  
-   size_t index;
-   int result;
-   Node_F checker;
+   assert(n != NULL);
+   assert(path != NULL);
 
+   return NodeD_findFileChild(n, path, strlen(path), childID);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+int NodeD_hasDirChild(Node_D n, const char* path, size_t* childID)
+{
    assert(n != NULL);
    assert(path != NULL);
 
-   checker = NodeF_create(path, NULL, NULL, 0);
-   if(checker == NULL) {
-      return -1;
-   }
-   result = DynArray_bsearch(n->fileChildren, checker, &index,
-                             (int (*)(const void*, const void*))
-                             NodeF_compare);
-   (void) NodeF_removeFile(checker);
+   return NodeD_findDirChild(n, path, strlen(path), childID);
+}
 
-   if(childID != NULL)
-      *childID = index;
+/*--------------------------------------------------------------------*/
 
-   return result;
+/* Compares childName with the len characters beginning at name.
+   Returns <0, 0, or >0 as for strcmp. */
+static int NodeD_compareName(const char* childName, const char* name,
+                             size_t len)
+{
+   int result;
+
+   assert(childName != NULL);
+   assert(name != NULL);
+
+   result = strncmp(childName, name, len);
+   if(result != 0)
+      return result;
+
+   /* name is a prefix of childName, so they match only if the
+      component ends here as well */
+   return (childName[len] == '\0') ? 0 : 1;
 }
 
 /*--------------------------------------------------------------------*/
 
-/* See NodeD.h for specification. */
-int NodeD_hasDirChild(Node_D n, const char* path, size_t* childID)
+/* Binary searches children, the sorted dirChildren (if isFile is
+   FALSE) or fileChildren (if isFile is TRUE) of n, for the child whose
+   name is the len characters beginning at name.
+   Returns 1 if found and 0 otherwise; *childID is set as described for
+   NodeD_findDirChild. */
+static int NodeD_findChild(Node_D n, struct NodeD_Children* children,
+                           boolean isFile,
+                           const char* name, size_t len, size_t* childID)
 {
-   size_t index;
+   size_t low = 0;
+   size_t high;
+   size_t mid;
+   void* child;
    int result;
-   Node_D checker;
 
    assert(n != NULL);
-   assert(path != NULL);
+   assert(name != NULL);
 
-   checker = NodeD_create(path, NULL);
-   if(checker == NULL) {
-      return -1;
+   high = NodeD_getLength(children);
+
+   /* Search the half-open range [low, high) */
+   while(low < high)
+   {
+      mid = low + (high - low) / 2;
+      child = NodeD_getChild(children, mid);
+      if(isFile)
+         result = NodeD_compareName(NodeF_getName(child), name, len);
+      else
+         result = NodeD_compareName(((Node_D) child)->name, name, len);
+
+      if(result == 0)
+      {
+         if(childID != NULL)
+            *childID = mid;
+         return 1;
+      }
+      else if(result < 0)
+         low = mid + 1;
+      else
+         high = mid;
    }
-   result = DynArray_bsearch(n->dirChildren, checker, &index,
-                             (int (*)(const void*, const void*))
-                             NodeD_compare);
-   (void) NodeD_destroy(checker);
 
    if(childID != NULL)
-      *childID = index;
+      *childID = low;
+   return 0;
+}
 
-   return result;
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+int NodeD_findDirChild(Node_D n, const char* name, size_t len,
+                       size_t* childID)
+{
+   assert(n != NULL);
+   assert(name != NULL);
+
+   return NodeD_findChild(n, &n->dirChildren, FALSE, name, len,
+                          childID);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+int NodeD_findFileChild(Node_D n, const char* name, size_t len,
+                        size_t* childID)
+{
+   assert(n != NULL);
+   assert(name != NULL);
+
+   return NodeD_findChild(n, &n->fileChildren, TRUE, name, len,
+                          childID);
 }
 
 /*--------------------------------------------------------------------*/
@@ -328,8 +779,8 @@ Node_F NodeD_getFileChild(Node_D n, size_t childID)
    if(n == NULL)
       return NULL;
 
-   if(DynArray_getLength(n->fileChildren) > childID) {
-      return DynArray_get(n->fileChildren, childID);
+   if(NodeD_getLength(&n->fileChildren) > childID) {
+      return NodeD_getChild(&n->fileChildren, childID);
    }
    else {
       return NULL;
@@ -344,8 +795,8 @@ Node_D NodeD_getDirChild(Node_D n, size_t childID)
    if(n == NULL)
       return NULL;
 
-   if(DynArray_getLength(n->dirChildren) > childID) {
-      return DynArray_get(n->dirChildren, childID);
+   if(NodeD_getLength(&n->dirChildren) > childID) {
+      return NodeD_getChild(&n->dirChildren, childID);
    }
    else {
       return NULL;
@@ -367,49 +818,29 @@ Node_D NodeD_getParent(Node_D n)
 
 /* Makes fileNode a child of parent, if possible, and returns SUCCESS.
    This is not possible in the following cases:
-   * parent already has a child with child's path,
+   * parent already has a child with child's name,
      in which case: returns ALREADY_IN_TREE
-   * child's path is not parent's path + / + directory,
+   * child's name is not a single path component,
      or the parent cannot link to the child,
      in which cases: returns PARENT_CHILD_ERROR */
 static int NodeD_linkFileChild(Node_D parent, Node_F child)
 {
    size_t i;
-   char* rest;
 
    assert(parent != NULL);
    assert(child != NULL);
    assert(CheckerFT_Dir_isValid(parent));
 
-   /* Check if child is already in tree */
-   if(NodeD_hasFileChild(parent, NodeF_getPath(child), NULL))
+   /* Check if child is already in tree, finding where it would go */
+   if(NodeD_hasFileChild(parent, NodeF_getName(child), &i))
    {
       assert(CheckerFT_Dir_isValid(parent));
       assert(CheckerFT_File_isValid(child));
       return ALREADY_IN_TREE;
    }
 
-   /* Checks that child's path includes exactly parent's path */
-   i = strlen(parent->path);
-   if(strncmp(NodeF_getPath(child), parent->path, i))
-   {
-      assert(CheckerFT_Dir_isValid(parent));
-      assert(CheckerFT_File_isValid(child));
-      return PARENT_CHILD_ERROR;
-   }
-
-   /* Checks that child's path is a valid path string */
-   rest = (char*) NodeF_getPath(child)+ i;
-   if(strlen(NodeF_getPath(child)) >= i && rest[0] != '/')
-   {
-      assert(CheckerFT_Dir_isValid(parent));
-      assert(CheckerFT_File_isValid(child));
-      return PARENT_CHILD_ERROR;
-   }
-
-   /* Makes sure child's path doesn't contain another '/' at the end */
-   rest++;
-   if(strstr(rest, "/") != NULL)
+   /* Makes sure child's name doesn't contain a '/' */
+   if(strchr(NodeF_getName(child), '/') != NULL)
    {
       assert(CheckerFT_Dir_isValid(parent));
       assert(CheckerFT_File_isValid(child));
@@ -418,18 +849,10 @@ static int NodeD_linkFileChild(Node_D parent, Node_F child)
 
    NodeF_linkFile(child, parent);
 
-   /* Checks if the file is already in the tree */
-   if(DynArray_bsearch(parent->fileChildren, child, &i,
-               (int (*)(const void*, const void*)) NodeF_compare) == 1)
-   {
-      assert(CheckerFT_Dir_isValid(parent));
-      assert(CheckerFT_File_isValid(child));
-      return ALREADY_IN_TREE;
-   }
-
    /* Checks if file was successfully linked into tree */
-   if(DynArray_addAt(parent->fileChildren, i, child) == TRUE)
+   if(NodeD_insertChild(&parent->fileChildren, i, child))
    {
+      NodeD_invalidate(parent);
       assert(CheckerFT_Dir_isValid(parent));
       assert(CheckerFT_File_isValid(child));
       return SUCCESS;
@@ -449,50 +872,30 @@ static int NodeD_linkFileChild(Node_D parent, Node_F child)
 
 /* Makes dirNode a child of parent, if possible, and returns SUCCESS.
    This is not possible in the following cases:
-   * parent already has a child with child's path,
+   * parent already has a child with child's name,
      in which case: returns ALREADY_IN_TREE
-     * child's path is not parent's path + / + directory,
+   * child's name is not a single path component,
      or the parent cannot link to the child,
      in which cases: returns PARENT_CHILD_ERROR */
 static int NodeD_linkDirChild(Node_D parent, Node_D child)
 {
    size_t i;
-   char* rest;
 
    assert(parent != NULL);
    assert(child != NULL);
    assert(CheckerFT_Dir_isValid(parent));
    assert(CheckerFT_Dir_isValid(child));
 
-   /* Check if child is already in tree */
-   if(NodeD_hasDirChild(parent, child->path, NULL))
+   /* Check if child is already in tree, finding where it would go */
+   if(NodeD_hasDirChild(parent, child->name, &i))
    {
       assert(CheckerFT_Dir_isValid(parent));
       assert(CheckerFT_Dir_isValid(child));
       return ALREADY_IN_TREE;
    }
 
-   /* Checks that child's path includes exactly parent's path */
-   i = strlen(parent->path);
-   if(strncmp(child->path, parent->path, i))
-   {
-      assert(CheckerFT_Dir_isValid(parent));
-      assert(CheckerFT_Dir_isValid(child));
-      return PARENT_CHILD_ERROR;
-   }
-
-   /* Checks that child's path is a valid path string */
-   rest = child->path + i;
-   if(strlen(child->path) >= i && rest[0] != '/')
-   {
-      assert(CheckerFT_Dir_isValid(parent));
-      assert(CheckerFT_Dir_isValid(child));
-      return PARENT_CHILD_ERROR;
-   }
-
-   /* Makes sure child's path doesn't contain another '/' at the end */
-   rest++;
-   if(strstr(rest, "/") != NULL)
+   /* Makes sure child's name doesn't contain a '/' */
+   if(strchr(child->name, '/') != NULL)
    {
       assert(CheckerFT_Dir_isValid(parent));
       assert(CheckerFT_Dir_isValid(child));
@@ -501,18 +904,10 @@ static int NodeD_linkDirChild(Node_D parent, Node_D child)
    
    child->parent = parent;
 
-   /* Checks if the directory is already in the tree */
-   if(DynArray_bsearch(parent->dirChildren, child, &i,
-               (int (*)(const void*, const void*)) NodeD_compare) == 1)
-   {
-      assert(CheckerFT_Dir_isValid(parent));
-      assert(CheckerFT_Dir_isValid(child));
-      return ALREADY_IN_TREE;
-   }
-
    /* Checks if file was successfully linked into tree */
-   if(DynArray_addAt(parent->dirChildren, i, child) == TRUE)
+   if(NodeD_insertChild(&parent->dirChildren, i, child))
    {
+      NodeD_invalidate(parent);
       assert(CheckerFT_Dir_isValid(parent));
       assert(CheckerFT_Dir_isValid(child));
       return SUCCESS;
@@ -539,15 +934,16 @@ int NodeD_unlinkFileChild(Node_D parent, Node_F child)
    assert(CheckerFT_Dir_isValid(parent));
    assert(CheckerFT_File_isValid(child));
 
-   if(DynArray_bsearch(parent->fileChildren, child, &i,
-               (int (*)(const void*, const void*)) NodeF_compare) == 0)
+   if(!NodeD_findFileChild(parent, NodeF_getName(child),
+                           strlen(NodeF_getName(child)), &i))
    {
       assert(CheckerFT_Dir_isValid(parent));
       assert(CheckerFT_File_isValid(child));
       return PARENT_CHILD_ERROR;
    }
 
-   (void) DynArray_removeAt(parent->fileChildren, i);
+   (void) NodeD_removeChild(&parent->fileChildren, i);
+   NodeD_invalidate(parent);
 
    assert(CheckerFT_Dir_isValid(parent));
    assert(CheckerFT_File_isValid(child));
@@ -559,7 +955,7 @@ int NodeD_unlinkFileChild(Node_D parent, Node_F child)
 
 /* See NodeD.h for specification. */
 int NodeD_addFileChild(Node_D parent, const char* dir, void* contents,
-size_t length)
+size_t length, StoreFT_T store)
 {
    Node_F new;
    int result;
@@ -568,7 +964,7 @@ size_t length)
    assert(dir != NULL);
    assert(CheckerFT_Dir_isValid(parent));
 
-   new = NodeF_create(dir, parent, contents, length);
+   new = NodeF_create(dir, parent, contents, length, store);
    if(new == NULL)
    {
       assert(CheckerFT_Dir_isValid(parent));
@@ -591,6 +987,147 @@ size_t length)
 
 /*--------------------------------------------------------------------*/
 
+/* See NodeD.h for specification. */
+void NodeD_addFileChildren(Node_D parent, const char* names[],
+                           void* contents[], size_t lengths[], size_t k,
+                           StoreFT_T store, int results[])
+{
+   struct NodeD_Children merged;
+   Node_F* created;
+   Node_F old;
+   size_t numOld;
+   size_t numNew = 0;
+   size_t i;
+   size_t j;
+   size_t c;
+
+   assert(parent != NULL);
+   assert(names != NULL);
+   assert(results != NULL);
+   assert(CheckerFT_Dir_isValid(parent));
+
+   if(k == 0)
+      return;
+
+   created = malloc(k * sizeof(Node_F));
+   if(created == NULL)
+   {
+      for(i = 0; i < k; i++)
+         results[i] = PARENT_CHILD_ERROR;
+      return;
+   }
+
+   /* Create a node for every name that is not a file already */
+   for(i = 0; i < k; i++)
+   {
+      assert(i == 0 || strcmp(names[i - 1], names[i]) < 0);
+
+      if(NodeD_findFileChild(parent, names[i], strlen(names[i]), &j))
+         results[i] = ALREADY_IN_TREE;
+      else if(strchr(names[i], '/') != NULL)
+         results[i] = PARENT_CHILD_ERROR;
+      else
+      {
+         created[numNew] = NodeF_create(names[i], parent, contents[i],
+                                        lengths[i], store);
+         if(created[numNew] == NULL)
+            results[i] = PARENT_CHILD_ERROR;
+         else
+         {
+            results[i] = SUCCESS;
+            numNew++;
+         }
+      }
+   }
+
+   /* Merge the old files and the new ones, both sorted by name, into
+      a new array, instead of inserting the new ones one at a time */
+   numOld = NodeD_getNumFileChildren(parent);
+   if(numNew == 0 || !NodeD_newChildren(&merged, numOld + numNew))
+   {
+      for(j = 0; j < numNew; j++)
+         (void) NodeF_removeFile(created[j]);
+      for(i = 0; i < k; i++)
+         if(results[i] == SUCCESS)
+            results[i] = PARENT_CHILD_ERROR;
+      free(created);
+      return;
+   }
+
+   i = 0;
+   j = 0;
+   for(c = 0; c < numOld + numNew; c++)
+   {
+      old = (i < numOld) ? NodeD_getChild(&parent->fileChildren, i)
+         : NULL;
+      if(j == numNew ||
+         (old != NULL && NodeF_compare(old, created[j]) < 0))
+      {
+         NodeD_setChild(&merged, c, old);
+         i++;
+      }
+      else
+      {
+         NodeF_linkFile(created[j], parent);
+         NodeD_setChild(&merged, c, created[j]);
+         j++;
+      }
+   }
+
+   NodeD_freeChildren(&parent->fileChildren);
+   parent->fileChildren = merged;
+   NodeD_invalidate(parent);
+   free(created);
+
+   assert(CheckerFT_Dir_isValid(parent));
+}
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+int NodeD_adoptChildren(Node_D n, Node_D dirs[], size_t numDirs,
+                        Node_F files[], size_t numFiles)
+{
+   struct NodeD_Children dirChildren;
+   struct NodeD_Children fileChildren;
+   size_t i;
+
+   assert(n != NULL);
+   assert(numDirs == 0 || dirs != NULL);
+   assert(numFiles == 0 || files != NULL);
+   assert(NodeD_getNumChildren(n) == 0);
+
+   /* Allocate both arrays at their final sizes before changing n */
+   if(!NodeD_newChildren(&dirChildren, numDirs))
+      return PARENT_CHILD_ERROR;
+   if(!NodeD_newChildren(&fileChildren, numFiles))
+   {
+      NodeD_freeChildren(&dirChildren);
+      return PARENT_CHILD_ERROR;
+   }
+
+   NodeD_freeChildren(&n->dirChildren);
+   NodeD_freeChildren(&n->fileChildren);
+   n->dirChildren = dirChildren;
+   n->fileChildren = fileChildren;
+
+   for(i = 0; i < numDirs; i++)
+   {
+      dirs[i]->parent = n;
+      NodeD_setChild(&n->dirChildren, i, dirs[i]);
+   }
+   for(i = 0; i < numFiles; i++)
+      NodeD_setChild(&n->fileChildren, i, files[i]);
+   for(i = 0; i < numFiles; i++)
+      (void) NodeF_linkFile(files[i], n);
+   NodeD_invalidate(n);
+
+   assert(CheckerFT_Dir_isValid(n));
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
 /* See NodeD.h for specification. */
 Node_D NodeD_addDirChild(Node_D parent, const char* dir)
 {
@@ -629,13 +1166,38 @@ char* NodeD_toString(Node_D n)
 
    assert(n != NULL);
 
-   copyPath = malloc(strlen(n->path)+1);
+   copyPath = malloc(NodeD_getPathLength(n)+1);
    if(copyPath == NULL)
    {
       return NULL;
    }
    else
    {
-      return strcpy(copyPath, n->path);
+      return NodeD_writePath(n, copyPath);
    }
 }
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+const char* NodeD_getListing(Node_D n, size_t* pLength)
+{
+   assert(n != NULL);
+   assert(pLength != NULL);
+
+   *pLength = n->listingLength;
+   return n->listing;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* See NodeD.h for specification. */
+void NodeD_setListing(Node_D n, char* listing, size_t length)
+{
+   assert(n != NULL);
+   assert(listing != NULL);
+
+   free(n->listing);
+   n->listing = listing;
+   n->listingLength = length;
+}
@@ -9,20 +9,88 @@
 #include <stddef.h>
 #include "a4def.h"
 #include "nodes.h"
+#include "storeFT.h"
 
 /* Destroys the entire hierarchy of nodes rooted at n, including n
-itself. Returns the number of nodes destroyed. */
+itself. Returns the number of nodes destroyed. Uses the same stack
+space however deep the hierarchy is.
+
+A node that a snapshot still shares, n included, is only unlinked and
+released, and is destroyed, together with what is below it, by the
+last release. */
 
 size_t NodeD_destroy(Node_D n);
 
-/* Compares node1 and node2 based on their paths.
+/* Adds a reference to n, on behalf of a snapshot of the tree that
+   shares the hierarchy rooted at n. The reference is released with
+   NodeD_destroy. */
+
+void NodeD_share(Node_D n);
+
+/* Returns TRUE if n has more than one reference, so that it is shared
+   with a snapshot and must not be changed in place, and FALSE
+   otherwise. */
+
+boolean NodeD_isShared(Node_D n);
+
+/* Makes a private copy of n, which must be shared, for the tree to
+   change in n's place. n's parent, which must not be shared itself,
+   has the copy as its child instead of n, so the tree's reference
+   moves from n to the copy; a root has no parent, and its caller makes
+   the copy the root. The copy has the same name and children as n,
+   which from then on are shared by both and have the copy as their
+   parent; nothing below is copied. The copy starts dirty.
+
+   Returns the copy, or NULL if there is an allocation error, in which
+   case nothing is changed. */
+
+Node_D NodeD_unshare(Node_D n);
+
+/* Makes a private copy of file, a shared child file of parent, which
+   must not be shared itself, with contents and length in place of
+   file's, copied into store as NodeF_create does, and replaces file
+   with it among parent's children.
+
+   Returns the copy, or NULL if there is an allocation error, in which
+   case nothing is changed. */
+
+Node_F NodeD_unshareFile(Node_D parent, Node_F file, void* contents,
+                         size_t length, StoreFT_T store);
+
+/* Unlinks n from its parent, if it has one, so that n becomes the root
+   of a hierarchy of its own that is no longer part of any tree: from
+   then on, NodeD_hasPath is FALSE for n and all of its descendants, as
+   is NodeF_hasPath for their files. The hierarchy is not freed.
+
+   Returns PARENT_CHILD_ERROR if n is not among its parent's children,
+   and SUCCESS otherwise. */
+
+int NodeD_detach(Node_D n);
+
+/* Compares node1 and node2 based on their names. For siblings this is
+   the same order as comparing their full paths.
    Returns <0, 0, or >0 if node1 is less than,
    equal to, or greater than node2, respectively. */
 
 int NodeD_compare(Node_D node1, Node_D node2);
 
-/* Returns n's path. Return NULL if n is null or the operation fails */
-const char* NodeD_getPath(Node_D n);
+/* Returns n's name, the final component of its path.
+   Return NULL if n is null. */
+const char* NodeD_getName(Node_D n);
+
+/* Returns the length of n's full path. */
+size_t NodeD_getPathLength(Node_D n);
+
+/* Writes n's full path, built from the names of n and its ancestors,
+   into buf, which must have room for NodeD_getPathLength(n) + 1
+   characters. Returns buf. */
+char* NodeD_writePath(Node_D n, char* buf);
+
+/* Returns TRUE if the first len characters of path are exactly n's
+   full path, and FALSE otherwise, including when n has been detached
+   from its tree. path must have at least len characters. Never
+   allocates. */
+boolean NodeD_hasPath(Node_D n, const char* path, size_t len);
 
 /* Returns the number of child directories/files n has. */
 
@@ -36,9 +104,10 @@ size_t NodeD_getNumFileChildren(Node_D n);
 
 size_t NodeD_getNumDirChildren(Node_D n);
 
-/* Returns 1 if n has a child directory with path,
+/* Returns 1 if n has a child directory with name path,
    0 if it does not have such a child, and -1 if
-   there is an allocation error during search.
+   there is an allocation error during search (the search no longer
+   allocates, so this does not happen).
 
    If n does have such a child, and childID is not NULL, store the
    child's identifier in *childID. If n does not have such a child,
@@ -47,6 +116,21 @@ size_t NodeD_getNumDirChildren(Node_D n);
 /*@unused@*/
 int NodeD_hasDirChild(Node_D n, const char* path, size_t* childID);
 
+/* Returns 1 if n has a child directory whose name is the len
+   characters beginning at name, 0 otherwise. Never allocates.
+
+   If n does have such a child, and childID is not NULL, store the
+   child's identifier in *childID. If n does not have such a child,
+   store the identifier that such a child would have in *childID. */
+
+int NodeD_findDirChild(Node_D n, const char* name, size_t len,
+                       size_t* childID);
+
+/* Same as NodeD_findDirChild, but searches n's child files. */
+
+int NodeD_findFileChild(Node_D n, const char* name, size_t len,
+                        size_t* childID);
+
 /* Returns the child fileNode of n with identifier childID, if one
    exists, otherwise returns NULL. */
 
@@ -70,11 +154,13 @@ Node_D NodeD_getParent(Node_D n);
 
 int NodeD_unlinkFileChild(Node_D parent, Node_F child);
 
-/* Creates a new fileNode such that the new fileNode's path is dir 
-   appended to n's path, separated by a slash, and that the new node
-   has no children of its own. The new node's parent is n, and the
-   new node is added as a child of n. The new node contains contents.
-   The new file gets parameters contents and length. 
+/* Creates a new fileNode such that the new fileNode's name is dir,
+   making its path dir appended to n's path, separated by a slash, and
+   such that the new node has no children of its own. The new node's
+   parent is n, and the new node is added as a child of n. The new node
+   contains contents.
+   The new file gets parameters contents and length, copied into store
+   as NodeF_create does.
 
    (Reiterating for clarity: unlike with NodeF_create, parent *is*
    changed so that the link is bidirectional.)
@@ -84,12 +170,36 @@ int NodeD_unlinkFileChild(Node_D parent, Node_F child);
    PARENT_CHILD_ERROR if the new child cannot otherwise be added */
 
 int NodeD_addFileChild(Node_D parent, const char* dir, void* contents,
-size_t length);
+size_t length, StoreFT_T store);
+
+/* Adds k new fileNodes to parent as NodeD_addFileChild does, one for
+   each of names, which must be distinct and sorted in increasing
+   order. The ith new node gets contents[i] and lengths[i], copied into
+   store as NodeF_create does, and the
+   status that NodeD_addFileChild would return for it is stored in
+   results[i]. The new nodes are merged into parent's files in one
+   pass, rather than inserted one at a time. */
 
-/* Creates a new dirNode such that the new dirNode's path is dir
-   appended to n's path, separated by a slash, and that the new node
-   has no children of its own. The new node's parent is n, and the
-   new node is added as a child of n.
+void NodeD_addFileChildren(Node_D parent, const char* names[],
+                           void* contents[], size_t lengths[], size_t k,
+                           StoreFT_T store, int results[]);
+
+/* Makes the numDirs dirNodes of dirs and the numFiles fileNodes of
+   files the children of n, which must have none yet. Each array must
+   be sorted by name with no name repeated, and the children must not
+   be linked to any other parent. The child arrays of n are sized to
+   hold exactly these children.
+
+   Returns SUCCESS, or PARENT_CHILD_ERROR if there is an allocation
+   error, in which case nothing is changed. */
+
+int NodeD_adoptChildren(Node_D n, Node_D dirs[], size_t numDirs,
+                        Node_F files[], size_t numFiles);
+
+/* Creates a new dirNode such that the new dirNode's name is dir,
+   making its path dir appended to n's path, separated by a slash, and
+   such that the new node has no children of its own. The new node's
+   parent is n, and the new node is added as a child of n.
 
    (Reiterating for clarity: unlike with NodeD_create, parent *is*
    changed so that the link is bidirectional.)
@@ -99,12 +209,28 @@ size_t length);
 
 Node_D NodeD_addDirChild(Node_D parent, const char* dir);
 
-/* Returns a string representation for n,
-   or NULL if there is an allocation error.
+/* Returns a string representation for n, its full path built from the
+   names of n and its ancestors, or NULL if there is an allocation error.
 
    Allocates memory for the returned string,
    which is then owned by client! */
 
 char* NodeD_toString(Node_D n);
 
+/* Returns the cached FT_toString listing of the hierarchy rooted at n,
+   which is not '\0'-terminated, and stores its length in *pLength.
+   Returns NULL if n is dirty, i.e. nothing is cached because the
+   hierarchy has changed since the listing was last set. Linking or
+   unlinking a child makes a directory and all of its ancestors dirty.
+
+   The listing is still owned by n. */
+
+const char* NodeD_getListing(Node_D n, size_t* pLength);
+
+/* Caches listing, length characters long, as n's listing, making n
+   clean. Its children must all be clean already. n takes ownership of
+   listing, which must have been allocated with malloc. */
+
+void NodeD_setListing(Node_D n, char* listing, size_t length);
+
 #endif
@@ -19,64 +19,76 @@ struct fileNode {
     /* Length of contents */
     size_t length;
 
-    /* the full path of this file */
-    char* path;
+    /* the name of this file, the final component of its path,
+    stored in the same allocation as the node, after the struct and
+    the room for inline contents, if there is any */
+    char* name;
 
     /* the parent directory of this file */
     Node_D directory;
-};
-
-/* returns a path with contents n->path/dir
-  or NULL if there is an allocation error.
 
-  Allocates memory for the returned string,
-  which is then owned by the caller. */
-static char* NodeF_buildPath(Node_D n, const char* dir) {
-    char* newPath;
+    /* the number of directories whose children include this file,
+    which is more than one while a snapshot of the tree shares it */
+    size_t refs;
 
-    assert(dir != NULL);
+    /* the store that the file's own copy of its contents is in, unless
+    the copy is inline, right after the struct, or NULL if the client
+    owns the contents */
+    StoreFT_T store;
+};
 
-    if(n == NULL)
-        newPath = malloc(strlen(dir)+1);
-    else
-        newPath = malloc(strlen(NodeD_getPath(n)) + 1 + strlen(dir) + 1);
+/* Returns a pointer to the room for inline contents of n, which is
+where its contents are if they are inline. */
+static char* NodeF_inline(Node_F n) {
+    assert(n != NULL);
 
-   if(newPath == NULL)
-        return NULL;
-   *newPath = '\0';
+    return (char*) (n + 1);
+}
 
-   if(n != NULL) {
-        strcpy(newPath, NodeD_getPath(n));
-        strcat(newPath, "/");
-   }
-   strcat(newPath, dir);
+/* Returns TRUE if n owns its contents and they are in its store, and
+FALSE otherwise. */
+static boolean NodeF_isStored(Node_F n) {
+    assert(n != NULL);
 
-   return newPath;
+    return (boolean) (n->store != NULL && n->contents != NULL &&
+                      (char*) n->contents != NodeF_inline(n));
 }
 
 /* see NodeF.h for specification */
 Node_F NodeF_create(const char* path, Node_D directory, void* contents,
-size_t length) {
+size_t length, StoreFT_T store) {
    Node_F new;
+   size_t room = 0;
 
    assert(directory == NULL || CheckerFT_Dir_isValid(directory));
    assert(path != NULL);
 
-   new = malloc(sizeof(struct fileNode));
+   /* The node, room for short contents that it owns, rounded up so
+      that they can grow a little in place, and its name take a single
+      allocation */
+   if(store != NULL && contents != NULL && length <= NODEF_INLINE)
+      room = (length + 15) / 16 * 16;
+   new = malloc(sizeof(struct fileNode) + room + strlen(path) + 1);
    if(new == NULL)
       return NULL;
 
-
-   new->path = NodeF_buildPath(directory, path);
-   if(new->path == NULL) { 
-      free(new);
-      new = NULL;
-      return NULL;
-   }
+   new->name = strcpy(NodeF_inline(new) + room, path);
 
    new->directory = directory;
-   new->contents = contents;
    new->length = length;
+   new->refs = 1;
+   new->store = store;
+   if(store == NULL || contents == NULL)
+      new->contents = contents;
+   else if(length <= NODEF_INLINE)
+      new->contents = memcpy(NodeF_inline(new), contents, length);
+   else {
+      new->contents = StoreFT_copy(store, contents, length);
+      if(new->contents == NULL) {
+         free(new);
+         return NULL;
+      }
+   }
 
    return new;
 }
@@ -86,14 +98,33 @@ int NodeF_compare(Node_F file1, Node_F file2) {
     assert(file1 != NULL);
     assert(file2 != NULL);
 
-    return strcmp(file1->path, file2->path);
+    return strcmp(file1->name, file2->name);
 }
 
 /* see NodeF.h for specification */
-const char* NodeF_getPath(Node_F n) {
+const char* NodeF_getName(Node_F n) {
     assert(n != NULL);
     
-    return n->path;
+    return n->name;
+}
+
+/* see NodeF.h for specification */
+boolean NodeF_hasPath(Node_F n, const char* path, size_t len) {
+    size_t nameLen;
+
+    assert(n != NULL);
+    assert(path != NULL);
+
+    /* path must end in "/" followed by n's name... */
+    nameLen = strlen(n->name);
+    if(nameLen + 1 > len || path[len - nameLen - 1] != '/' ||
+       strncmp(path + len - nameLen, n->name, nameLen) != 0)
+        return FALSE;
+
+    /* ...and begin with the directory's path */
+    if(n->directory == NULL)
+        return FALSE;
+    return NodeD_hasPath(n->directory, path, len - nameLen - 1);
 }
 
 /* see NodeF.h for specification */
@@ -118,12 +149,30 @@ void* NodeF_getContents(Node_F n) {
 }
 
 /* see NodeF.h for specification */
-void NodeF_replaceContents(Node_F n, void* newContents, 
-size_t newLength) {
+int NodeF_replaceContents(Node_F n, void* newContents,
+size_t newLength, StoreFT_T store) {
+    void* copy = newContents;
+
     assert(n != NULL);
 
-    n->contents = newContents;
+    /* Copy the new contents before the old ones, which they may be,
+    are released */
+    if(store != NULL && newContents != NULL) {
+        if(newLength <= (size_t) (n->name - NodeF_inline(n)))
+            copy = memmove(NodeF_inline(n), newContents, newLength);
+        else {
+            copy = StoreFT_copy(store, newContents, newLength);
+            if(copy == NULL)
+                return MEMORY_ERROR;
+        }
+    }
+
+    if(NodeF_isStored(n))
+        StoreFT_release(n->store, n->contents, n->length);
+    n->contents = copy;
     n->length = newLength;
+    n->store = store;
+    return SUCCESS;
 }
 
 /* see NodeF.h for specification */
@@ -136,13 +185,30 @@ int NodeF_linkFile(Node_F file, Node_D directory) {
 }
 
 
+/* see NodeF.h for specification */
+void NodeF_share(Node_F n) {
+    assert(n != NULL);
+
+    n->refs++;
+}
+
+/* see NodeF.h for specification */
+boolean NodeF_isShared(Node_F n) {
+    assert(n != NULL);
+
+    return (boolean) (n->refs > 1);
+}
+
 /* see NodeF.h for specification. */
 int NodeF_removeFile(Node_F file) {
+    assert(file != NULL);
+    assert(file->refs > 0);
 
-    free(file->path);
-    file->path = NULL;
-    free(file);
-    file = NULL;
+    if(--file->refs == 0) {
+        if(NodeF_isStored(file))
+            StoreFT_release(file->store, file->contents, file->length);
+        free(file);
+    }
 
     return SUCCESS;
 }
@@ -150,12 +216,21 @@ int NodeF_removeFile(Node_F file) {
 /* see NodeF.h for specification. */
 char* NodeF_toString(Node_F n) {
     char* copyPath;
+    size_t dirLen = 0;
 
     assert(n != NULL);
 
-    copyPath = malloc(strlen(n->path)+1);
+    if(n->directory != NULL)
+        dirLen = NodeD_getPathLength(n->directory) + 1;
+
+    copyPath = malloc(dirLen + strlen(n->name)+1);
     if(copyPath == NULL) 
         return NULL;
-    else 
-        return strcpy(copyPath, n->path);
+
+    if(n->directory != NULL) {
+        (void) NodeD_writePath(n->directory, copyPath);
+        copyPath[dirLen - 1] = '/';
+    }
+    strcpy(copyPath + dirLen, n->name);
+    return copyPath;
 }
\ No newline at end of file
@@ -9,6 +9,10 @@
 #include <stddef.h>
 #include "a4def.h"
 #include "nodes.h"
+#include "storeFT.h"
+
+/* The longest contents that a file owning its contents keeps inline */
+enum {NODEF_INLINE = 32};
 
 /*--------------------------------------------------------------------*/
 
@@ -16,27 +20,38 @@
 returns a new Node_F or NULL if any allocation error occurs 
 in creating the file or its fields.
 
-The new structure is initialized to have its path as the directory's
-path prefixed to the file path parameter, separated by a slash. It is 
-also initialized with its directory link as the directory parameter 
-value, but the directory itself is not changed to link to the new node.
-The contents and length are passed to the file. */
+The new structure is initialized to have the path parameter as its
+name, so that its path is the directory's path prefixed to that name,
+separated by a slash. It is also initialized with its directory link as
+the directory parameter value, but the directory itself is not changed
+to link to the new node. The contents and length are passed to the
+file, which keeps the client's pointer if store is NULL. Otherwise the
+file owns a copy of its contents: one of at most NODEF_INLINE bytes is
+kept inline in the node's own allocation, and a longer one in store. */
 
 Node_F NodeF_create(const char* path, Node_D directory, void* contents,
-size_t length);
+size_t length, StoreFT_T store);
 
 /*--------------------------------------------------------------------*/
 
-/* Compares file1 and file2 based on their paths. Returns <0, 0, or >0 
-if node1's path is less than, equal to, or greater than node2's path, 
+/* Compares file1 and file2 based on their names, which for files in the
+same directory orders them as their paths would. Returns <0, 0, or >0 
+if node1's name is less than, equal to, or greater than node2's name, 
 respectively. */
 
 int NodeF_compare(Node_F file1, Node_F file2);
 
 /*--------------------------------------------------------------------*/
 
-/* Returns n's path. */
-const char* NodeF_getPath(Node_F n);
+/* Returns n's name, the final component of its path. */
+const char* NodeF_getName(Node_F n);
+
+/*--------------------------------------------------------------------*/
+
+/* Returns TRUE if the first len characters of path are exactly n's
+full path, and FALSE otherwise. path must have at least len characters.
+Never allocates. */
+boolean NodeF_hasPath(Node_F n, const char* path, size_t len);
 
 /*--------------------------------------------------------------------*/
 
@@ -55,9 +70,16 @@ void* NodeF_getContents(Node_F n);
 
 /*--------------------------------------------------------------------*/
 
-/* Replace the contents of n with newContents and newLength */
-void NodeF_replaceContents(Node_F n, void* newContents, 
-size_t newLength);
+/* Replace the contents of n with newContents and newLength. If store is
+not NULL, n owns a copy of them, as with NodeF_create, and newContents
+may be n's current contents; a short copy is kept inline if n was
+created with room for it. If n owned its old contents, they are
+released.
+
+Returns SUCCESS, or MEMORY_ERROR if the contents cannot be copied, in
+which case n is unchanged. */
+int NodeF_replaceContents(Node_F n, void* newContents,
+size_t newLength, StoreFT_T store);
 
 /*--------------------------------------------------------------------*/
 
@@ -68,8 +90,21 @@ int NodeF_linkFile(Node_F file, Node_D directory);
 
 /*--------------------------------------------------------------------*/
 
+/* Records that one more directory, of a snapshot of the tree, has n
+among its children. */
+void NodeF_share(Node_F n);
+
+/*--------------------------------------------------------------------*/
+
+/* Returns TRUE if more than one directory has n among its children,
+so that n must not be changed in place, and FALSE otherwise. */
+boolean NodeF_isShared(Node_F n);
+
+/*--------------------------------------------------------------------*/
+
 /* Removes the given file from the file tree. Leaves the parent 
-unchanged. 
+unchanged. The file is freed once no directory that shares it is
+left, and so are its contents if it owns them.
 
 Returns SUCCESS upon completion or NULL if the file doesn't exist or 
 it can otherwise not be removed. */
@@ -77,8 +112,8 @@ int NodeF_removeFile(Node_F file);
 
 /*--------------------------------------------------------------------*/
 
-/* Returns a string representation for n,  or NULL if there is an 
-allocation error.
+/* Returns a string representation for n, its full path built from its
+directory's path and its name, or NULL if there is an allocation error.
 
 Allocates memory for the returned string, which is then owned by 
 client. */
@@ -4,6 +4,7 @@
 /*--------------------------------------------------------------------*/
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,44 +17,53 @@
 - make sure total children add up to getnumDir and getnumFile --> check!
 - and the numbers should be right for each category --> check! */
 
+/* The number of calls of CheckerFT_isValid between whole-tree checks,
+   or 0 for none, and the number of calls since the last one. Calls
+   for trees used by different threads run at once, so sampleLock
+   guards both. */
+static size_t sampleRate = 256;
+static size_t sampleCalls = 0;
+static pthread_mutex_t sampleLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* see checkerFT.h for specification */
+void CheckerFT_setSampleRate(size_t rate) {
+   (void) pthread_mutex_lock(&sampleLock);
+   sampleRate = rate;
+   sampleCalls = 0;
+   (void) pthread_mutex_unlock(&sampleLock);
+}
+
+/* Returns TRUE if this call of CheckerFT_isValid is one that checks
+   the whole tree, or FALSE otherwise. */
+static boolean CheckerFT_isSampled(void) {
+   boolean isSampled = FALSE;
+
+   (void) pthread_mutex_lock(&sampleLock);
+   if(sampleRate != 0 && ++sampleCalls >= sampleRate) {
+      sampleCalls = 0;
+      isSampled = TRUE;
+   }
+   (void) pthread_mutex_unlock(&sampleLock);
+   return isSampled;
+}
+
 /* see checkerFT.h for specification */
 boolean CheckerFT_Dir_isValid(Node_D n) {
-   Node_D parent;
-   const char* npath;
-   const char* ppath;
-   const char* rest;
    size_t i;
   
-   /* Initial n->path checks: */
-   /* A NULL pointer is not a valid path */
+   /* n->name checks: */
    if(n != NULL) {
-      if(NodeD_getPath(n) == NULL) {
-         fprintf(stderr, "A node's path is a NULL pointer\n");
-         return FALSE;
-      }
-   } 
-   
-   /* n->parent checks and more n->path checks: */
-   parent = NodeD_getParent(n);
-   if(parent != NULL) {
-      npath = NodeD_getPath(n);
-
-      /* Parent's path must be prefix of n's path */
-      ppath = NodeD_getPath(parent);
-      i = strlen(ppath);
-      if(strncmp(npath, ppath, i)) {
-         fprintf(stderr, "P's path is not a prefix of C's path\n");
+      /* A NULL pointer is not a valid name */
+      if(NodeD_getName(n) == NULL) {
+         fprintf(stderr, "A node's name is a NULL pointer\n");
          return FALSE;
       }
-      /* n's path after parent's path + '/' must have no further
-      '/' characters */
-      rest = npath + i;
-      rest++;
-      if(strstr(rest, "/") != NULL) {
-         fprintf(stderr, "C's path has grandchild of P's path\n");
+      /* A name is a single path component, so it has no '/' */
+      if(strchr(NodeD_getName(n), '/') != NULL) {
+         fprintf(stderr, "A node's name contains a '/'\n");
          return FALSE;
       }
-   }
+   } 
 
    /* n->dirChildren checks: */
    if(NodeD_getNumDirChildren(n) == 1)
@@ -136,86 +146,132 @@ boolean CheckerFT_Dir_isValid(Node_D n) {
 
 /* see checkerFT.h for specification */
 boolean CheckerFT_File_isValid(Node_F n) {
-    const char* ppath;
-    const char* npath;
-    const char* rest;
-    size_t i;
-
     /* A null pointer is not a file */
     if(n == NULL) {
         fprintf(stderr, "A file is a null pointer.\n");
         return FALSE;
     }
 
-    /* A null path is not valid */
-    if(NodeF_getPath(n) == NULL) {
-        fprintf(stderr, "A file's path is a null pointer.\n");
-        return FALSE;
-    }
-
-    /* A null parent is not valid */
-    if(NodeF_getDirectory(n) == NULL) {
-        fprintf(stderr, "A file has a null parent directory.\n");
+    /* A null name is not valid */
+    if(NodeF_getName(n) == NULL) {
+        fprintf(stderr, "A file's name is a null pointer.\n");
         return FALSE;
     }
 
-    /* Parent's path must be prefix of n's path */
-    npath = NodeF_getPath(n);
-    ppath = NodeD_getPath(NodeF_getDirectory(n));
-    i = strlen(ppath);
-    if(strncmp(npath, ppath, i)) {
-        fprintf(stderr, "P's path is not a prefix of C's path.\n");
+    /* A name is a single path component, so it has no '/' */
+    if(strchr(NodeF_getName(n), '/') != NULL) {
+        fprintf(stderr, "A file's name contains a '/'.\n");
         return FALSE;
     }
 
-    /* n's path after parent's path + '/' must have no further
-    '/' characters */
-    rest = npath + i;
-    rest++;
-    if(strstr(rest, "/") != NULL) {
-        fprintf(stderr, "C's path has grandchild of P's path.\n");
+    /* A null parent is not valid */
+    if(NodeF_getDirectory(n) == NULL) {
+        fprintf(stderr, "A file has a null parent directory.\n");
         return FALSE;
     }
 
     return TRUE;
 }
 
-/* Performs a pre-order traversal of the tree rooted at n. Returns FALSE
-if a broken invariant is found and returns TRUE otherwise */
-static boolean CheckerFT_treeCheck(Node_D n) {
+/* Checks n, which must not be NULL, and its children, without
+descending further. Returns FALSE if a broken invariant is found and
+returns TRUE otherwise */
+static boolean CheckerFT_dirCheck(Node_D n) {
    size_t i;
    size_t j;
 
-   if(n != NULL) {
-        /* Sample check on each non-root node: node must be valid */
-        /* If not, pass that failure back up immediately */
-        if(!CheckerFT_Dir_isValid(n))
-            return FALSE; 
-    
-        /* Check each file. */
-        for(i = 0; i < NodeD_getNumFileChildren(n); i++) {
-            Node_F file = NodeD_getFileChild(n, i);
-
-            if(!CheckerFT_File_isValid(file))
-                return FALSE;
-        }
-
-        /* Check each directory. */
-        for(j = 0; j < NodeD_getNumDirChildren(n); j++) {
-            Node_D child = NodeD_getDirChild(n, j);
-
-            if(!CheckerFT_Dir_isValid(child))
-                return FALSE;
-            
-            /* if recurring down one subtree results in a failed check
-            farther down, passes the failure back up immediately */
-            if(!CheckerFT_treeCheck(child))
-                return FALSE;
-        }
+   /* Sample check on each non-root node: node must be valid */
+   /* If not, pass that failure back up immediately */
+   if(!CheckerFT_Dir_isValid(n))
+      return FALSE;
+
+   /* Check each file. */
+   for(i = 0; i < NodeD_getNumFileChildren(n); i++) {
+      Node_F file = NodeD_getFileChild(n, i);
+
+      if(!CheckerFT_File_isValid(file))
+         return FALSE;
+
+      /* The file's parent link must point back to n */
+      if(NodeF_getDirectory(file) != n) {
+         fprintf(stderr, "A file's directory is not its parent\n");
+         return FALSE;
+      }
+   }
+
+   /* Check each directory. */
+   for(j = 0; j < NodeD_getNumDirChildren(n); j++) {
+      Node_D child = NodeD_getDirChild(n, j);
+      size_t length;
+
+      if(!CheckerFT_Dir_isValid(child))
+         return FALSE;
+
+      /* The child's parent link must point back to n */
+      if(NodeD_getParent(child) != n) {
+         fprintf(stderr, "A child's parent link is wrong\n");
+         return FALSE;
+      }
+
+      /* A clean directory's listing includes its children's, so
+      its children must be clean too */
+      if(NodeD_getListing(n, &length) != NULL &&
+         NodeD_getListing(child, &length) == NULL) {
+         fprintf(stderr, "A clean directory has a dirty child\n");
+         return FALSE;
+      }
    }
    return TRUE;
 }
 
+/* Performs a pre-order traversal of the tree rooted at n. Returns FALSE
+if a broken invariant is found and returns TRUE otherwise. The
+traversal does not recurse or allocate, however deep the tree is: it
+goes down to a directory's first child, and back up through the parent
+links, which have been checked on the way down, to the next sibling of
+the nearest ancestor that has one */
+static boolean CheckerFT_treeCheck(Node_D n) {
+   Node_D curr;
+   Node_D parent;
+   size_t childID;
+
+   if(n == NULL)
+      return TRUE;
+
+   curr = n;
+   for(;;) {
+      if(!CheckerFT_dirCheck(curr))
+         return FALSE;
+
+      if(NodeD_getNumDirChildren(curr) != 0) {
+         curr = NodeD_getDirChild(curr, 0);
+         continue;
+      }
+
+      while(curr != n) {
+         parent = NodeD_getParent(curr);
+
+         /* The parent must have curr among its children */
+         if(!NodeD_findDirChild(parent, NodeD_getName(curr),
+                                strlen(NodeD_getName(curr)),
+                                &childID) ||
+            NodeD_getDirChild(parent, childID) != curr) {
+            fprintf(stderr,
+                    "A directory is not among its parent's children\n");
+            return FALSE;
+         }
+
+         if(childID + 1 < NodeD_getNumDirChildren(parent)) {
+            curr = NodeD_getDirChild(parent, childID + 1);
+            break;
+         }
+         curr = parent;
+      }
+      if(curr == n)
+         return TRUE;
+   }
+}
+
 /* see checkerDT.h for specification */
 boolean CheckerFT_isValid(boolean isInit, Node_D root, size_t count) {
 
@@ -263,6 +319,76 @@ boolean CheckerFT_isValid(boolean isInit, Node_D root, size_t count) {
       }
    }
    
-   /* Now checks invariants recursively at each node from the root. */
+   /* Now checks invariants recursively at each node from the root,
+   if this call is one of the sampled ones. */
+   if(!CheckerFT_isSampled())
+      return TRUE;
    return CheckerFT_treeCheck(root);
 }
+
+/* see checkerFT.h for specification */
+boolean CheckerFT_isPathValid(boolean isInit, Node_D root, size_t count,
+                              Node_D n) {
+   Node_D parent;
+   Node_D child;
+   size_t childID;
+   size_t length;
+   size_t i;
+
+   if(!CheckerFT_isValid(isInit, root, count))
+      return FALSE;
+
+   if(n == NULL)
+      return TRUE;
+
+   /* Check each child of n, without descending further. */
+   for(i = 0; i < NodeD_getNumFileChildren(n); i++) {
+      if(!CheckerFT_File_isValid(NodeD_getFileChild(n, i)))
+         return FALSE;
+      if(NodeF_getDirectory(NodeD_getFileChild(n, i)) != n) {
+         fprintf(stderr, "A file's directory is not its parent\n");
+         return FALSE;
+      }
+   }
+   for(i = 0; i < NodeD_getNumDirChildren(n); i++) {
+      child = NodeD_getDirChild(n, i);
+      if(!CheckerFT_Dir_isValid(child))
+         return FALSE;
+      if(NodeD_getParent(child) != n) {
+         fprintf(stderr, "A child's parent link is wrong\n");
+         return FALSE;
+      }
+   }
+
+   /* Check n and its ancestors up to the root. */
+   for(child = n; ; child = parent) {
+      if(!CheckerFT_Dir_isValid(child))
+         return FALSE;
+
+      parent = NodeD_getParent(child);
+      if(parent == NULL)
+         break;
+
+      /* The parent must have child among its children */
+      if(!NodeD_findDirChild(parent, NodeD_getName(child),
+                             strlen(NodeD_getName(child)), &childID) ||
+         NodeD_getDirChild(parent, childID) != child) {
+         fprintf(stderr,
+                 "A directory is not among its parent's children\n");
+         return FALSE;
+      }
+
+      if(NodeD_getListing(parent, &length) != NULL &&
+         NodeD_getListing(child, &length) == NULL) {
+         fprintf(stderr, "A clean directory has a dirty child\n");
+         return FALSE;
+      }
+   }
+
+   if(child != root) {
+      fprintf(stderr, "A directory's ancestors do not lead to the root\n");
+      return FALSE;
+   }
+
+   return TRUE;
+}
@@ -24,4 +24,22 @@ boolean CheckerFT_File_isValid(Node_F n);
    representing the total number of directories in the hierarchy. */
 boolean CheckerFT_isValid(boolean isInit, Node_D root, size_t count);
 
+/* Returns TRUE if the hierarchy passes the checks that involve only
+   the part of it an operation touched, or FALSE otherwise. The global
+   invariants on isInit, root, and count are checked as by
+   CheckerFT_isValid, and so is the whole tree when it is sampled.
+   Beyond that, n and each of its ancestors must be a valid directory
+   that is linked to its parent, the chain of ancestors must end at
+   root, and each child of n must be valid and linked back to n. n may
+   be NULL, in which case only the global invariants are checked. */
+boolean CheckerFT_isPathValid(boolean isInit, Node_D root, size_t count,
+                              Node_D n);
+
+/* Sets how often CheckerFT_isValid and CheckerFT_isPathValid check
+   the whole tree: once every rate calls, counted across all trees and
+   threads, or never if rate is 0. The initial rate is 256, so that a
+   large tree's walk costs each call little; a rate of 1 checks the
+   whole tree on every call. */
+void CheckerFT_setSampleRate(size_t rate);
+
 #endif
@@ -2,139 +2,831 @@
 /* ft.c                                                               */
 /* Author: Daniel Park and John Hart                                  */
 /*--------------------------------------------------------------------*/
+#define _XOPEN_SOURCE 600
+
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#include "dynarray.h"
 #include "ft.h"
+#include "ftExt.h"
 #include "NodeF.h"
 #include "NodeD.h"
 #include "checkerFT.h"
+#include "indexFT.h"
+#include "storeFT.h"
+
+/* One directory of a walk of a hierarchy in progress. */
+struct FT_WalkFrame {
+   /* the directory */
+   Node_D dir;
+   /* the index of its next directory child to visit */
+   size_t next;
+   /* the hash of its path, for walks that update the index */
+   size_t hash;
+   /* the length of its path, for walks that list it */
+   size_t len;
+};
+
+/* A directory that FT_rmDir has detached from a tree, waiting for the
+   reclaimer to free it. */
+struct FT_Reclaim {
+   /* the detached directory */
+   Node_D dir;
+   /* the hash of the path it had */
+   size_t hash;
+   /* TRUE if its nodes are still included in the count of the tree,
+      which goes down as they are freed */
+   boolean isCounted;
+   /* the next directory waiting in the same tree */
+   struct FT_Reclaim* next;
+};
+
+/* A snapshot or journal image mapped by FT_loadSnapshot or
+   FT_replay. */
+struct FT_Mapping {
+   /* the start of the image and its size */
+   void* base;
+   size_t size;
+   /* the next image mapped for the same tree */
+   struct FT_Mapping* next;
+};
+
+/* A journal open for a tree, to which each change to the tree is
+   appended as an FT_JournalRecord. */
+struct FT_Journal {
+   /* the journal file, open for appending */
+   int fd;
+   /* the records not yet written to the file */
+   char* buffer;
+   size_t length;
+   size_t capacity;
+   /* the buffer is written and synced once it holds syncBytes bytes,
+      or once its oldest record is syncMillis milliseconds old */
+   size_t syncBytes;
+   size_t syncMillis;
+   /* when the oldest record in the buffer was added */
+   struct timespec oldest;
+   /* whether a record has been lost since the journal was opened */
+   boolean hasFailed;
+};
+
+/* A File Tree is an ADT with the following state variables: */
+struct FT {
+   /* a flag for if it is in an initialized state (TRUE) or not (FALSE) */
+   boolean isInitialized;
+   /* a pointer to the root node in the hierarchy */
+   Node_D root;
+   /* a counter of the number of nodes in the hierarchy, and of those
+      in removed directories that are still waiting to be freed */
+   size_t count;
+   /* an index from the full path of every node to that node */
+   IndexFT_T pathIndex;
+   /* the work stack of the walks made with the lock held for writing,
+      reused by each of them. It always has room for a frame for every
+      directory on the longest path of the hierarchy, so that those
+      walks never need to allocate */
+   struct FT_WalkFrame* walk;
+   size_t walkCapacity;
+   /* the removed directories waiting to be freed. Entries in the index
+      for their nodes stay until they are, but never match a lookup */
+   struct FT_Reclaim* reclaim;
+   /* whether the tree is on the reclaimer's queue, and the tree after
+      it there, both guarded by reclaimLock */
+   boolean isQueued;
+   FT_T nextQueued;
+   /* the snapshot images that the contents of files loaded with
+      FT_loadSnapshot point into, unmapped when the tree is destroyed */
+   struct FT_Mapping* mappings;
+   /* the journal that changes to the tree are recorded in, or NULL */
+   struct FT_Journal* journal;
+   /* for a snapshot, the tree it was taken of, and the root which that
+      tree had then and which the snapshot shares with it; NULL for a
+      tree of its own. A snapshot has no root, index, work stack, or
+      locks of its own, but its walkCapacity bounds the depth of
+      frozenRoot */
+   FT_T origin;
+   Node_D frozenRoot;
+   /* the number of snapshots of the tree that have not been freed.
+      While there are any, a node is copied before it is changed if a
+      snapshot shares it */
+   size_t numSnapshots;
+   /* whether the tree owns the contents of the files inserted into it,
+      copying them into store. The store outlives the tree's files
+      until the last snapshot sharing them is freed */
+   boolean ownsContents;
+   StoreFT_T store;
+   /* the number of views of the contents of the tree's files, or of
+      its snapshots' files, that have not been released. Like a
+      snapshot, a view keeps the files it pins, and the images and
+      store that their contents may be in */
+   size_t numViews;
+   /* whether FT_free was called on the tree while it still had
+      snapshots or views, which were counted by the fields above; the
+      tree is then destroyed, and the last of them to go frees it */
+   boolean isFreed;
+   /* a lock held shared by queries and exclusively by everything that
+      changes the tree, its index, or its cached listings. A writer
+      waiting for it holds back new queries, so that they cannot
+      starve it */
+   pthread_rwlock_t lock;
+   /* the lock that views, which are acquired and released while
+      holding the tree's lock for reading, take to change reference
+      counts, the store, and numViews, which otherwise change only with
+      the tree's lock held for writing */
+   pthread_mutex_t viewLock;
+};
+
+/* The tree that the functions of ft.h operate on. Its locks are set up
+   by FT_setup */
+static struct FT defaultTree;
+
+/* Makes sure FT_setup runs exactly once */
+static pthread_once_t setupOnce = PTHREAD_ONCE_INIT;
+
+/* The most nodes the reclaimer frees while holding a tree's lock */
+enum {RECLAIM_BUDGET = 1024};
+
+/* Makes sure FT_startReclaimer runs exactly once, and whether the
+   reclaimer thread it starts is running */
+static pthread_once_t reclaimOnce = PTHREAD_ONCE_INIT;
+static boolean haveReclaimer;
+
+/* The queue of trees with removed directories to free, the tree the
+   reclaimer is freeing nodes of, if any, and the lock that guards
+   them. The reclaimer waits on reclaimWork for the queue to fill, and
+   signals reclaimIdle whenever it is done with a tree for the time
+   being */
+static FT_T reclaimHead;
+static FT_T reclaimTail;
+static FT_T reclaimCurrent;
+static pthread_mutex_t reclaimLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reclaimWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t reclaimIdle = PTHREAD_COND_INITIALIZER;
+
+/* Initializes the locks of ft. Returns TRUE on success or FALSE if one
+   could not be initialized, in which case none are left initialized. */
+static boolean FT_initLocks(FT_T ft) {
+   pthread_rwlockattr_t attr;
+   int result;
+
+   assert(ft != NULL);
+
+   if(pthread_mutex_init(&ft->viewLock, NULL) != 0)
+      return FALSE;
+   if(pthread_rwlockattr_init(&attr) != 0) {
+      (void) pthread_mutex_destroy(&ft->viewLock);
+      return FALSE;
+   }
+   /* glibc's locks prefer readers unless asked otherwise; elsewhere
+      POSIX leaves the choice to the implementation */
+#ifdef __GLIBC__
+   (void) pthread_rwlockattr_setkind_np(&attr,
+      PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+   result = pthread_rwlock_init(&ft->lock, &attr);
+   (void) pthread_rwlockattr_destroy(&attr);
+   if(result != 0) {
+      (void) pthread_mutex_destroy(&ft->viewLock);
+      return FALSE;
+   }
+   return TRUE;
+}
 
-/* A File Tree is an AO with 3 state variables: */
-/* a flag for if it is in an initialized state (TRUE) or not (FALSE) */
-static boolean isInitialized;
-/* a pointer to the root node in the hierarchy */
-static Node_D root;
-/* a counter of the number of nodes in the hierarchy */
-static size_t count;
+/* Releases the locks of ft. */
+static void FT_destroyLocks(FT_T ft) {
+   assert(ft != NULL);
 
+   (void) pthread_rwlock_destroy(&ft->lock);
+   (void) pthread_mutex_destroy(&ft->viewLock);
+}
 
-/* Starting at the parameter curr, traverses as far down the hierarchy
-as possible while still matching the path parameter.
+/* Returns TRUE if ft was freed with FT_free and has no snapshots or
+   views left that keep it, so that it must now be freed, or FALSE
+   otherwise. Call with ft's lock held, and its viewLock if ft's lock
+   is held for reading. */
+static boolean FT_isAbandoned(FT_T ft) {
+   assert(ft != NULL);
 
-Returns a pointer to the farthest matching directory down that
-path, or NULL if there is no directory in curr's hierarchy that 
-matches a prefix of the path. */
-static Node_D FT_traverseDirPathFrom(char* path, Node_D curr) {
-   Node_D found;
-   size_t i;
+   return (boolean) (ft->isFreed && ft->numSnapshots == 0 &&
+                     ft->numViews == 0);
+}
+
+/* Frees ft, which FT_destroyTree has already emptied, and its locks,
+   which no thread may hold. */
+static void FT_freeAbandoned(FT_T ft) {
+   assert(ft != NULL);
+   assert(FT_isAbandoned(ft));
+
+   FT_destroyLocks(ft);
+   free(ft);
+}
+
+/* Initializes the locks of defaultTree. If that fails, every use of
+   defaultTree fails its assert. */
+static void FT_setup(void) {
+   boolean result;
+
+   result = FT_initLocks(&defaultTree);
+   assert(result);
+}
+
+/* Returns the tree that the functions of ft.h operate on. */
+static FT_T FT_getDefault(void) {
+   (void) pthread_once(&setupOnce, FT_setup);
+   return &defaultTree;
+}
+
+/* Returns the tree whose locks guard ft: ft itself, or for a snapshot
+   the tree it was taken of, which may change the fields of the nodes
+   that the snapshot shares with it, such as their links up and
+   reference counts, even though it leaves their names and children
+   alone. */
+static FT_T FT_getLockTree(FT_T ft) {
+   assert(ft != NULL);
+
+   return (ft->origin != NULL) ? ft->origin : ft;
+}
+
+/* Acquires ft's lock for reading, after any writer already waiting
+   for it. */
+static void FT_readLock(FT_T ft) {
+   int result;
+
+   assert(ft != NULL);
+
+   result = pthread_rwlock_rdlock(&FT_getLockTree(ft)->lock);
+   assert(result == 0);
+}
+
+/* Acquires ft's lock for writing, keeping new readers out while it
+   waits for those that hold it. */
+static void FT_writeLock(FT_T ft) {
+   int result;
+
+   assert(ft != NULL);
+
+   result = pthread_rwlock_wrlock(&FT_getLockTree(ft)->lock);
+   assert(result == 0);
+}
+
+/* Releases ft's lock. */
+static void FT_unlock(FT_T ft) {
+   int result;
+
+   assert(ft != NULL);
+
+   result = pthread_rwlock_unlock(&FT_getLockTree(ft)->lock);
+   assert(result == 0);
+}
+
+/* The result of resolving a path against the hierarchy with
+FT_resolve, which walks the path down from the root exactly once. */
+struct FT_Cursor {
+   /* the deepest directory whose path is a prefix of the path, or NULL
+   if the path does not even begin with the root's name */
+   Node_D dir;
+
+   /* the file of dir named by the first unmatched component, or NULL if
+   there is none */
+   Node_F file;
+
+   /* the unmatched suffix of the path: empty if dir's path is the whole
+   path, and otherwise the part after dir's path and the '/' that
+   follows it */
+   const char* rest;
+
+   /* the length of dir's path, which is also its length within the
+   path */
+   size_t dirLen;
+};
+
+/* Returns the length of the path component beginning at path, i.e. the
+number of characters before the next '/' or the end of the string. */
+static size_t FT_componentLength(const char* path) {
+   const char* end;
 
    assert(path != NULL);
-   if(curr == NULL) 
-      return NULL;
 
-   /* If the current node has the same path as the path parameter,
-   return curr */
-   else if(!strcmp(path, NodeD_getPath(curr))) 
-      return curr;
+   end = strchr(path, '/');
+   if(end == NULL)
+      return strlen(path);
+   return (size_t)(end - path);
+}
+
+/* Returns the root of the hierarchy that queries on ft see: ft's own
+root, or the root it shares if it is a snapshot. */
+static Node_D FT_getRoot(FT_T ft) {
+   assert(ft != NULL);
+
+   return (ft->origin != NULL) ? ft->frozenRoot : ft->root;
+}
+
+/* Returns TRUE if ft can be changed, i.e. it is initialized and is not
+a snapshot, and FALSE otherwise. */
+static boolean FT_isWritable(FT_T ft) {
+   assert(ft != NULL);
+
+   return (boolean) (ft->isInitialized && ft->origin == NULL);
+}
+
+/* Returns the store that ft copies the contents of new files into, or
+NULL if the client owns them. */
+static StoreFT_T FT_getStore(FT_T ft) {
+   assert(ft != NULL);
+
+   return ft->ownsContents ? ft->store : NULL;
+}
+
+/* Walks path down from the root one component at a time, as far as it
+names directories, and describes where it stopped in *cursor. Each
+level is resolved by a binary search of the current directory's
+children on the next path component. The walk never allocates. */
+static void FT_resolve(FT_T ft, const char* path,
+                       struct FT_Cursor* cursor) {
+   Node_D curr;
+   const char* rest;
+   size_t len;
+   size_t childID;
+
+   assert(path != NULL);
+   assert(cursor != NULL);
+
+   cursor->dir = NULL;
+   cursor->file = NULL;
+   cursor->rest = path;
+   cursor->dirLen = 0;
 
-   /* If the path parameter contains the current node's path, search
-   through all curr's children to find a match */
-   else if(!strncmp(path, NodeD_getPath(curr), 
-   strlen(NodeD_getPath(curr)))) {
-      for(i = 0; i < NodeD_getNumDirChildren(curr); i++) {
-         found = FT_traverseDirPathFrom(path,
-         NodeD_getDirChild(curr, i));
-         if(found != NULL) return found;
+   /* The first component must be the root's name */
+   curr = FT_getRoot(ft);
+   if(curr == NULL)
+      return;
+   len = FT_componentLength(path);
+   if(strncmp(path, NodeD_getName(curr), len) ||
+      NodeD_getName(curr)[len] != '\0')
+      return;
+
+   rest = path + len;
+   while(*rest == '/') {
+      len = FT_componentLength(rest + 1);
+      if(!NodeD_findDirChild(curr, rest + 1, len, &childID)) {
+         /* Not a directory, but the component may still name a file */
+         if(NodeD_findFileChild(curr, rest + 1, len, &childID))
+            cursor->file = NodeD_getFileChild(curr, childID);
+         break;
       }
-      /* If no match is found, return curr */
-      return curr;
+      curr = NodeD_getDirChild(curr, childID);
+      rest += len + 1;
    }
-   /* If the paths don't match, return NULL */
-   return NULL;
+
+   cursor->dir = curr;
+   cursor->dirLen = (size_t)(rest - path);
+   cursor->rest = (*rest == '/') ? rest + 1 : rest;
 }
 
-/* Starting at the parameter curr, traverses as far down the hierarchy
-as possible while still matching the match parameter.
+/* Returns TRUE if the file found by the resolve that produced cursor
+has the whole path, and FALSE if it is only a proper prefix of it. */
+static boolean FT_isExactFile(const struct FT_Cursor* cursor) {
+   assert(cursor != NULL);
+   assert(cursor->file != NULL);
 
-Returns a pointer to the farthest matching file down that path, or NULL
-if there is no file in curr's hierarchy that matches a prefix of the
-path. */
-static Node_F FT_traverseFilePathFrom(char* path, Node_D curr) {
-   Node_D directory;
-   Node_F child;
-   size_t i;
+   return (boolean) (strchr(cursor->rest, '/') == NULL);
+}
+
+/* Returns the directory of ft whose path is path, or NULL if there is
+none. A snapshot has no index, so its path is walked down instead. */
+static Node_D FT_findDir(FT_T ft, const char* path) {
+   struct FT_Cursor cursor;
+
+   assert(ft != NULL);
    assert(path != NULL);
-   assert(CheckerFT_Dir_isValid(curr));
 
-   /* Reach the farthest directory that matches a prefix of the path */
-   directory = FT_traverseDirPathFrom(path, curr);
+   if(ft->pathIndex != NULL)
+      return IndexFT_getDir(ft->pathIndex, path);
 
-   /* If there is no directory that matches a prefix of the path,
-   there is matching file. */
-   if (directory == NULL)
+   FT_resolve(ft, path, &cursor);
+   if(cursor.dir == NULL || cursor.dirLen != strlen(path))
       return NULL;
+   return cursor.dir;
+}
 
-   /* Search the farthest directory's files for a match */
-   for(i = 0; i < NodeD_getNumFileChildren(directory); i++) {
-      child = NodeD_getFileChild(directory, i);
-      /* If a file exists as a proper prefix of the path, return it */
-      if(!strncmp(path, NodeF_getPath(child), 
-      strlen(NodeF_getPath(child))) && child != NULL) {
-         return child;
-      }
-   } 
+/* Same as FT_findDir, but for files. */
+static Node_F FT_findFile(FT_T ft, const char* path) {
+   struct FT_Cursor cursor;
 
-   /* If no match is found, return NULL */
-   return NULL;
+   assert(ft != NULL);
+   assert(path != NULL);
+
+   if(ft->pathIndex != NULL)
+      return IndexFT_getFile(ft->pathIndex, path);
+
+   FT_resolve(ft, path, &cursor);
+   if(cursor.file == NULL || !FT_isExactFile(&cursor))
+      return NULL;
+   return cursor.file;
+}
+
+/* Returns the hash of path as used by pathIndex. */
+static size_t FT_pathHash(const char* path) {
+   assert(path != NULL);
+   return IndexFT_hash(0, path, strlen(path));
+}
+
+/* Returns the hash of the path of a child named name of a directory
+whose path has hash parentHash. */
+static size_t FT_childHash(size_t parentHash, const char* name) {
+   assert(name != NULL);
+   return IndexFT_hash(IndexFT_hash(parentHash, "/", 1), name,
+                       strlen(name));
 }
 
-/* Starting at the root, traverse as far down the hierarchy as possible
-while still matching the path parameter.
+/* Returns the number of directories on the path from the root to n,
+   including both. */
+static size_t FT_depth(Node_D n) {
+   size_t depth;
 
-Returns a pointer to the farthest matching directory down that
-path, or NULL if there is no directory in the root's hierarchy 
-that matches a prefix of the path. */
-static Node_D FT_traverseDirPath(char* path) {
-    assert(path != NULL);
-    return FT_traverseDirPathFrom(path, root);
+   for(depth = 0; n != NULL; n = NodeD_getParent(n))
+      depth++;
+   return depth;
 }
 
-/* Starting at the root, traverse as far down the hierachy as possible
-while still matching the path parameter.
+/* Makes sure that the work stack of ft has room for at least depth
+   frames, doubling its capacity as often as necessary. Returns TRUE on
+   success or FALSE if there is an allocation error, in which case the
+   stack is unchanged. */
+static boolean FT_reserveWalk(FT_T ft, size_t depth) {
+   struct FT_WalkFrame* walk;
+   size_t capacity;
 
-Returns a pointer to the farthest matching file down that path, or NULL 
-if there is no directory in the root's hierarchy that matches a prefix
-of that path. */
-static Node_F FT_traverseFilePath(char* path) {
-   assert(path != NULL);
-   return FT_traverseFilePathFrom(path, root);
+   assert(ft != NULL);
+
+   if(depth <= ft->walkCapacity)
+      return TRUE;
+
+   capacity = (ft->walkCapacity == 0) ? 16 : ft->walkCapacity;
+   while(capacity < depth)
+      capacity *= 2;
+   walk = realloc(ft->walk, capacity * sizeof(struct FT_WalkFrame));
+   if(walk == NULL)
+      return FALSE;
+   ft->walk = walk;
+   ft->walkCapacity = capacity;
+   return TRUE;
+}
+
+/* Sets frame to the start of the visit of n, whose path has hash hash
+   and is len characters long. */
+static void FT_setFrame(struct FT_WalkFrame* frame, Node_D n,
+                        size_t hash, size_t len) {
+   assert(frame != NULL);
+   assert(n != NULL);
+
+   frame->dir = n;
+   frame->next = 0;
+   frame->hash = hash;
+   frame->len = len;
+}
+
+/* Makes sure that no snapshot shares dir, a directory of ft, or any
+   of its ancestors, copying those that one does with NodeD_unshare
+   from the root down, so that dir can be changed without any snapshot
+   seeing it. The copies take the places of the originals in the tree
+   and in its index. The path to dir is gathered on ft's work stack.
+   Returns the directory now at dir's path, which is dir itself unless
+   it was copied, or NULL if there is an allocation error, in which
+   case the copies made so far stay in the tree. */
+static Node_D FT_unshareDir(FT_T ft, Node_D dir) {
+   Node_D curr;
+   Node_D copy;
+   size_t depth;
+   size_t hash = 0;
+   size_t i;
+
+   assert(ft != NULL);
+   assert(dir != NULL);
+
+   /* Nothing is shared without a snapshot */
+   if(ft->numSnapshots == 0)
+      return dir;
+
+   depth = FT_depth(dir);
+   assert(depth <= ft->walkCapacity);
+   i = depth;
+   for(curr = dir; curr != NULL; curr = NodeD_getParent(curr))
+      ft->walk[--i].dir = curr;
+
+   for(i = 0; i < depth; i++) {
+      curr = ft->walk[i].dir;
+      hash = (i == 0) ? FT_pathHash(NodeD_getName(curr)) :
+         FT_childHash(hash, NodeD_getName(curr));
+      if(!NodeD_isShared(curr))
+         continue;
+
+      copy = NodeD_unshare(curr);
+      if(copy == NULL)
+         return NULL;
+      if(i == 0)
+         ft->root = copy;
+      (void) IndexFT_replaceDir(ft->pathIndex, hash, curr, copy);
+      ft->walk[i].dir = copy;
+   }
+
+   return ft->walk[depth - 1].dir;
+}
+
+/* Removes n and its file children from ft's index. hash is the hash of
+   n's path. Returns the number of nodes removed. */
+static size_t FT_unindexDir(FT_T ft, Node_D n, size_t hash) {
+   Node_F file;
+   size_t c;
+
+   assert(ft != NULL);
+   assert(n != NULL);
+
+   for(c = 0; c < NodeD_getNumFileChildren(n); c++) {
+      file = NodeD_getFileChild(n, c);
+      (void) IndexFT_removeFile(ft->pathIndex,
+                                FT_childHash(hash, NodeF_getName(file)),
+                                file);
+   }
+   (void) IndexFT_removeDir(ft->pathIndex, hash, n);
+   return c + 1;
+}
+
+/* Removes every node of the hierarchy rooted at n, including n itself,
+from pathIndex. hash is the hash of n's path; the hashes of the
+descendants are extended from it one name at a time. The walk keeps
+its place on ft's work stack, which is deep enough already. Returns
+the number of nodes removed. */
+static size_t FT_unindexSubtree(FT_T ft, Node_D n, size_t hash) {
+   struct FT_WalkFrame* frame;
+   Node_D child;
+   size_t depth = 1;
+   size_t count;
+
+   assert(ft != NULL);
+   assert(n != NULL);
+   assert(ft->walkCapacity >= 1);
+
+   count = FT_unindexDir(ft, n, hash);
+   FT_setFrame(&ft->walk[0], n, hash, 0);
+   while(depth > 0) {
+      frame = &ft->walk[depth - 1];
+      if(frame->next == NodeD_getNumDirChildren(frame->dir)) {
+         depth--;
+         continue;
+      }
+      child = NodeD_getDirChild(frame->dir, frame->next++);
+      hash = FT_childHash(frame->hash, NodeD_getName(child));
+      count += FT_unindexDir(ft, child, hash);
+      assert(depth < ft->walkCapacity);
+      FT_setFrame(&ft->walk[depth++], child, hash, 0);
+   }
+   return count;
 }
 
 /*
    Destroys the entire hierarchy of nodes rooted at curr,
-   including curr itself.
+   including curr itself. hash is the hash of curr's path.
+   Nodes that a snapshot shares are left to it, but leave the
+   tree all the same.
 */
-static void FT_removeDirPathFrom(Node_D curr) {
-   if(curr != NULL) {
+static void FT_removeDirPathFrom(FT_T ft, Node_D curr, size_t hash) {
+   struct FT_Reclaim* job;
 
-      if(curr == root) {
-         count -= NodeD_destroy(curr);
-         root = NULL;
+   if(curr != NULL) {
+      ft->count -= FT_unindexSubtree(ft, curr, hash);
+
+      /* Without a root the tree has no nodes, so nothing waiting to be
+         freed counts any more, as in FT_deferRemoval */
+      if(curr == ft->root) {
+         (void) NodeD_destroy(curr);
+         ft->root = NULL;
+         ft->count = 0;
+         for(job = ft->reclaim; job != NULL; job = job->next)
+            job->isCounted = FALSE;
       }
       
-      else count -= NodeD_destroy(curr);
+      else (void) NodeD_destroy(curr);
    }
 }
 
-/*
-   Inserts a new directory into the tree rooted at parent, or, if
-   parent is NULL, at the root of the data structure.
+/* Frees nodes of the directories waiting in ft's reclaim list, removing
+   each from the index first, until the list is empty or budget nodes
+   have been freed. Each directory is freed from the bottom up, always
+   taking the last child so that no child array has to shift. The walk
+   starts again from the top of the directory on each call, on ft's
+   work stack, which is still as deep as any detached directory. */
+static void FT_reclaimSlice(FT_T ft, size_t budget) {
+   struct FT_Reclaim* job;
+   struct FT_WalkFrame* frame;
+   Node_D dir;
+   Node_F file;
+   size_t depth;
+   size_t freed = 0;
+   size_t last;
+
+   assert(ft != NULL);
+
+   while(ft->reclaim != NULL && freed < budget) {
+      job = ft->reclaim;
+      assert(ft->walkCapacity >= 1);
+      FT_setFrame(&ft->walk[0], job->dir, job->hash, 0);
+      depth = 1;
+      while(depth > 0 && freed < budget) {
+         frame = &ft->walk[depth - 1];
+         dir = frame->dir;
+
+         if(NodeD_getNumDirChildren(dir) != 0) {
+            last = NodeD_getNumDirChildren(dir);
+            dir = NodeD_getDirChild(dir, last - 1);
+            assert(depth < ft->walkCapacity);
+            FT_setFrame(&ft->walk[depth++], dir,
+                        FT_childHash(frame->hash, NodeD_getName(dir)), 0);
+            continue;
+         }
+
+         last = NodeD_getNumFileChildren(dir);
+         if(last != 0) {
+            file = NodeD_getFileChild(dir, last - 1);
+            (void) IndexFT_removeFile(ft->pathIndex,
+                                      FT_childHash(frame->hash,
+                                                   NodeF_getName(file)),
+                                      file);
+            (void) NodeD_unlinkFileChild(dir, file);
+            (void) NodeF_removeFile(file);
+         }
+         else {
+            (void) IndexFT_removeDir(ft->pathIndex, frame->hash, dir);
+            if(depth == 1)
+               ft->reclaim = job->next;
+            (void) NodeD_destroy(dir);
+            depth--;
+         }
+         if(job->isCounted)
+            ft->count--;
+         freed++;
+      }
+      if(ft->reclaim != job)
+         free(job);
+   }
+}
+
+/* Takes trees off the reclaimer's queue in turn and frees a slice of
+   the nodes waiting in each, holding the tree's lock only for that
+   slice. A tree with nodes left goes back to the end of the queue. */
+static void* FT_reclaimer(void* unused) {
+   FT_T ft;
+   boolean isLeft;
+
+   (void) unused;
+   for(;;) {
+      (void) pthread_mutex_lock(&reclaimLock);
+      while(reclaimHead == NULL)
+         (void) pthread_cond_wait(&reclaimWork, &reclaimLock);
+      ft = reclaimHead;
+      reclaimHead = ft->nextQueued;
+      if(reclaimHead == NULL)
+         reclaimTail = NULL;
+      ft->isQueued = FALSE;
+      reclaimCurrent = ft;
+      (void) pthread_mutex_unlock(&reclaimLock);
+
+      FT_writeLock(ft);
+      FT_reclaimSlice(ft, RECLAIM_BUDGET);
+      assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+      isLeft = (boolean) (ft->reclaim != NULL);
+      FT_unlock(ft);
+
+      /* Once reclaimCurrent is cleared, ft may be freed at any moment,
+         so its lock must already be released */
+      (void) pthread_mutex_lock(&reclaimLock);
+      if(isLeft && !ft->isQueued) {
+         ft->isQueued = TRUE;
+         ft->nextQueued = NULL;
+         if(reclaimTail == NULL)
+            reclaimHead = ft;
+         else
+            reclaimTail->nextQueued = ft;
+         reclaimTail = ft;
+      }
+      reclaimCurrent = NULL;
+      (void) pthread_cond_broadcast(&reclaimIdle);
+      (void) pthread_mutex_unlock(&reclaimLock);
+   }
+   return NULL;
+}
+
+/* Starts the reclaimer thread, detached from the rest of the process.
+   If that fails, removed directories are freed right away instead. */
+static void FT_startReclaimer(void) {
+   pthread_t thread;
+
+   if(pthread_create(&thread, NULL, FT_reclaimer, NULL) == 0) {
+      (void) pthread_detach(thread);
+      haveReclaimer = TRUE;
+   }
+}
+
+/* Detaches curr, a directory of ft whose path has hash hash, from ft,
+   and leaves the freeing of its hierarchy to the reclaimer thread.
+   From then on curr and its descendants are not in ft's namespace,
+   though their index entries are removed only as they are freed.
+   Returns TRUE on success, or FALSE if the reclaimer cannot take curr,
+   in which case ft is unchanged. */
+static boolean FT_deferRemoval(FT_T ft, Node_D curr, size_t hash) {
+   struct FT_Reclaim* job;
+   struct FT_Reclaim* other;
+
+   assert(ft != NULL);
+   assert(curr != NULL);
+
+   (void) pthread_once(&reclaimOnce, FT_startReclaimer);
+   if(!haveReclaimer)
+      return FALSE;
+
+   job = malloc(sizeof(struct FT_Reclaim));
+   if(job == NULL)
+      return FALSE;
+   if(NodeD_detach(curr) != SUCCESS) {
+      free(job);
+      return FALSE;
+   }
+
+   job->dir = curr;
+   job->hash = hash;
+   job->isCounted = TRUE;
+
+   /* Without a root the tree has no nodes, so nothing waiting to be
+      freed counts any more */
+   if(curr == ft->root) {
+      ft->root = NULL;
+      ft->count = 0;
+      job->isCounted = FALSE;
+      for(other = ft->reclaim; other != NULL; other = other->next)
+         other->isCounted = FALSE;
+   }
+   job->next = ft->reclaim;
+   ft->reclaim = job;
+
+   (void) pthread_mutex_lock(&reclaimLock);
+   if(!ft->isQueued) {
+      ft->isQueued = TRUE;
+      ft->nextQueued = NULL;
+      if(reclaimTail == NULL)
+         reclaimHead = ft;
+      else
+         reclaimTail->nextQueued = ft;
+      reclaimTail = ft;
+      (void) pthread_cond_signal(&reclaimWork);
+   }
+   (void) pthread_mutex_unlock(&reclaimLock);
+   return TRUE;
+}
+
+/* Takes ft, which must have no removed directories waiting, off the
+   reclaimer's queue, and waits until the reclaimer is not using it, so
+   that ft can be freed. */
+static void FT_forgetReclaim(FT_T ft) {
+   FT_T prev = NULL;
+   FT_T curr;
+
+   assert(ft != NULL);
+   assert(ft->reclaim == NULL);
+
+   /* The reclaimer may put ft back on the queue as it finishes with
+      it, so ft is taken off only after that */
+   (void) pthread_mutex_lock(&reclaimLock);
+   while(reclaimCurrent == ft)
+      (void) pthread_cond_wait(&reclaimIdle, &reclaimLock);
+   if(ft->isQueued) {
+      for(curr = reclaimHead; curr != ft; curr = curr->nextQueued)
+         prev = curr;
+      if(prev == NULL)
+         reclaimHead = ft->nextQueued;
+      else
+         prev->nextQueued = ft->nextQueued;
+      if(reclaimTail == ft)
+         reclaimTail = prev;
+      ft->isQueued = FALSE;
+   }
+   (void) pthread_mutex_unlock(&reclaimLock);
+}
 
-   If a node representing path already exists, returns ALREADY_IN_TREE
+/*
+   Inserts the components of rest into the tree below parent, or, if
+   parent is NULL, at the root of the data structure. hash is the hash
+   of parent's path. Every component becomes a new directory, except
+   that if isFile is TRUE the last one becomes a new file that stores
+   contents and length.
 
    If there is an allocation error in creating any of the new nodes or
    their fields, returns MEMORY_ERROR
@@ -144,43 +836,52 @@ static void FT_removeDirPathFrom(Node_D curr) {
 
    Otherwise, returns SUCCESS
 */
-static int FT_insertDirRestOfPath(char* path, Node_D parent) {
+static int FT_insertRestOfPath(FT_T ft, const char* rest, Node_D parent,
+size_t hash, boolean isFile, void* contents, size_t length) {
    char* copyPath;
-   char* restPath = path;
    char* dirToken;
+   char* nextToken;
    Node_D newNode;
-   size_t newCount = 0;
-
-   assert(path != NULL);
-
-   /* If curr is NULL but it isn't the root node, 
-      then there is something wrong with the path */
-   if(parent == NULL)
-   {
-      if(root != NULL)
-      {
-         return CONFLICTING_PATH;
-      }
-   }
-   /* Check if node is already in tree */
-   else if(!strcmp(path, NodeD_getPath(parent))) {
-      return ALREADY_IN_TREE;
-   }
+   Node_F newFile;
+   size_t childID;
+   size_t depth;
+   const char* c;
+   int result;
 
-   if(parent != NULL)
-      restPath += (strlen(NodeD_getPath(parent)) + 1);
+   assert(rest != NULL);
+   assert(parent != NULL || ft->root == NULL);
+   assert(parent != NULL || !isFile);
+
+   /* Each new directory makes the hierarchy at most one deeper; make
+      room for that on the work stack before changing anything */
+   depth = isFile ? 0 : 1;
+   for(c = rest; *c != '\0'; c++)
+      if(*c == '/')
+         depth++;
+   if(depth > 0 && !FT_reserveWalk(ft, FT_depth(parent) + depth))
+      return MEMORY_ERROR;
 
    /* Make sure there's no memory error */
-   copyPath = malloc(strlen(restPath)+1);
+   copyPath = malloc(strlen(rest)+1);
    if(copyPath == NULL)
    {
       return MEMORY_ERROR;
    }
-   strcpy(copyPath, restPath);
-   dirToken = strtok(copyPath, "/");
+   strcpy(copyPath, rest);
 
-   while(dirToken != NULL)
+   /* Split the copy in place, skipping empty components */
+   for(dirToken = copyPath; *dirToken != '\0'; dirToken = nextToken)
    {
+      nextToken = dirToken + FT_componentLength(dirToken);
+      if(*nextToken == '/')
+         *nextToken++ = '\0';
+      if(*dirToken == '\0')
+         continue;
+
+      /* The last component of a file path is the file itself */
+      if(isFile && nextToken[strspn(nextToken, "/")] == '\0')
+         break;
+
       newNode = NodeD_addDirChild(parent, dirToken);
 
       /* Check for memory error */
@@ -190,40 +891,82 @@ static int FT_insertDirRestOfPath(char* path, Node_D parent) {
          return MEMORY_ERROR;
       }
 
+      if(parent == NULL)
+         hash = FT_pathHash(dirToken);
+      else
+         hash = FT_childHash(hash, dirToken);
+
+      if(!IndexFT_putDir(ft->pathIndex, hash, newNode))
+      {
+         (void) NodeD_destroy(newNode);
+         free(copyPath);
+         return MEMORY_ERROR;
+      }
+
       /* If the parent is NULL, set the root */
-      if(parent == NULL && root == NULL) {
-         root = newNode;
+      if(parent == NULL && ft->root == NULL) {
+         ft->root = newNode;
       }
 
-      count++;
+      ft->count++;
       parent = newNode;
-      dirToken = strtok(NULL, "/");
    }
 
+   if(!isFile)
+   {
+      free(copyPath);
+      return SUCCESS;
+   }
+
+   /* Add the file */
+   if(*dirToken == '\0')
+   {
+      free(copyPath);
+      return PARENT_CHILD_ERROR;
+   }
+   result = NodeD_addFileChild(parent, dirToken, contents, length,
+                               FT_getStore(ft));
+   if(result != SUCCESS) {
+      free(copyPath);
+      return result;
+   }
+
+   /* Index the new file, backing it out if that fails */
+   (void) NodeD_findFileChild(parent, dirToken, strlen(dirToken),
+                              &childID);
+   newFile = NodeD_getFileChild(parent, childID);
+   if(!IndexFT_putFile(ft->pathIndex, FT_childHash(hash, dirToken),
+                       newFile)) {
+      (void) NodeD_unlinkFileChild(parent, newFile);
+      (void) NodeF_removeFile(newFile);
+      free(copyPath);
+      return MEMORY_ERROR;
+   }
+
+   ft->count++;
    free(copyPath);
-   count += newCount;
    return SUCCESS;
 }
 
-/* see ft.h for specification */
-int FT_insertDir(char *path)
+/* Does FT_insertDirIn with ft's lock held. */
+static int FT_insertDirLocked(FT_T ft, const char* path)
 {
-   Node_D curr;
-   Node_F file;
+   struct FT_Cursor cursor;
    int result;
 
-   assert(CheckerFT_isValid(isInitialized,root,count));
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized,ft->root,ft->count));
    assert(path != NULL);
 
-   if(isInitialized == FALSE)
+   if(!FT_isWritable(ft))
       return INITIALIZATION_ERROR;
 
-   /* Makes sure there isn't a file with the same path */
-   file = FT_traverseFilePath(path);
+   FT_resolve(ft, path, &cursor);
 
-   if(file != NULL) {
+   /* Makes sure there isn't a file with the same path */
+   if(cursor.file != NULL) {
       /* If the file is already in the tree, return ALREADY_IN_TREE */
-      if(!strcmp(NodeF_getPath(file), path))
+      if(FT_isExactFile(&cursor))
          return ALREADY_IN_TREE;
 
       /* If the file exists and it's a proper prefix of path,
@@ -232,396 +975,323 @@ int FT_insertDir(char *path)
    }
    
    /* Makes sure there is no conflict with the path */
-   curr = FT_traverseDirPath(path);
-
-   if(curr == NULL && root != NULL)
+   if(cursor.dir == NULL && ft->root != NULL)
       return CONFLICTING_PATH;
 
-   if(curr != NULL) {
-      if(!strcmp(NodeD_getPath(curr), path))
-         return ALREADY_IN_TREE;
+   if(cursor.dir != NULL && *cursor.rest == '\0')
+      return ALREADY_IN_TREE;
+
+   if(cursor.dir != NULL) {
+      cursor.dir = FT_unshareDir(ft, cursor.dir);
+      if(cursor.dir == NULL)
+         return MEMORY_ERROR;
    }
    
-   result = FT_insertDirRestOfPath(path, curr);
-   assert(CheckerFT_isValid(isInitialized,root,count));
+   result = FT_insertRestOfPath(ft, cursor.rest, cursor.dir,
+                                IndexFT_hash(0, path, cursor.dirLen),
+                                FALSE, NULL, 0);
+   assert(CheckerFT_isPathValid(ft->isInitialized, ft->root, ft->count,
+                                result == SUCCESS ?
+                                IndexFT_getDir(ft->pathIndex, path) :
+                                cursor.dir));
    return result;
 }
 
-/* see ft.h for specification. */
-boolean FT_containsDir(char *path)
+/* Does FT_containsDirIn with ft's lock held. */
+static boolean FT_containsDirLocked(FT_T ft, const char* path)
 {
    Node_D curr;
    boolean result;
 
-   assert(CheckerFT_isValid(isInitialized,root,count));
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized,ft->root,ft->count));
    assert(path != NULL);
 
-   if(!isInitialized)
+   if(!ft->isInitialized)
    {
       return FALSE;
    }
 
-   curr = FT_traverseDirPath(path);
-
+   /* Exact-path queries are answered by the index alone */
+   curr = FT_findDir(ft, path);
 
    if(curr == NULL)
       result = FALSE;
-   else if(strcmp(path, NodeD_getPath(curr)))
-      result = FALSE;
    else
       result = TRUE;
 
-   assert(CheckerFT_isValid(isInitialized,root,count));
+   assert(CheckerFT_isValid(ft->isInitialized,ft->root,ft->count));
    return result;
 }
 
-/* Removes the directory hierarchy rooted at path starting from curr.
-If curr is the data structure's root, root becomes NULL.
-
-Returns NO_SUCH_PATH if curr is not the node for path, and SUCCESS
-otherwise. */
-static int FT_rmDirPathAt(char* path, Node_D curr) {
-   assert(path != NULL);
-   assert(curr != NULL);
-
-   if(!strcmp(path, NodeD_getPath(curr))) {
-      FT_removeDirPathFrom(curr);
-      return SUCCESS;
-   }
-   return NO_SUCH_PATH;
-}
-
-/* see ft.h for specification */
-int FT_rmDir(char *path)
+/* Does FT_rmDirIn with ft's lock held. */
+static int FT_rmDirLocked(FT_T ft, const char* path)
 {
-   Node_D curr;
-   Node_F file;
-   int result;
+   struct FT_Cursor cursor;
+   Node_D parent;
+   size_t hash;
 
-   assert(CheckerFT_isValid(isInitialized,root,count));
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized,ft->root,ft->count));
    assert(path != NULL);
 
-   if(!isInitialized)
+   if(!FT_isWritable(ft))
       return INITIALIZATION_ERROR;
 
-   if(root == NULL)
+   if(ft->root == NULL)
       return NO_SUCH_PATH;
 
+   FT_resolve(ft, path, &cursor);
+
    /* If the path exists, but is a file, return NOT_A_DIRECTORY */
-   file = FT_traverseFilePath(path);
-   if(file != NULL)
+   if(cursor.file != NULL)
       return NOT_A_DIRECTORY;
 
-   /* If no directory is found, return NO_SUCH_PATH */
-   curr = FT_traverseDirPath(path);
-   if(curr == NULL)
-      result =  NO_SUCH_PATH;
+   /* If no directory is found, or the one found does not match the
+   path, return NO_SUCH_PATH */
+   if(cursor.dir == NULL || *cursor.rest != '\0')
+      return NO_SUCH_PATH;
 
-   /* If a directory is found, but does not match the path, return
-   NO_SUCH_PATH */
-   if(!strcmp(NodeD_getPath(curr), path))
-   {
-      result = FT_rmDirPathAt(path, curr);
+   parent = NodeD_getParent(cursor.dir);
+   if(parent != NULL) {
+      parent = FT_unshareDir(ft, parent);
+      if(parent == NULL)
+         return MEMORY_ERROR;
    }
 
-   else result = NO_SUCH_PATH;
+   /* Only detach the directory here, leaving the freeing to the
+      reclaimer, unless it cannot take it. While there are snapshots,
+      which may share any part of it, only the tree's references are
+      released, right away */
+   hash = IndexFT_hash(0, path, cursor.dirLen);
+   if(ft->numSnapshots != 0 || !FT_deferRemoval(ft, cursor.dir, hash))
+      FT_removeDirPathFrom(ft, cursor.dir, hash);
 
-   assert(CheckerFT_isValid(isInitialized,root,count));
-   return result;
+   assert(CheckerFT_isPathValid(ft->isInitialized, ft->root, ft->count,
+                                parent));
+   return SUCCESS;
 }
 
-/* Inserts a new file into the tree rooted at parent that stores
-   given contents and the file's path as well as the file length 
+/* Does FT_insertFileIn with ft's lock held. */
+static int FT_insertFileLocked(FT_T ft, const char* path,
+                               void* contents, size_t length) {
+   struct FT_Cursor cursor;
+   int result;
 
-   If there is an allocation error in creating any of the new nodes or
-   their fields, returns MEMORY_ERROR
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   assert(path != NULL);
 
-   If there is an error linking any of the new nodes,
-   returns PARENT_CHILD_ERROR
+   if(!FT_isWritable(ft))
+      return INITIALIZATION_ERROR;
 
-   Otherwise, returns SUCCESS */
-static int FT_insertFileRestOfPath(char* path, Node_D parent,
-void* contents, size_t length) {
-   int i;
-   char* restPath = path;
-   char* dirToken;
-   Node_D dir;
+   /* Can't insert a file into the root */
+   if(ft->root == NULL)
+      return CONFLICTING_PATH;
 
-   assert(path != NULL);
-   assert(parent != NULL);
+   /* Find the farthest directory down the hierarchy */
+   FT_resolve(ft, path, &cursor);
+   if(cursor.dir == NULL)
+      return CONFLICTING_PATH;
 
-   restPath += (strlen(NodeD_getPath(parent)) + 1);
+   if(cursor.file != NULL) {
+      /* If the file is already in the tree, return ALREADY_IN_TREE */
+      if(FT_isExactFile(&cursor))
+         return ALREADY_IN_TREE;
 
-   /* Make sure there's no memory error */
-   dirToken = malloc(strlen(restPath) + 1);
-   if(dirToken == NULL)
+      /* If the file exists and it's a proper prefix of path,
+      return NOT_A_DIRECTORY */
+      return NOT_A_DIRECTORY;
+   }
+   
+   /* If the directory is already in the tree, return ALREADY_IN_TREE */
+   if(*cursor.rest == '\0')
+      return ALREADY_IN_TREE;
+
+   cursor.dir = FT_unshareDir(ft, cursor.dir);
+   if(cursor.dir == NULL)
       return MEMORY_ERROR;
 
-   strcpy(dirToken, restPath);
-   dirToken = strtok(dirToken, "/");
+   /* Insert any missing directories and then the file */
+   result = FT_insertRestOfPath(ft, cursor.rest, cursor.dir,
+                                IndexFT_hash(0, path, cursor.dirLen),
+                                TRUE, contents, length);
 
-   if(dirToken == NULL)
-      return PARENT_CHILD_ERROR;
+   assert(CheckerFT_isPathValid(ft->isInitialized, ft->root, ft->count,
+                                cursor.dir));
+   return result;
+}
 
-   /* Add directories if needed */
-   while(dirToken != NULL && strstr((const char*)dirToken, "/") != NULL) 
-   {
-      dir = NodeD_addDirChild(parent, (const char*)dirToken);
-      if(dir == NULL) {
-         free(dirToken);
-         return PARENT_CHILD_ERROR;
-      }
-      count++;
-      dirToken = strtok(NULL, "/");
-   }
-
-   /* Add the file */
-   i = NodeD_addFileChild(parent, (const char*)dirToken, contents,
-   length);
-   if(i != SUCCESS) {
-      free(dirToken);
-      return PARENT_CHILD_ERROR;
-   }
-   count++;
-   free(dirToken);
-   return SUCCESS;
-}
-
-/* see ft.h for specification */
-int FT_insertFile(char *path, void *contents, size_t length) {
-   Node_D directory;
-   Node_D parent;
+/* Does FT_containsFileIn with ft's lock held. */
+static boolean FT_containsFileLocked(FT_T ft, const char* path) {
    Node_F file;
-   Node_F newFile;
-   size_t destroyedCount;
-   char *dirPath;
-   int result;
 
-   assert(CheckerFT_isValid(isInitialized, root, count));
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
    assert(path != NULL);
 
-   if(isInitialized == FALSE)
-      return INITIALIZATION_ERROR;
-
-   /* Can't insert a file into the root */
-   if(root == NULL)
-      return CONFLICTING_PATH;
-
-   /* Find the farthest directory down the hierarchy */
-   directory = FT_traverseDirPath(path);
-   if(directory == NULL)
-      return CONFLICTING_PATH;
-
-   /* Find the farthest file down the hierarchy */
-   file = FT_traverseFilePath(path);
-
-   if(file != NULL) {
-      /* If the file is already in the tree, return ALREADY_IN_TREE */
-      if(!strcmp(NodeF_getPath(file), path))
-         return ALREADY_IN_TREE;
-
-      /* If the file exists and it's a proper prefix of path,
-      return NOT_A_DIRECTORY */
-      return NOT_A_DIRECTORY;
-   }
-   
-   /* If the directory is already in the tree, return ALREADY_IN_TREE */
-   dirPath = (char*)NodeD_getPath(directory);
-   if(!strcmp(dirPath, path))
-      return ALREADY_IN_TREE;
-
-   /* Insert a directory at the path */
-   result = FT_insertDir(path);
-   if(result != SUCCESS)
-      return MEMORY_ERROR;
-   
-   /* Set directory to the newly added node */
-   directory = FT_traverseDirPath(path);
-   assert(!strcmp(NodeD_getPath(directory), path)); /*CHECK */
-
-   /* Remove the last directory and insert a file */
-   parent = NodeD_getParent(directory);
-   destroyedCount = NodeD_destroy(directory);
-
-   /* CHECK */
-   assert(destroyedCount == 1);
-   count = count - destroyedCount;
-
-   result = FT_insertFileRestOfPath(path, parent, contents, length);
-   if(result != SUCCESS) 
-      return MEMORY_ERROR;
-   
-   assert(CheckerFT_isValid(isInitialized, root, count));
-
-   /* EXTRA CHECKS JUST TO BE SAFE */
-   newFile = FT_traverseFilePath(path);
-   assert(!strcmp(NodeF_getPath(newFile), path));
-   assert(CheckerFT_File_isValid(newFile));
-   return SUCCESS;
-}
-
-/* see ft.h for specification */
-boolean FT_containsFile(char *path) {
-   Node_F file;
-
-   assert(CheckerFT_isValid(isInitialized, root, count));
-   assert(path != NULL);
+   if(ft->isInitialized == FALSE)
+      return FALSE;
 
-   /* If a file that's a proper prefix of the path doesn't
-   exist, return false */
-   file = FT_traverseFilePath(path);
+   /* If no file has the given path, return false */
+   file = FT_findFile(ft, path);
    if(file == NULL)
       return FALSE;
-   
-   /* If the found file doesn't have the given path, return false */
-   if(strcmp(NodeF_getPath(file), path))
-      return FALSE;
 
-   assert(CheckerFT_isValid(isInitialized, root, count));
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
    return TRUE;
 }
 
-/* see ft.h for specification */
-int FT_rmFile(char *path) {
-   Node_D directory;
+/* Does FT_rmFileIn with ft's lock held. */
+static int FT_rmFileLocked(FT_T ft, const char* path) {
+   struct FT_Cursor cursor;
    Node_D parent;
    Node_F file;
 
-   assert(CheckerFT_isValid(isInitialized, root, count));
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
    assert(path != NULL);
 
-   if(isInitialized == FALSE)
+   if(!FT_isWritable(ft))
       return INITIALIZATION_ERROR;
 
+   FT_resolve(ft, path, &cursor);
+
    /* If there is no directory that's a proper prefix of path, return
    NO_SUCH_PATH */
-   directory = FT_traverseDirPath(path);
-   if(directory == NULL)
+   if(cursor.dir == NULL)
       return NO_SUCH_PATH;
 
    /* If the path is a directory, return NOT_A_FILE */
-   if(!strcmp(NodeD_getPath(directory), path))
+   if(*cursor.rest == '\0')
       return NOT_A_FILE;
 
-   /* If there is no file that's a proper prefix of path, return 
-   NO_SUCH_PATH */
-   file = FT_traverseFilePath(path);
-   if(file == NULL)
-      return NO_SUCH_PATH;
-   
-   /* If the found file doesn't match the path, return NO_SUCH_PATH */
-   if(strcmp(NodeF_getPath(file), path))
+   /* If there is no file with exactly the path, return NO_SUCH_PATH */
+   if(cursor.file == NULL || !FT_isExactFile(&cursor))
       return NO_SUCH_PATH;
+   file = cursor.file;
 
    /* If the operation fails, return an error */
-   parent = NodeF_getDirectory(file);
-   assert(parent != NULL);
+   parent = FT_unshareDir(ft, cursor.dir);
+   if(parent == NULL)
+      return MEMORY_ERROR;
+   assert(parent == NodeF_getDirectory(file));
+   (void) IndexFT_removeFile(ft->pathIndex, FT_pathHash(path), file);
    NodeD_unlinkFileChild(parent, file);
    (void)NodeF_removeFile(file);
 
-   assert(CheckerFT_isValid(isInitialized, root, count));
-   count--;
+   assert(CheckerFT_isPathValid(ft->isInitialized, ft->root, ft->count,
+                                parent));
+   ft->count--;
    return SUCCESS;
 }
 
-/* see ft.h for specification */
-void *FT_getFileContents(char *path) {
-   Node_D directory;
+/* Does FT_getFileContentsIn with ft's lock held. */
+static void* FT_getFileContentsLocked(FT_T ft, const char* path) {
    Node_F file;
 
+   assert(ft != NULL);
    assert(path != NULL);
-   assert(CheckerFT_isValid(isInitialized, root, count));
-
-   if(isInitialized == FALSE)
-      return NULL;
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
 
-   /* If a directory doesn't exist as a proper prefix of the path,
-   return NULL */
-   directory = FT_traverseDirPath(path);
-   if(directory == NULL)
-      return NULL;
-   if(!strcmp(NodeD_getPath(directory), path))
+   if(ft->isInitialized == FALSE)
       return NULL;
 
-   /* If the found file doesn't match the path, return NULL */
-   file = FT_traverseFilePath(path);
+   /* If no file has the given path, return NULL */
+   file = FT_findFile(ft, path);
    if(file == NULL)
       return NULL;
-   if(strcmp(NodeF_getPath(file), path))
-      return NULL;
 
-   assert(CheckerFT_isValid(isInitialized, root, count));
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
    return NodeF_getContents(file);
 }
 
-/* see ft.h for specification */
-void *FT_replaceFileContents(char *path, void *newContents,
-size_t newLength) {
-   Node_D directory;
+/* Does FT_replaceFileContentsIn with ft's lock held, and sets
+   *pIsReplaced to whether the contents were replaced. */
+static void* FT_replaceFileContentsLocked(FT_T ft, const char* path,
+                                          void* newContents,
+                                          size_t newLength,
+                                          boolean* pIsReplaced) {
+   Node_D parent;
    Node_F file;
+   Node_F copy;
    void* oldContents;
 
+   assert(ft != NULL);
    assert(path != NULL);
-   assert(CheckerFT_isValid(isInitialized, root, count));
+   assert(pIsReplaced != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
 
-   if(isInitialized == FALSE)
+   *pIsReplaced = FALSE;
+   if(!FT_isWritable(ft))
       return NULL;
 
-   /* If a directory doesn't exist as a proper prefix of the path,
-   return NULL */
-   directory = FT_traverseDirPath(path);
-   if(directory == NULL)
-      return NULL;
-   if(!strcmp(NodeD_getPath(directory), path))
+   /* If no file has the given path, return NULL */
+   file = IndexFT_getFile(ft->pathIndex, path);
+   if(file == NULL)
       return NULL;
 
-   /* If the found file doesn't match the path, return NULL */
-   file = FT_traverseFilePath(path);
-   if(file == NULL)
+   /* A snapshot may share the file, either itself or through one of
+      its ancestors, and a view may pin it; either must go on seeing
+      the old contents, so a shared file is replaced by a copy with the
+      new ones */
+   oldContents = NodeF_getContents(file);
+   parent = FT_unshareDir(ft, NodeF_getDirectory(file));
+   if(parent == NULL)
       return NULL;
-   if(strcmp(NodeF_getPath(file), path))
+   if(NodeF_isShared(file)) {
+      copy = NodeD_unshareFile(parent, file, newContents, newLength,
+                               FT_getStore(ft));
+      if(copy == NULL)
+         return NULL;
+      (void) IndexFT_replaceFile(ft->pathIndex, FT_pathHash(path), file,
+                                 copy);
+      file = copy;
+   }
+   else if(NodeF_replaceContents(file, newContents, newLength,
+                                 FT_getStore(ft)) != SUCCESS)
       return NULL;
+   *pIsReplaced = TRUE;
 
-   oldContents = NodeF_getContents(file);
-   NodeF_replaceContents(file, newContents, newLength);
+   /* An owned file's old contents are released, so the FT's copy of
+      the new ones is returned instead */
+   if(FT_getStore(ft) != NULL)
+      oldContents = NodeF_getContents(file);
 
-   assert(CheckerFT_isValid(isInitialized, root, count));
+   assert(CheckerFT_isPathValid(ft->isInitialized, ft->root, ft->count,
+                                NodeF_getDirectory(file)));
    assert(CheckerFT_File_isValid(file));
 
    return oldContents;
 }
 
-/* see ft.h for specification */
-int FT_stat(char *path, boolean *type, size_t *length) {
+/* Does FT_statIn with ft's lock held. */
+static int FT_statLocked(FT_T ft, const char* path, boolean* type,
+                         size_t* length) {
    Node_D directory;
    Node_F file;
 
-   assert(CheckerFT_isValid(isInitialized, root, count));
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
    assert(path != NULL);
    assert(type != NULL);
    assert(length != NULL);
 
-   if(isInitialized == FALSE)
+   if(ft->isInitialized == FALSE)
       return INITIALIZATION_ERROR;
 
-   directory = FT_traverseDirPath(path);
-   if(directory == NULL)
-      return NO_SUCH_PATH;
-
    /* If the path is a directory: */
-   if(!strcmp(NodeD_getPath(directory), path)) {
+   directory = FT_findDir(ft, path);
+   if(directory != NULL) {
       assert(CheckerFT_Dir_isValid(directory));
       *type = FALSE;
       return SUCCESS;
 
    }
 
-   file = FT_traverseFilePathFrom(path, directory);
-   if(file == NULL)
-      return NO_SUCH_PATH;
-
    /* If the path is a file: */
-   if(!strcmp(NodeF_getPath(file), path)) {
+   file = FT_findFile(ft, path);
+   if(file != NULL) {
       assert(CheckerFT_File_isValid(file));
       *type = TRUE;
       *length = NodeF_getLength(file);
@@ -632,129 +1302,2741 @@ int FT_stat(char *path, boolean *type, size_t *length) {
    return NO_SUCH_PATH;
 }
 
-/* see ft.h for specification. */
-int FT_init(void) {
-   assert(CheckerFT_isValid(isInitialized, root, count));
+/* Writes the len bytes at buf to fd. Returns TRUE on success or FALSE
+   if a write fails. */
+static boolean FT_writeAll(int fd, const char* buf, size_t len) {
+   ssize_t written;
+
+   assert(buf != NULL);
+
+   while(len > 0) {
+      written = write(fd, buf, len);
+      if(written < 0) {
+         if(errno == EINTR)
+            continue;
+         return FALSE;
+      }
+      buf += written;
+      len -= (size_t) written;
+   }
+   return TRUE;
+}
+
+/* Writes the records in journal's buffer to its file and syncs the
+   file, emptying the buffer. If either fails, those records are lost
+   and the journal is marked as having failed. Returns TRUE on success
+   or FALSE on failure. */
+static boolean FT_flushJournal(struct FT_Journal* journal) {
+   assert(journal != NULL);
+
+   if(journal->length > 0 &&
+      (!FT_writeAll(journal->fd, journal->buffer, journal->length) ||
+       fsync(journal->fd) != 0))
+      journal->hasFailed = TRUE;
+   journal->length = 0;
+   return (boolean) !journal->hasFailed;
+}
+
+/* Flushes and closes ft's journal, if it has one. Returns SUCCESS if no
+   record has been lost since the journal was opened,
+   INITIALIZATION_ERROR if ft has no journal, or EOF otherwise. */
+static int FT_closeJournalLocked(FT_T ft) {
+   struct FT_Journal* journal;
+   boolean ok;
+
+   assert(ft != NULL);
+
+   journal = ft->journal;
+   if(journal == NULL)
+      return INITIALIZATION_ERROR;
+
+   ok = FT_flushJournal(journal);
+   if(close(journal->fd) != 0)
+      ok = FALSE;
+   free(journal->buffer);
+   free(journal);
+   ft->journal = NULL;
+   return ok ? SUCCESS : EOF;
+}
+
+/* Initializes ft, which must not be initialized already, to an empty
+   tree. Returns INITIALIZATION_ERROR if ft is already initialized,
+   MEMORY_ERROR if there is an allocation error, or SUCCESS. */
+static int FT_initTree(FT_T ft) {
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
 
-   if (isInitialized == TRUE)
+   if (ft->isInitialized == TRUE)
       return INITIALIZATION_ERROR;
 
-   isInitialized = TRUE;
-   count = 0;
-   root = NULL;
+   ft->pathIndex = IndexFT_new();
+   if (ft->pathIndex == NULL)
+      return MEMORY_ERROR;
+
+   ft->isInitialized = TRUE;
+   ft->count = 0;
+   ft->root = NULL;
 
-   assert(CheckerFT_isValid(isInitialized, root, count));
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
    return SUCCESS;
 }
 
-/* see ft.h for specification */
-int FT_destroy(void) {
-   assert(CheckerFT_isValid(isInitialized, root, count));
+/* Unmaps every image in ft's mappings. */
+static void FT_unmapImages(FT_T ft) {
+   struct FT_Mapping* mapping;
+
+   assert(ft != NULL);
+
+   while(ft->mappings != NULL) {
+      mapping = ft->mappings;
+      ft->mappings = mapping->next;
+      (void) munmap(mapping->base, mapping->size);
+      free(mapping);
+   }
+}
+
+/* Unmaps ft's images and frees its store, unless ft is initialized, or
+   a snapshot or a view still needs them for the files it keeps. */
+static void FT_releaseStorage(FT_T ft) {
+   assert(ft != NULL);
+
+   if(ft->isInitialized || ft->numSnapshots != 0 || ft->numViews != 0)
+      return;
+
+   FT_unmapImages(ft);
+   if(ft->store != NULL) {
+      StoreFT_free(ft->store);
+      ft->store = NULL;
+   }
+}
+
+/* Removes all contents of ft, leaving it uninitialized. Returns
+   INITIALIZATION_ERROR if ft is not initialized, or SUCCESS. */
+static int FT_destroyTree(FT_T ft) {
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+
+   if (ft->isInitialized == FALSE)
+      return INITIALIZATION_ERROR;
 
-   if (isInitialized == FALSE)
+   if(ft->journal != NULL)
+      (void) FT_closeJournalLocked(ft);
+   FT_reclaimSlice(ft, ~(size_t) 0);
+   if(ft->root != NULL)
+      FT_removeDirPathFrom(ft, ft->root,
+                           FT_pathHash(NodeD_getName(ft->root)));
+   IndexFT_free(ft->pathIndex);
+   ft->pathIndex = NULL;
+   free(ft->walk);
+   ft->walk = NULL;
+   ft->walkCapacity = 0;
+   ft->ownsContents = FALSE;
+   ft->isInitialized = FALSE;
+   ft->root = NULL;
+   /* Files that snapshots or views still keep may have their contents
+      in the images or the store, which are then freed by the last of
+      them to go */
+   FT_releaseStorage(ft);
+   assert(ft->count == 0);
+
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   return SUCCESS;
+}
+
+/* Does FT_ownContentsIn, or FT_dedupContentsIn if isDeduplicating is
+   TRUE, with ft's lock held. */
+static int FT_ownContentsLocked(FT_T ft, boolean isDeduplicating) {
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+
+   if(!FT_isWritable(ft) || ft->root != NULL)
+      return INITIALIZATION_ERROR;
+
+   /* A store kept for the snapshots or views of an earlier tree is
+      reused */
+   if(ft->store == NULL) {
+      ft->store = StoreFT_new(isDeduplicating);
+      if(ft->store == NULL)
+         return MEMORY_ERROR;
+   }
+   else
+      StoreFT_setDeduplicating(ft->store, isDeduplicating);
+   ft->ownsContents = TRUE;
+   return SUCCESS;
+}
+
+/* Does FT_getIndexStatsIn for an initialized tree or snapshot ft, with
+   ft's lock held. */
+static void FT_getIndexStatsLocked(FT_T ft, struct FT_IndexStats* stats) {
+   assert(ft != NULL);
+   assert(stats != NULL);
+
+   if(ft->pathIndex == NULL) {
+      stats->numPaths = 0;
+      stats->bytes = 0;
+   }
+   else {
+      stats->numPaths = IndexFT_getNumEntries(ft->pathIndex);
+      stats->bytes = IndexFT_getMemoryUsage(ft->pathIndex);
+   }
+   stats->bytesPerPath = (stats->numPaths == 0) ? 0.0 :
+      (double) stats->bytes / (double) stats->numPaths;
+}
+
+/* Does FT_getContentStatsIn for an initialized tree, or a snapshot of
+   ft, with ft's lock held. */
+static void FT_getContentStatsLocked(FT_T ft,
+                                     struct FT_ContentStats* stats) {
+   assert(ft != NULL);
+   assert(stats != NULL);
+
+   if(ft->store == NULL) {
+      stats->numFiles = 0;
+      stats->bytes = 0;
+      stats->numBlobs = 0;
+      stats->storedBytes = 0;
+      stats->memoryBytes = 0;
+   }
+   else {
+      StoreFT_getStats(ft->store, &stats->numFiles, &stats->bytes,
+                       &stats->numBlobs, &stats->storedBytes);
+      stats->memoryBytes = StoreFT_getMemoryUsage(ft->store);
+   }
+   stats->savedBytes = stats->bytes - stats->storedBytes;
+   stats->ratio = (stats->storedBytes == 0) ? 1.0 :
+      (double) stats->bytes / (double) stats->storedBytes;
+}
+
+/* Does FT_acquireContentsIn with the lock of owner, which is ft or the
+   tree that ft is a snapshot of, held for reading together with its
+   viewLock. */
+static int FT_acquireContentsLocked(FT_T ft, FT_T owner, const char* path,
+                                    struct FT_ContentView* view) {
+   Node_F file;
+
+   assert(ft != NULL);
+   assert(owner != NULL);
+   assert(path != NULL);
+   assert(view != NULL);
+
+   if(!ft->isInitialized)
       return INITIALIZATION_ERROR;
 
-   FT_removeDirPathFrom(root);
-   isInitialized = FALSE;
-   root = NULL;
-   assert(count == 0);
+   file = FT_findFile(ft, path);
+   if(file == NULL)
+      return (FT_findDir(ft, path) != NULL) ? NOT_A_FILE : NO_SUCH_PATH;
+
+   /* The file is now shared, so the tree leaves it as it is and
+      replaces it with a copy to change it */
+   NodeF_share(file);
+   owner->numViews++;
 
-   assert(CheckerFT_isValid(isInitialized, root, count));
+   view->contents = NodeF_getContents(file);
+   view->length = NodeF_getLength(file);
+   view->ft = owner;
+   view->file = file;
    return SUCCESS;
 }
 
-/* Performs a pre-order traversal of the tree rooted at n, going over
-   each directory child and file child to DynArray_T d and DynArray_T f
-   beginning at index i. Returns the total number of nodes in the
-   FT. */
-static size_t FT_preOrderTraversal(Node_D n, DynArray_T d, size_t i)
-{
-   size_t c;
+/* An entry of a batch passed to FT_insertBatch. */
+struct FT_BatchItem {
+   /* the path of the file to insert */
+   const char* path;
+
+   /* the position of the entry in the batch */
+   size_t item;
+
+   /* the length of the path's directory part, before the last '/' */
+   size_t dirLen;
+
+   /* TRUE if the path is a plain file path: it has a directory part,
+      and no component of it is empty */
+   boolean isPlain;
+};
+
+/* Returns the order of character i of the first len characters of
+   path when comparing paths component by component: the end comes
+   first, then '/', and then every other character in the usual
+   order. */
+static int FT_componentOrder(const char* path, size_t len, size_t i) {
+   if(i >= len)
+      return 0;
+   if(path[i] == '/')
+      return 1;
+   return (int) (unsigned char) path[i] + 1;
+}
+
+/* Compares two FT_BatchItems: by their directory parts, component by
+   component, so that the files of each directory are contiguous and
+   the directories appear in pre-order; then by name; then by position
+   in the batch. Returns <0, 0, or >0 as for strcmp. */
+static int FT_compareBatchItems(const void* a, const void* b) {
+   const struct FT_BatchItem* item1 = a;
+   const struct FT_BatchItem* item2 = b;
+   int order1;
+   int order2;
+   int result;
+   size_t i;
 
-   assert(d != NULL);
+   for(i = 0; ; i++) {
+      order1 = FT_componentOrder(item1->path, item1->dirLen, i);
+      order2 = FT_componentOrder(item2->path, item2->dirLen, i);
+      if(order1 != order2)
+         return order1 - order2;
+      if(order1 == 0)
+         break;
+   }
 
-   if(n == root)
-   {
-      (void) DynArray_set(d, i, NodeD_getPath(n));
+   result = strcmp(item1->path + item1->dirLen,
+                   item2->path + item2->dirLen);
+   if(result != 0)
+      return result;
+   if(item1->item < item2->item)
+      return -1;
+   return (item1->item > item2->item);
+}
+
+/* Fills in item for the entry at position i of a batch, with path
+   path. */
+static void FT_initBatchItem(struct FT_BatchItem* item, const char* path,
+                             size_t i) {
+   const char* lastSlash;
+
+   assert(item != NULL);
+   assert(path != NULL);
+
+   item->path = path;
+   item->item = i;
+   lastSlash = strrchr(path, '/');
+   item->dirLen = (lastSlash == NULL) ? 0 : (size_t) (lastSlash - path);
+   item->isPlain = (boolean) (lastSlash != NULL && path[0] != '/' &&
+                              lastSlash[1] != '\0' &&
+                              strstr(path, "//") == NULL);
+}
+
+/* Finds the directory whose path is the first dirLen characters of
+   path, creating any of it that is missing as FT_insertFile does, and
+   stores it in *pDir. The search starts from prev, a directory whose
+   path is the first prevLen characters of prevPath, climbing only as
+   far as the paths differ; prev may be NULL to start from the root.
+   Returns SUCCESS, or the status FT_insertFile would return for every
+   file in the directory if it cannot be found or created. */
+static int FT_findBatchDir(FT_T ft, const char* path, size_t dirLen,
+                           Node_D prev, const char* prevPath,
+                           size_t prevLen, Node_D* pDir) {
+   Node_D dir = prev;
+   size_t len = prevLen;
+   size_t compLen;
+   size_t childID;
+   char* rest;
+   int result;
+
+   assert(ft != NULL);
+   assert(path != NULL);
+   assert(pDir != NULL);
+
+   /* Climb to the deepest ancestor of prev that is a prefix of path */
+   while(dir != NULL &&
+         !(len <= dirLen && (len == dirLen || path[len] == '/') &&
+           strncmp(prevPath, path, len) == 0)) {
+      len -= strlen(NodeD_getName(dir));
+      dir = NodeD_getParent(dir);
+      if(dir != NULL)
+         len--;
    }
-   if(n != NULL) {
-      i++;
-      for(c = 0; c < NodeD_getNumFileChildren(n); c++)
-      {
-         (void) DynArray_set(d, i,
-                             NodeF_getPath(NodeD_getFileChild(n, c)));
-         i++;
+
+   /* Otherwise start from the root, which must be path's first
+      component */
+   if(dir == NULL) {
+      if(ft->root == NULL)
+         return CONFLICTING_PATH;
+      len = strlen(NodeD_getName(ft->root));
+      if(len > dirLen || (len < dirLen && path[len] != '/') ||
+         strncmp(path, NodeD_getName(ft->root), len) != 0)
+         return CONFLICTING_PATH;
+      dir = ft->root;
+   }
+
+   /* Descend through the directories that exist */
+   while(len < dirLen) {
+      compLen = FT_componentLength(path + len + 1);
+      if(compLen > dirLen - len - 1)
+         compLen = dirLen - len - 1;
+      if(!NodeD_findDirChild(dir, path + len + 1, compLen, &childID))
+         break;
+      dir = NodeD_getDirChild(dir, childID);
+      len += compLen + 1;
+   }
+
+   if(len < dirLen) {
+      /* A file in the way is a proper prefix of every path */
+      if(NodeD_findFileChild(dir, path + len + 1, compLen, &childID))
+         return NOT_A_DIRECTORY;
+
+      /* Create the rest of the directory part */
+      dir = FT_unshareDir(ft, dir);
+      if(dir == NULL)
+         return MEMORY_ERROR;
+      rest = malloc(dirLen - len);
+      if(rest == NULL)
+         return MEMORY_ERROR;
+      memcpy(rest, path + len + 1, dirLen - len - 1);
+      rest[dirLen - len - 1] = '\0';
+      result = FT_insertRestOfPath(ft, rest, dir,
+                                   IndexFT_hash(0, path, len),
+                                   FALSE, NULL, 0);
+      free(rest);
+      if(result != SUCCESS)
+         return result;
+
+      /* And descend through it */
+      while(len < dirLen) {
+         compLen = FT_componentLength(path + len + 1);
+         if(compLen > dirLen - len - 1)
+            compLen = dirLen - len - 1;
+         (void) NodeD_findDirChild(dir, path + len + 1, compLen,
+                                   &childID);
+         dir = NodeD_getDirChild(dir, childID);
+         len += compLen + 1;
       }
-      for(c = 0; c < NodeD_getNumDirChildren(n); c++)
-      {
-         (void) DynArray_set(d, i,
-                             NodeD_getPath(NodeD_getDirChild(n, c)));
-         i = FT_preOrderTraversal(NodeD_getDirChild(n, c), d, i);
+   }
+
+   dir = FT_unshareDir(ft, dir);
+   if(dir == NULL)
+      return MEMORY_ERROR;
+   *pDir = dir;
+   return SUCCESS;
+}
+
+/* Does FT_insertBatchIn with ft's lock held. */
+static int FT_insertBatchLocked(FT_T ft, char* paths[], void* contents[],
+                                size_t lengths[], size_t n,
+                                int results[]) {
+   struct FT_BatchItem* items;
+   const char** names;
+   void** groupContents;
+   size_t* groupLengths;
+   size_t* groupItems;
+   int* groupResults;
+   Node_D dir;
+   Node_D prevDir = NULL;
+   const char* prevPath = NULL;
+   size_t prevLen = 0;
+   size_t dirHash;
+   size_t childID;
+   size_t k;
+   size_t i;
+   size_t j;
+   size_t g;
+   Node_F file;
+   int status;
+
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   assert(n == 0 || (paths != NULL && contents != NULL &&
+                     lengths != NULL && results != NULL));
+
+   if(!FT_isWritable(ft))
+      return INITIALIZATION_ERROR;
+
+   if(n == 0)
+      return SUCCESS;
+
+   items = malloc(n * sizeof(struct FT_BatchItem));
+   names = malloc(n * sizeof(const char*));
+   groupContents = malloc(n * sizeof(void*));
+   groupLengths = malloc(n * sizeof(size_t));
+   groupItems = malloc(n * sizeof(size_t));
+   groupResults = malloc(n * sizeof(int));
+   if(items == NULL || names == NULL || groupContents == NULL ||
+      groupLengths == NULL || groupItems == NULL ||
+      groupResults == NULL) {
+      free(items);
+      free(names);
+      free(groupContents);
+      free(groupLengths);
+      free(groupItems);
+      free(groupResults);
+      for(i = 0; i < n; i++)
+         results[i] = MEMORY_ERROR;
+      return MEMORY_ERROR;
+   }
+
+   for(i = 0; i < n; i++) {
+      assert(paths[i] != NULL);
+      FT_initBatchItem(&items[i], paths[i], i);
+   }
+   qsort(items, n, sizeof(struct FT_BatchItem), FT_compareBatchItems);
+
+   for(i = 0; i < n; i = j) {
+      /* Unusual paths are inserted one at a time */
+      if(!items[i].isPlain) {
+         results[items[i].item] =
+            FT_insertFileLocked(ft, items[i].path,
+                                contents[items[i].item],
+                                lengths[items[i].item]);
+         prevDir = NULL;
+         j = i + 1;
+         continue;
+      }
+
+      /* The group of files in the same directory */
+      for(j = i + 1; j < n; j++)
+         if(!items[j].isPlain || items[j].dirLen != items[i].dirLen ||
+            strncmp(items[j].path, items[i].path, items[i].dirLen) != 0)
+            break;
+
+      status = FT_findBatchDir(ft, items[i].path, items[i].dirLen,
+                               prevDir, prevPath, prevLen, &dir);
+      if(status != SUCCESS) {
+         for(g = i; g < j; g++)
+            results[items[g].item] = status;
+         prevDir = NULL;
+         continue;
       }
+
+      /* Collect the names that are not already taken */
+      k = 0;
+      for(g = i; g < j; g++) {
+         names[k] = items[g].path + items[g].dirLen + 1;
+         if((k > 0 && strcmp(names[k - 1], names[k]) == 0) ||
+            NodeD_findDirChild(dir, names[k], strlen(names[k]),
+                               &childID))
+            results[items[g].item] = ALREADY_IN_TREE;
+         else {
+            groupContents[k] = contents[items[g].item];
+            groupLengths[k] = lengths[items[g].item];
+            groupItems[k] = items[g].item;
+            k++;
+         }
+      }
+
+      NodeD_addFileChildren(dir, names, groupContents, groupLengths, k,
+                            FT_getStore(ft), groupResults);
+
+      /* Index the new files, backing out any that cannot be */
+      dirHash = IndexFT_hash(0, items[i].path, items[i].dirLen);
+      for(g = 0; g < k; g++) {
+         if(groupResults[g] == SUCCESS) {
+            (void) NodeD_findFileChild(dir, names[g], strlen(names[g]),
+                                       &childID);
+            file = NodeD_getFileChild(dir, childID);
+            if(IndexFT_putFile(ft->pathIndex,
+                               FT_childHash(dirHash, names[g]), file))
+               ft->count++;
+            else {
+               (void) NodeD_unlinkFileChild(dir, file);
+               (void) NodeF_removeFile(file);
+               groupResults[g] = MEMORY_ERROR;
+            }
+         }
+         results[groupItems[g]] = groupResults[g];
+      }
+
+      prevDir = dir;
+      prevPath = items[i].path;
+      prevLen = items[i].dirLen;
    }
-   return i;
+
+   free(items);
+   free(names);
+   free(groupContents);
+   free(groupLengths);
+   free(groupItems);
+   free(groupResults);
+
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   return SUCCESS;
 }
 
-/* Alternate version of strlen that uses pAcc as an in-out parameter
-   to accumulate a string length, rather than returning the length of
-   str, and also always adds one more in addition to str's length. */
-static void FT_strlenAccumulate(char* str, size_t* pAcc) {
-   assert(pAcc != NULL);
-   assert(str != NULL);
-   
-   *pAcc += (strlen(str) + 1);
+/* A directory that FT_bulkLoad has created but not yet given its
+   children. */
+struct FT_BulkLevel {
+   /* the directory */
+   Node_D dir;
+
+   /* the length of its path, a prefix of the record being loaded */
+   size_t pathLen;
+
+   /* where its files and subdirectories begin on the bulk stacks */
+   size_t fileStart;
+   size_t dirStart;
+};
+
+/* The state of a bulk load: the directories being built, from the root
+   down, the stacks of finished children waiting for their parents
+   to be finished, the number of directories created, and the store
+   that the contents of the files are copied into, or NULL. */
+struct FT_BulkState {
+   struct FT_BulkLevel* levels;
+   size_t numLevels;
+   Node_F* files;
+   size_t numFiles;
+   Node_D* dirs;
+   size_t numDirs;
+   size_t numCreated;
+   StoreFT_T store;
+};
+
+/* Compares the directories pointed to by a and b as NodeD_compare
+   does, for qsort. */
+static int FT_compareDirs(const void* a, const void* b) {
+   return NodeD_compare(*(const Node_D*) a, *(const Node_D*) b);
+}
+
+/* Gives the innermost directory being built its children, which are
+   at the top of the stacks of state, and then pushes it onto the stack
+   of finished directories unless it is the root. Returns SUCCESS,
+   NOT_A_DIRECTORY if a file and a subdirectory share a name, or
+   MEMORY_ERROR if there is an allocation error. */
+static int FT_finishBulkLevel(struct FT_BulkState* state) {
+   struct FT_BulkLevel* level;
+   Node_D* dirs;
+   Node_F* files;
+   size_t numDirs;
+   size_t numFiles;
+   size_t i;
+   size_t j;
+   int order;
+
+   assert(state != NULL);
+   assert(state->numLevels > 0);
+
+   level = &state->levels[state->numLevels - 1];
+   dirs = state->dirs + level->dirStart;
+   numDirs = state->numDirs - level->dirStart;
+   files = state->files + level->fileStart;
+   numFiles = state->numFiles - level->fileStart;
+
+   /* Sorted paths list the subdirectories in name order, except when
+      a name contains a character that sorts before '/' */
+   for(i = 1; i < numDirs; i++)
+      if(NodeD_compare(dirs[i - 1], dirs[i]) > 0) {
+         qsort(dirs, numDirs, sizeof(Node_D), FT_compareDirs);
+         break;
+      }
+
+   /* No name may be both a file and a subdirectory */
+   i = 0;
+   j = 0;
+   while(i < numDirs && j < numFiles) {
+      order = strcmp(NodeD_getName(dirs[i]), NodeF_getName(files[j]));
+      if(order == 0)
+         return NOT_A_DIRECTORY;
+      if(order < 0)
+         i++;
+      else
+         j++;
+   }
+
+   if(NodeD_adoptChildren(level->dir, dirs, numDirs, files, numFiles)
+      != SUCCESS)
+      return MEMORY_ERROR;
+
+   state->numDirs = level->dirStart;
+   state->numFiles = level->fileStart;
+   state->numLevels--;
+   if(state->numLevels > 0)
+      state->dirs[state->numDirs++] = level->dir;
+   return SUCCESS;
 }
 
-/* Alternate version of strcat that inverts the typical argument
-   order, appending str onto acc, and also always adds a newline at
-   the end of the concatenated string. */
-static void FT_strcatAccumulate(char* str, char* acc) {
-   assert(acc != NULL);
-   assert(str != NULL);
+/* Frees every node that the bulk load described by state has created.
+   None of them is indexed yet. */
+static void FT_abandonBulkLoad(struct FT_BulkState* state) {
+   size_t i;
+
+   assert(state != NULL);
 
-   strcat(acc, str); 
-   strcat(acc, "\n");
+   for(i = 0; i < state->numFiles; i++)
+      (void) NodeF_removeFile(state->files[i]);
+   for(i = 0; i < state->numDirs; i++)
+      (void) NodeD_destroy(state->dirs[i]);
+   for(i = state->numLevels; i > 0; i--)
+      (void) NodeD_destroy(state->levels[i - 1].dir);
 }
 
-/* see ft.h for specification */
-char *FT_toString(void) {
-   DynArray_T nodes;
-   size_t totalStrlen = 1;
-   char* result = NULL;
+/* Adds n and its file children to ft's index. hash is the hash of n's
+   path. Returns TRUE on success or FALSE if there is an allocation
+   error. */
+static boolean FT_indexDir(FT_T ft, Node_D n, size_t hash) {
+   Node_F file;
+   size_t c;
 
-   assert(CheckerFT_isValid(isInitialized, root, count));
+   assert(ft != NULL);
+   assert(n != NULL);
 
-   if(isInitialized == FALSE)
-      return NULL;
+   if(!IndexFT_putDir(ft->pathIndex, hash, n))
+      return FALSE;
+   for(c = 0; c < NodeD_getNumFileChildren(n); c++) {
+      file = NodeD_getFileChild(n, c);
+      if(!IndexFT_putFile(ft->pathIndex,
+                          FT_childHash(hash, NodeF_getName(file)), file))
+         return FALSE;
+   }
+   return TRUE;
+}
 
-   if(root == NULL) {
-      result = malloc(sizeof(char));
-      if(result == NULL) {
-         assert(CheckerFT_isValid(isInitialized, root, count));
-         return NULL;
+/* Adds every node of the hierarchy rooted at n, including n itself,
+   to ft's index, walking it as FT_unindexSubtree does. hash is the
+   hash of n's path. Returns TRUE on success or FALSE if there is an
+   allocation error. */
+static boolean FT_indexSubtree(FT_T ft, Node_D n, size_t hash) {
+   struct FT_WalkFrame* frame;
+   Node_D child;
+   size_t depth = 1;
+
+   assert(ft != NULL);
+   assert(n != NULL);
+   assert(ft->walkCapacity >= 1);
+
+   if(!FT_indexDir(ft, n, hash))
+      return FALSE;
+   FT_setFrame(&ft->walk[0], n, hash, 0);
+   while(depth > 0) {
+      frame = &ft->walk[depth - 1];
+      if(frame->next == NodeD_getNumDirChildren(frame->dir)) {
+         depth--;
+         continue;
       }
-      *result = '\0';
-      return result;
+      child = NodeD_getDirChild(frame->dir, frame->next++);
+      hash = FT_childHash(frame->hash, NodeD_getName(child));
+      if(!FT_indexDir(ft, child, hash))
+         return FALSE;
+      assert(depth < ft->walkCapacity);
+      FT_setFrame(&ft->walk[depth++], child, hash, 0);
    }
+   return TRUE;
+}
 
-   nodes = DynArray_new(count);
-   (void) FT_preOrderTraversal(root, nodes, 0);
+/* Checks that paths, which has n entries, is a valid bulk load, and
+   stores the total number of '/' characters in all of its paths in
+   *pSlashes, the most in any one in *pDepth, and the length of the
+   longest in *pMaxLen. Returns SUCCESS or the status FT_bulkLoad
+   returns for an invalid list. */
+static int FT_checkBulkPaths(char* paths[], size_t n, size_t* pSlashes,
+                             size_t* pDepth, size_t* pMaxLen) {
+   const char* c;
+   size_t slashes;
+   size_t i;
+   int order;
+
+   assert(paths != NULL);
+
+   *pSlashes = 0;
+   *pDepth = 0;
+   *pMaxLen = 0;
+   for(i = 0; i < n; i++) {
+      assert(paths[i] != NULL);
+
+      if(i > 0) {
+         order = strcmp(paths[i - 1], paths[i]);
+         if(order == 0)
+            return ALREADY_IN_TREE;
+         if(order > 0)
+            return PARENT_CHILD_ERROR;
+      }
 
-   DynArray_map(nodes, (void (*)(void *, void*)) FT_strlenAccumulate,
-                (void*) &totalStrlen);
+      /* Every path is a file below the root, with no empty component */
+      if(paths[i][0] == '/' || strstr(paths[i], "//") != NULL ||
+         strchr(paths[i], '/') == NULL ||
+         paths[i][strlen(paths[i]) - 1] == '/')
+         return CONFLICTING_PATH;
 
-   result = malloc(totalStrlen);
-   if(result == NULL) {
-      DynArray_free(nodes);
-      assert(CheckerFT_isValid(isInitialized,root,count));
-      return NULL;
+      slashes = 0;
+      for(c = paths[i]; *c != '\0'; c++)
+         if(*c == '/')
+            slashes++;
+      *pSlashes += slashes;
+      if(slashes > *pDepth)
+         *pDepth = slashes;
+      if((size_t) (c - paths[i]) > *pMaxLen)
+         *pMaxLen = (size_t) (c - paths[i]);
    }
-   *result = '\0';
-
-   DynArray_map(nodes, (void (*)(void *, void*)) FT_strcatAccumulate,
-                (void *) result);
+   return SUCCESS;
+}
 
-   DynArray_free(nodes);
-   assert(CheckerFT_isValid(isInitialized,root,count));
-   return result;
+/* Loads the records into state, building the hierarchy from the
+   bottom up. name is a buffer long enough for any path. Returns
+   SUCCESS or the status FT_bulkLoad returns on failure. */
+static int FT_buildBulk(struct FT_BulkState* state, char* paths[],
+                        void* contents[], size_t lengths[], size_t n,
+                        char* name) {
+   const char* path;
+   const char* prev = NULL;
+   size_t common;
+   size_t start;
+   size_t compLen;
+   size_t len;
+   size_t i;
+   Node_D dir;
+   Node_F file;
+   int result;
+
+   for(i = 0; i < n; i++) {
+      path = paths[i];
+
+      /* Finish the directories that are not prefixes of this path */
+      if(prev != NULL) {
+         for(common = 0; path[common] == prev[common]; common++)
+            ;
+         while(state->numLevels > 0 &&
+               !(state->levels[state->numLevels - 1].pathLen <= common &&
+                 path[state->levels[state->numLevels - 1].pathLen]
+                 == '/')) {
+            /* All paths must share the root */
+            if(state->numLevels == 1)
+               return CONFLICTING_PATH;
+            result = FT_finishBulkLevel(state);
+            if(result != SUCCESS)
+               return result;
+         }
+      }
+      prev = path;
+
+      /* Create the directories that are new with this path */
+      len = (state->numLevels == 0) ? 0 :
+         state->levels[state->numLevels - 1].pathLen + 1;
+      for(;;) {
+         compLen = FT_componentLength(path + len);
+         if(path[len + compLen] == '\0')
+            break;
+         memcpy(name, path + len, compLen);
+         name[compLen] = '\0';
+
+         dir = NodeD_addDirChild(NULL, name);
+         if(dir == NULL)
+            return MEMORY_ERROR;
+         state->numCreated++;
+         start = state->numLevels++;
+         state->levels[start].dir = dir;
+         state->levels[start].pathLen = len + compLen;
+         state->levels[start].fileStart = state->numFiles;
+         state->levels[start].dirStart = state->numDirs;
+         len += compLen + 1;
+      }
+
+      /* And the file itself */
+      file = NodeF_create(path + len,
+                          state->levels[state->numLevels - 1].dir,
+                          contents[i], lengths[i], state->store);
+      if(file == NULL)
+         return MEMORY_ERROR;
+      state->files[state->numFiles++] = file;
+   }
+
+   while(state->numLevels > 1) {
+      result = FT_finishBulkLevel(state);
+      if(result != SUCCESS)
+         return result;
+   }
+   return SUCCESS;
+}
+
+/* Does FT_bulkLoadIn with ft's lock held. */
+static int FT_bulkLoadLocked(FT_T ft, char* paths[], void* contents[],
+                             size_t lengths[], size_t n) {
+   struct FT_BulkState state;
+   Node_D newRoot;
+   char* name;
+   size_t slashes;
+   size_t depth;
+   size_t maxLen;
+   size_t hash;
+   int result;
+
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   assert(n == 0 || (paths != NULL && contents != NULL &&
+                     lengths != NULL));
+
+   if(!FT_isWritable(ft) || ft->root != NULL)
+      return INITIALIZATION_ERROR;
+
+   if(n == 0)
+      return SUCCESS;
+
+   result = FT_checkBulkPaths(paths, n, &slashes, &depth, &maxLen);
+   if(result != SUCCESS)
+      return result;
+
+   /* Every stack is allocated at its largest possible size up front,
+      including the work stack of the tree */
+   if(!FT_reserveWalk(ft, depth))
+      return MEMORY_ERROR;
+   state.levels = malloc(depth * sizeof(struct FT_BulkLevel));
+   state.files = malloc(n * sizeof(Node_F));
+   state.dirs = malloc(slashes * sizeof(Node_D));
+   name = malloc(maxLen + 1);
+   state.numLevels = 0;
+   state.numFiles = 0;
+   state.numDirs = 0;
+   state.numCreated = 0;
+   state.store = FT_getStore(ft);
+   if(state.levels == NULL || state.files == NULL ||
+      state.dirs == NULL || name == NULL)
+      result = MEMORY_ERROR;
+   else
+      result = FT_buildBulk(&state, paths, contents, lengths, n, name);
+
+   /* Finish the root last, so that it is not lost if that fails */
+   newRoot = NULL;
+   if(result == SUCCESS) {
+      newRoot = state.levels[0].dir;
+      result = FT_finishBulkLevel(&state);
+   }
+   if(result != SUCCESS)
+      FT_abandonBulkLoad(&state);
+   free(state.levels);
+   free(state.files);
+   free(state.dirs);
+   free(name);
+   if(result != SUCCESS)
+      return result;
+
+   /* Index the whole tree in one pass */
+   hash = FT_pathHash(NodeD_getName(newRoot));
+   if(!FT_indexSubtree(ft, newRoot, hash)) {
+      FT_unindexSubtree(ft, newRoot, hash);
+      (void) NodeD_destroy(newRoot);
+      return MEMORY_ERROR;
+   }
+
+   ft->root = newRoot;
+   ft->count = n + state.numCreated;
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   return SUCCESS;
+}
+
+/* A growable buffer holding the path of the node being listed. */
+struct FT_PathBuffer {
+   /* the characters of the path, not '\0'-terminated */
+   char* chars;
+
+   /* the number of characters chars can hold */
+   size_t capacity;
+};
+
+/* Makes sure that path can hold at least needed characters, doubling
+   its capacity as often as necessary. Returns TRUE on success or FALSE
+   if there is an allocation error, in which case path is unchanged. */
+static boolean FT_reservePath(struct FT_PathBuffer* path, size_t needed)
+{
+   size_t capacity;
+   char* chars;
+
+   assert(path != NULL);
+
+   if(needed <= path->capacity)
+      return TRUE;
+
+   capacity = path->capacity;
+   while(capacity < needed)
+      capacity *= 2;
+   chars = realloc(path->chars, capacity);
+   if(chars == NULL)
+      return FALSE;
+   path->chars = chars;
+   path->capacity = capacity;
+   return TRUE;
+}
+
+/* Writes the first len characters of path, which are a node's full
+   path, as one line through write with extra. Returns SUCCESS,
+   MEMORY_ERROR, or the status returned by write. */
+static int FT_writeLine(struct FT_PathBuffer* path, size_t len,
+                        FT_WriteFn write, void* extra)
+{
+   assert(path != NULL);
+   assert(write != NULL);
+
+   if(!FT_reservePath(path, len + 1))
+      return MEMORY_ERROR;
+   path->chars[len] = '\n';
+   return write(path->chars, len + 1, extra);
+}
+
+/* Appends "/name" to the first len characters of path and returns the
+   new length, or 0 if there is an allocation error. */
+static size_t FT_appendName(struct FT_PathBuffer* path, size_t len,
+                            const char* name)
+{
+   size_t nameLen;
+
+   assert(path != NULL);
+   assert(name != NULL);
+
+   nameLen = strlen(name);
+   if(!FT_reservePath(path, len + 1 + nameLen))
+      return 0;
+   path->chars[len] = '/';
+   memcpy(path->chars + len + 1, name, nameLen);
+   return len + 1 + nameLen;
+}
+
+/* Writes the full path of n, then of each of its file children, as
+   lines through write with extra. The first len characters of path
+   hold n's path. Returns SUCCESS, MEMORY_ERROR, or the first status
+   other than SUCCESS returned by write. */
+static int FT_writeDirLines(Node_D n, struct FT_PathBuffer* path,
+                            size_t len, FT_WriteFn write, void* extra)
+{
+   size_t c;
+   size_t childLen;
+   int status;
+
+   assert(n != NULL);
+   assert(path != NULL);
+
+   status = FT_writeLine(path, len, write, extra);
+   if(status != SUCCESS)
+      return status;
+
+   for(c = 0; c < NodeD_getNumFileChildren(n); c++)
+   {
+      childLen = FT_appendName(path, len,
+                               NodeF_getName(NodeD_getFileChild(n, c)));
+      if(childLen == 0)
+         return MEMORY_ERROR;
+      status = FT_writeLine(path, childLen, write, extra);
+      if(status != SUCCESS)
+         return status;
+   }
+   return SUCCESS;
+}
+
+/* Performs a pre-order traversal of the tree rooted at n, writing the
+   lines of n as FT_writeDirLines does, then those of each of its
+   directory children and their descendants. The first len characters
+   of path hold n's path; each child's path is built by appending its
+   name there, so every character of output is produced once. The walk
+   keeps its place in frames, which must have room for a frame for
+   every directory on the longest path below n. Returns SUCCESS,
+   MEMORY_ERROR, or the first status other than SUCCESS returned by
+   write. */
+static int FT_preOrderTraversal(Node_D n, struct FT_PathBuffer* path,
+                                size_t len, struct FT_WalkFrame* frames,
+                                FT_WriteFn write, void* extra)
+{
+   struct FT_WalkFrame* frame;
+   Node_D child;
+   size_t depth = 1;
+   size_t childLen;
+   int status;
+
+   assert(n != NULL);
+   assert(path != NULL);
+   assert(frames != NULL);
+
+   status = FT_writeDirLines(n, path, len, write, extra);
+   if(status != SUCCESS)
+      return status;
+
+   FT_setFrame(&frames[0], n, 0, len);
+   while(depth > 0)
+   {
+      frame = &frames[depth - 1];
+      if(frame->next == NodeD_getNumDirChildren(frame->dir))
+      {
+         depth--;
+         continue;
+      }
+      child = NodeD_getDirChild(frame->dir, frame->next++);
+      childLen = FT_appendName(path, frame->len, NodeD_getName(child));
+      if(childLen == 0)
+         return MEMORY_ERROR;
+      status = FT_writeDirLines(child, path, childLen, write, extra);
+      if(status != SUCCESS)
+         return status;
+      FT_setFrame(&frames[depth++], child, 0, childLen);
+   }
+   return SUCCESS;
+}
+
+/* Does FT_toStreamIn with ft's lock held. */
+static int FT_toStreamLocked(FT_T ft, FT_WriteFn write, void* extra) {
+   struct FT_PathBuffer path;
+   struct FT_WalkFrame* frames;
+   Node_D root;
+   size_t len;
+   int status;
+
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   assert(write != NULL);
+
+   if(ft->isInitialized == FALSE)
+      return INITIALIZATION_ERROR;
+
+   root = FT_getRoot(ft);
+   if(root == NULL)
+      return SUCCESS;
+
+   len = strlen(NodeD_getName(root));
+   path.capacity = 64;
+   while(path.capacity <= len)
+      path.capacity *= 2;
+   path.chars = malloc(path.capacity);
+   if(path.chars == NULL)
+      return MEMORY_ERROR;
+   memcpy(path.chars, NodeD_getName(root), len);
+
+   /* Other queries may be walking the tree too, so this one cannot
+      share its work stack; it uses one just as large */
+   frames = malloc(ft->walkCapacity * sizeof(struct FT_WalkFrame));
+   if(frames == NULL) {
+      free(path.chars);
+      return MEMORY_ERROR;
+   }
+
+   status = FT_preOrderTraversal(root, &path, len, frames, write,
+                                 extra);
+
+   free(frames);
+   free(path.chars);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   return status;
+}
+
+/* An FT_WriteFn that writes buf to the FILE* stream. */
+static int FT_fileWrite(const char* buf, size_t len, void* stream) {
+   assert(buf != NULL);
+   assert(stream != NULL);
+
+   if(fwrite(buf, 1, len, (FILE*) stream) != len)
+      return EOF;
+   return SUCCESS;
+}
+
+/* see ftExt.h for specification */
+int FT_toFileIn(FT_T ft, FILE* stream) {
+   assert(ft != NULL);
+   assert(stream != NULL);
+
+   return FT_toStreamIn(ft, FT_fileWrite, stream);
+}
+
+/* Builds the listing of n, whose subdirectories must all be clean,
+   from its own path, the paths of its files, and the cached listings of
+   its subdirectories, making n clean. Returns TRUE on success or FALSE
+   if there is an allocation error. */
+static boolean FT_buildDirListing(Node_D n) {
+   Node_D child;
+   const char* name;
+   const char* childListing;
+   char* listing;
+   char* end;
+   size_t pathLen;
+   size_t nameLen;
+   size_t length;
+   size_t total = 0;
+   size_t c;
+
+   assert(n != NULL);
+
+   for(c = 0; c < NodeD_getNumDirChildren(n); c++) {
+      child = NodeD_getDirChild(n, c);
+      childListing = NodeD_getListing(child, &length);
+      assert(childListing != NULL);
+      total += length;
+   }
+
+   pathLen = NodeD_getPathLength(n);
+   total += pathLen + 1;
+   for(c = 0; c < NodeD_getNumFileChildren(n); c++)
+      total += pathLen + strlen(NodeF_getName(NodeD_getFileChild(n, c)))
+         + 2;
+
+   /* One extra byte for the '\0' that NodeD_writePath stores */
+   listing = malloc(total + 1);
+   if(listing == NULL)
+      return FALSE;
+
+   /* The directory's own line, then a line for each file that reuses
+      the directory's path from the first line */
+   (void) NodeD_writePath(n, listing);
+   end = listing + pathLen;
+   *end++ = '\n';
+   for(c = 0; c < NodeD_getNumFileChildren(n); c++) {
+      name = NodeF_getName(NodeD_getFileChild(n, c));
+      nameLen = strlen(name);
+      memcpy(end, listing, pathLen);
+      end += pathLen;
+      *end++ = '/';
+      memcpy(end, name, nameLen);
+      end += nameLen;
+      *end++ = '\n';
+   }
+
+   /* Then the cached listings of the subdirectories */
+   for(c = 0; c < NodeD_getNumDirChildren(n); c++) {
+      childListing = NodeD_getListing(NodeD_getDirChild(n, c), &length);
+      memcpy(end, childListing, length);
+      end += length;
+   }
+   assert((size_t)(end - listing) == total);
+
+   NodeD_setListing(n, listing, total);
+   return TRUE;
+}
+
+/* Makes sure that every directory of the hierarchy rooted at n is
+   clean, building the listing of each dirty one with
+   FT_buildDirListing after those of its subdirectories. Clean subtrees
+   are not visited. The walk keeps its place on ft's work stack.
+   Returns TRUE on success or FALSE if there is an allocation error. */
+static boolean FT_buildListing(FT_T ft, Node_D n) {
+   struct FT_WalkFrame* frame;
+   Node_D child;
+   size_t depth = 1;
+   size_t length;
+
+   assert(ft != NULL);
+   assert(n != NULL);
+   assert(ft->walkCapacity >= 1);
+
+   if(NodeD_getListing(n, &length) != NULL)
+      return TRUE;
+
+   FT_setFrame(&ft->walk[0], n, 0, 0);
+   while(depth > 0) {
+      frame = &ft->walk[depth - 1];
+      if(frame->next < NodeD_getNumDirChildren(frame->dir)) {
+         child = NodeD_getDirChild(frame->dir, frame->next++);
+         if(NodeD_getListing(child, &length) == NULL) {
+            assert(depth < ft->walkCapacity);
+            FT_setFrame(&ft->walk[depth++], child, 0, 0);
+         }
+         continue;
+      }
+      if(!FT_buildDirListing(frame->dir))
+         return FALSE;
+      depth--;
+   }
+   return TRUE;
+}
+
+/* The listing of a snapshot as FT_toString builds it. */
+struct FT_Listing {
+   /* the characters of the listing so far, not '\0'-terminated */
+   struct FT_PathBuffer buffer;
+
+   /* the number of characters in buffer */
+   size_t length;
+};
+
+/* An FT_WriteFn that appends buf to the FT_Listing listing, always
+   leaving room for a '\0' after it. */
+static int FT_listingWrite(const char* buf, size_t len, void* listing) {
+   struct FT_Listing* to = listing;
+
+   assert(buf != NULL);
+   assert(to != NULL);
+
+   if(!FT_reservePath(&to->buffer, to->length + len + 1))
+      return MEMORY_ERROR;
+   memcpy(to->buffer.chars + to->length, buf, len);
+   to->length += len;
+   return SUCCESS;
+}
+
+/* Returns the listing of snapshot, built with FT_toStreamLocked, or
+   NULL if there is an allocation error. The cached listings of the
+   directories it shares are not used: building them would change
+   nodes that other queries, holding the same lock for reading, may be
+   reading at the same time. */
+static char* FT_streamListing(FT_T snapshot) {
+   struct FT_Listing listing;
+
+   assert(snapshot != NULL);
+
+   listing.buffer.capacity = 64;
+   listing.buffer.chars = malloc(listing.buffer.capacity);
+   if(listing.buffer.chars == NULL)
+      return NULL;
+   listing.length = 0;
+
+   if(FT_toStreamLocked(snapshot, FT_listingWrite, &listing) != SUCCESS) {
+      free(listing.buffer.chars);
+      return NULL;
+   }
+   listing.buffer.chars[listing.length] = '\0';
+   return listing.buffer.chars;
+}
+
+/* Does FT_toStringIn with ft's lock held: for writing if ft is not a
+   snapshot and the listing of its root is not cached, and otherwise
+   at least for reading. */
+static char* FT_toStringLocked(FT_T ft) {
+   const char* listing;
+   size_t totalStrlen = 0;
+   char* result;
+
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+
+   if(ft->isInitialized == FALSE)
+      return NULL;
+
+   if(ft->origin != NULL)
+      return FT_streamListing(ft);
+
+   /* Only the directories changed since the last call are rebuilt */
+   if(ft->root == NULL)
+      listing = "";
+   else if(!FT_buildListing(ft, ft->root))
+      return NULL;
+   else
+      listing = NodeD_getListing(ft->root, &totalStrlen);
+
+   result = malloc(totalStrlen + 1);
+   if(result == NULL)
+      return NULL;
+   memcpy(result, listing, totalStrlen);
+   result[totalStrlen] = '\0';
+
+   assert(CheckerFT_isValid(ft->isInitialized,ft->root,ft->count));
+   return result;
+}
+
+/* The start of a snapshot file. The rest of the file holds the
+   hierarchy in the pre-order of FT_toString, one FT_SnapshotRecord for
+   each node. */
+struct FT_SnapshotHeader {
+   /* snapshotMagic, '\0'-padded */
+   char magic[8];
+   /* sizeof(struct FT_SnapshotRecord), so that a snapshot written
+      with a different word size is rejected */
+   size_t recordSize;
+};
+
+/* The kinds of node in a snapshot: a directory, a file, and a file
+   whose contents are NULL */
+enum {SNAPSHOT_DIR, SNAPSHOT_FILE, SNAPSHOT_NULL_FILE};
+
+/* One node of a snapshot. It is followed by the node's name and a
+   '\0', and then, for an SNAPSHOT_FILE, by the length bytes of its
+   contents, each padded with zeros to a multiple of sizeof(size_t) so
+   that the records and contents that follow are aligned. Nothing in
+   the image is an address or an offset, so it can be mapped
+   anywhere. */
+struct FT_SnapshotRecord {
+   /* SNAPSHOT_DIR, SNAPSHOT_FILE, or SNAPSHOT_NULL_FILE */
+   size_t kind;
+   /* the number of directories above the node, 0 for the root */
+   size_t depth;
+   /* the length of the node's name */
+   size_t nameLength;
+   /* the length of a file's contents */
+   size_t length;
+};
+
+/* The magic string that starts every snapshot */
+static const char snapshotMagic[8] = "FTSNAP1";
+
+/* Returns n rounded up to a multiple of sizeof(size_t). */
+static size_t FT_snapshotAlign(size_t n) {
+   return (n + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t);
+}
+
+/* Writes the len bytes at data to stream, padded with zeros as in a
+   snapshot. Returns TRUE on success or FALSE if a write fails. */
+static boolean FT_writePadded(FILE* stream, const void* data,
+                              size_t len) {
+   static const char zeros[sizeof(size_t)];
+   size_t pad;
+
+   assert(stream != NULL);
+
+   pad = FT_snapshotAlign(len) - len;
+   return (boolean) ((len == 0 || fwrite(data, 1, len, stream) == len) &&
+                     fwrite(zeros, 1, pad, stream) == pad);
+}
+
+/* Writes the snapshot record of a node of kind kind, with name name,
+   depth directories deep, and with contents of length length, or NULL,
+   to stream. Returns TRUE on success or FALSE if a write fails. */
+static boolean FT_writeRecord(FILE* stream, size_t kind, size_t depth,
+                              const char* name, const void* contents,
+                              size_t length) {
+   struct FT_SnapshotRecord record;
+
+   assert(stream != NULL);
+   assert(name != NULL);
+
+   record.kind = kind;
+   record.depth = depth;
+   record.nameLength = strlen(name);
+   record.length = length;
+   if(fwrite(&record, sizeof(record), 1, stream) != 1 ||
+      !FT_writePadded(stream, name, record.nameLength + 1))
+      return FALSE;
+   if(kind == SNAPSHOT_FILE)
+      return FT_writePadded(stream, contents, length);
+   return TRUE;
+}
+
+/* Writes the snapshot records of n, which is depth directories deep,
+   and of its files to stream. Returns TRUE on success or FALSE if a
+   write fails. */
+static boolean FT_writeDirRecords(FILE* stream, Node_D n, size_t depth) {
+   Node_F file;
+   size_t c;
+
+   assert(stream != NULL);
+   assert(n != NULL);
+
+   if(!FT_writeRecord(stream, SNAPSHOT_DIR, depth, NodeD_getName(n),
+                      NULL, 0))
+      return FALSE;
+   for(c = 0; c < NodeD_getNumFileChildren(n); c++) {
+      file = NodeD_getFileChild(n, c);
+      if(!FT_writeRecord(stream,
+                         (NodeF_getContents(file) == NULL) ?
+                         SNAPSHOT_NULL_FILE : SNAPSHOT_FILE,
+                         depth + 1, NodeF_getName(file),
+                         NodeF_getContents(file), NodeF_getLength(file)))
+         return FALSE;
+   }
+   return TRUE;
+}
+
+/* Creates a file named by tempPath, whose last six characters must be
+   "XXXXXX" and are replaced to make the name unique, and opens it for
+   writing. Returns the stream, or NULL if the file cannot be created. */
+static FILE* FT_openTemp(char* tempPath) {
+   FILE* stream;
+   int fd;
+
+   assert(tempPath != NULL);
+
+   fd = mkstemp(tempPath);
+   if(fd < 0)
+      return NULL;
+   stream = fdopen(fd, "wb");
+   if(stream == NULL) {
+      (void) close(fd);
+      (void) unlink(tempPath);
+   }
+   return stream;
+}
+
+/* Does FT_saveSnapshotIn with ft's lock held. */
+static int FT_saveSnapshotLocked(FT_T ft, const char* path) {
+   struct FT_SnapshotHeader header;
+   struct FT_WalkFrame* frames = NULL;
+   struct FT_WalkFrame* frame;
+   Node_D root;
+   Node_D child;
+   size_t depth;
+   char* tempPath;
+   FILE* stream;
+   boolean ok;
+
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   assert(path != NULL);
+
+   if(ft->isInitialized == FALSE)
+      return INITIALIZATION_ERROR;
+
+   /* Other queries may be walking the tree too, as for FT_toStream */
+   root = FT_getRoot(ft);
+   if(root != NULL) {
+      frames = malloc(ft->walkCapacity * sizeof(struct FT_WalkFrame));
+      if(frames == NULL)
+         return MEMORY_ERROR;
+   }
+
+   /* The image is written beside path and then renamed over it, since
+      contents loaded from the file at path may still be mapped from it,
+      and so that a failed save leaves that file as it was */
+   tempPath = malloc(strlen(path) + sizeof(".XXXXXX"));
+   if(tempPath == NULL) {
+      free(frames);
+      return MEMORY_ERROR;
+   }
+   strcpy(tempPath, path);
+   strcat(tempPath, ".XXXXXX");
+   stream = FT_openTemp(tempPath);
+   if(stream == NULL) {
+      free(tempPath);
+      free(frames);
+      return NO_SUCH_PATH;
+   }
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+   header.recordSize = sizeof(struct FT_SnapshotRecord);
+   ok = (boolean) (fwrite(&header, sizeof(header), 1, stream) == 1);
+
+   /* A pre-order walk, writing each directory and its files when it
+      is first visited */
+   if(ok && root != NULL) {
+      ok = FT_writeDirRecords(stream, root, 0);
+      FT_setFrame(&frames[0], root, 0, 0);
+      depth = 1;
+      while(ok && depth > 0) {
+         frame = &frames[depth - 1];
+         if(frame->next == NodeD_getNumDirChildren(frame->dir)) {
+            depth--;
+            continue;
+         }
+         child = NodeD_getDirChild(frame->dir, frame->next++);
+         ok = FT_writeDirRecords(stream, child, depth);
+         FT_setFrame(&frames[depth++], child, 0, 0);
+      }
+   }
+
+   if(ok && (fflush(stream) != 0 || fsync(fileno(stream)) != 0))
+      ok = FALSE;
+   if(fclose(stream) != 0)
+      ok = FALSE;
+   if(ok && rename(tempPath, path) != 0)
+      ok = FALSE;
+   if(!ok)
+      (void) unlink(tempPath);
+   free(tempPath);
+   free(frames);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   return ok ? SUCCESS : EOF;
+}
+
+/* Adds the node described by record, whose name is name and whose
+   contents are contents, to the hierarchy that ft's work stack holds
+   the open directories of, depth of them. The root is stored in
+   *pRoot. Returns SUCCESS, PARENT_CHILD_ERROR if the record does not
+   fit the hierarchy, or MEMORY_ERROR if there is an allocation
+   error. */
+static int FT_loadRecord(FT_T ft, const struct FT_SnapshotRecord* record,
+                         const char* name, void* contents,
+                         size_t* pDepth, Node_D* pRoot) {
+   struct FT_WalkFrame* parent = NULL;
+   Node_D dir;
+   Node_F file;
+   size_t childID;
+   size_t hash;
+
+   assert(ft != NULL);
+   assert(record != NULL);
+   assert(name != NULL);
+   assert(pDepth != NULL);
+   assert(pRoot != NULL);
+
+   /* The root comes first, and everything else is in a directory that
+      is still open */
+   if(*pRoot == NULL) {
+      if(record->kind != SNAPSHOT_DIR || record->depth != 0)
+         return PARENT_CHILD_ERROR;
+   }
+   else {
+      if(record->depth == 0 || record->depth > *pDepth)
+         return PARENT_CHILD_ERROR;
+      parent = &ft->walk[record->depth - 1];
+      if(NodeD_findDirChild(parent->dir, name, record->nameLength,
+                            NULL) ||
+         NodeD_findFileChild(parent->dir, name, record->nameLength,
+                             NULL))
+         return PARENT_CHILD_ERROR;
+   }
+
+   if(record->kind != SNAPSHOT_DIR) {
+      assert(parent != NULL);
+      if(NodeD_addFileChild(parent->dir, name, contents, record->length,
+                            NULL) != SUCCESS)
+         return MEMORY_ERROR;
+      (void) NodeD_findFileChild(parent->dir, name, record->nameLength,
+                                 &childID);
+      file = NodeD_getFileChild(parent->dir, childID);
+      if(!IndexFT_putFile(ft->pathIndex,
+                          FT_childHash(parent->hash, name), file))
+         return MEMORY_ERROR;
+      *pDepth = record->depth;
+      return SUCCESS;
+   }
+
+   if(!FT_reserveWalk(ft, record->depth + 1))
+      return MEMORY_ERROR;
+   /* The stack may have moved */
+   if(parent != NULL)
+      parent = &ft->walk[record->depth - 1];
+
+   dir = NodeD_addDirChild((parent == NULL) ? NULL : parent->dir, name);
+   if(dir == NULL)
+      return MEMORY_ERROR;
+   if(parent == NULL) {
+      *pRoot = dir;
+      hash = FT_pathHash(name);
+   }
+   else
+      hash = FT_childHash(parent->hash, name);
+   if(!IndexFT_putDir(ft->pathIndex, hash, dir))
+      return MEMORY_ERROR;
+
+   FT_setFrame(&ft->walk[record->depth], dir, hash, 0);
+   *pDepth = record->depth + 1;
+   return SUCCESS;
+}
+
+/* Does FT_loadSnapshotIn with ft's lock held. */
+static int FT_loadSnapshotLocked(FT_T ft, const char* path) {
+   const struct FT_SnapshotHeader* header;
+   const struct FT_SnapshotRecord* record;
+   struct FT_Mapping* mapping;
+   struct stat status;
+   const char* at;
+   const char* end;
+   const char* name;
+   void* contents;
+   Node_D root = NULL;
+   size_t depth = 0;
+   size_t count = 0;
+   void* base;
+   int fd;
+   int result = SUCCESS;
+
+   assert(ft != NULL);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   assert(path != NULL);
+
+   if(!FT_isWritable(ft) || ft->root != NULL)
+      return INITIALIZATION_ERROR;
+
+   fd = open(path, O_RDONLY);
+   if(fd < 0)
+      return NO_SUCH_PATH;
+   if(fstat(fd, &status) != 0) {
+      (void) close(fd);
+      return NO_SUCH_PATH;
+   }
+   if((size_t) status.st_size < sizeof(struct FT_SnapshotHeader)) {
+      (void) close(fd);
+      return PARENT_CHILD_ERROR;
+   }
+   base = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE,
+               fd, 0);
+   (void) close(fd);
+   if(base == MAP_FAILED)
+      return NO_SUCH_PATH;
+
+   mapping = malloc(sizeof(struct FT_Mapping));
+   if(mapping == NULL) {
+      (void) munmap(base, (size_t) status.st_size);
+      return MEMORY_ERROR;
+   }
+   mapping->base = base;
+   mapping->size = (size_t) status.st_size;
+
+   header = base;
+   if(memcmp(header->magic, snapshotMagic, sizeof(header->magic)) != 0
+      || header->recordSize != sizeof(struct FT_SnapshotRecord))
+      result = PARENT_CHILD_ERROR;
+
+   /* Names are copied into the new nodes, but the contents of files
+      stay in the image, to be paged in when they are first read */
+   at = (const char*) base + sizeof(struct FT_SnapshotHeader);
+   end = (const char*) base + mapping->size;
+   while(result == SUCCESS && at != end) {
+      if((size_t) (end - at) < sizeof(struct FT_SnapshotRecord)) {
+         result = PARENT_CHILD_ERROR;
+         break;
+      }
+      record = (const struct FT_SnapshotRecord*) at;
+      at += sizeof(struct FT_SnapshotRecord);
+
+      name = at;
+      if(record->nameLength == 0 ||
+         record->nameLength >= (size_t) (end - at) ||
+         FT_snapshotAlign(record->nameLength + 1) > (size_t) (end - at) ||
+         memchr(name, '\0', record->nameLength) != NULL ||
+         memchr(name, '/', record->nameLength) != NULL ||
+         name[record->nameLength] != '\0') {
+         result = PARENT_CHILD_ERROR;
+         break;
+      }
+      at += FT_snapshotAlign(record->nameLength + 1);
+
+      contents = NULL;
+      if(record->kind == SNAPSHOT_FILE) {
+         if(record->length > (size_t) (end - at) ||
+            FT_snapshotAlign(record->length) > (size_t) (end - at)) {
+            result = PARENT_CHILD_ERROR;
+            break;
+         }
+         contents = (void*) at;
+         at += FT_snapshotAlign(record->length);
+      }
+      else if(record->kind != SNAPSHOT_DIR &&
+              record->kind != SNAPSHOT_NULL_FILE) {
+         result = PARENT_CHILD_ERROR;
+         break;
+      }
+
+      result = FT_loadRecord(ft, record, name, contents, &depth, &root);
+      if(result == SUCCESS)
+         count++;
+   }
+
+   if(result != SUCCESS || root == NULL) {
+      if(root != NULL) {
+         FT_unindexSubtree(ft, root, FT_pathHash(NodeD_getName(root)));
+         (void) NodeD_destroy(root);
+      }
+      (void) munmap(base, mapping->size);
+      free(mapping);
+      return result;
+   }
+
+   ft->root = root;
+   ft->count = count;
+   mapping->next = ft->mappings;
+   ft->mappings = mapping;
+
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   return SUCCESS;
+}
+
+/* The start of a journal file. The rest of the file holds one
+   FT_JournalRecord for each change made while the journal was open, in
+   the order they were made. */
+struct FT_JournalHeader {
+   /* journalMagic, '\0'-padded */
+   char magic[8];
+   /* sizeof(struct FT_JournalRecord) */
+   size_t recordSize;
+};
+
+/* The kinds of change in a journal. The _NULL kinds are those that
+   leave a file with NULL contents. */
+enum {JOURNAL_INSERT_DIR, JOURNAL_INSERT_FILE, JOURNAL_INSERT_NULL_FILE,
+      JOURNAL_RM_DIR, JOURNAL_RM_FILE, JOURNAL_REPLACE,
+      JOURNAL_REPLACE_NULL};
+
+/* One change. It is followed by the path it was made at and a '\0',
+   and then, for a JOURNAL_INSERT_FILE or a JOURNAL_REPLACE, by the
+   length bytes of the file's new contents, each padded as in a
+   snapshot. */
+struct FT_JournalRecord {
+   /* one of the JOURNAL_ kinds */
+   size_t kind;
+   /* the length of the path */
+   size_t pathLength;
+   /* the length of the file's new contents */
+   size_t length;
+};
+
+/* The magic string that starts every journal */
+static const char journalMagic[8] = "FTJRNL1";
+
+/* Returns the number of milliseconds that have passed since *since. */
+static size_t FT_millisSince(const struct timespec* since) {
+   struct timespec now;
+
+   assert(since != NULL);
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &now);
+   return (size_t) ((now.tv_sec - since->tv_sec) * 1000L +
+                    (now.tv_nsec - since->tv_nsec) / 1000000L);
+}
+
+/* Copies the len bytes at data to at, padded as in a snapshot, and
+   returns the end of the padding. */
+static char* FT_putPadded(char* at, const void* data, size_t len) {
+   size_t padded;
+
+   assert(at != NULL);
+
+   padded = FT_snapshotAlign(len);
+   if(len > 0)
+      memcpy(at, data, len);
+   memset(at + len, 0, padded - len);
+   return at + padded;
+}
+
+/* Appends a record of a change of kind kind at path, giving a file
+   contents of length length, to ft's journal, if it has one, and
+   writes out and syncs the journal's buffer if it is due. A record
+   that cannot be buffered is lost, and the journal marked as having
+   failed. */
+static void FT_journal(FT_T ft, size_t kind, const char* path,
+                       const void* contents, size_t length) {
+   struct FT_Journal* journal;
+   struct FT_JournalRecord record;
+   size_t size;
+   size_t capacity;
+   char* buffer;
+   char* at;
+
+   assert(ft != NULL);
+   assert(path != NULL);
+
+   journal = ft->journal;
+   if(journal == NULL)
+      return;
+
+   record.kind = kind;
+   record.pathLength = strlen(path);
+   record.length = length;
+   size = sizeof(record) + FT_snapshotAlign(record.pathLength + 1);
+   if(kind == JOURNAL_INSERT_FILE || kind == JOURNAL_REPLACE)
+      size += FT_snapshotAlign(length);
+
+   if(journal->capacity - journal->length < size) {
+      capacity = (journal->capacity == 0) ? 4096 : journal->capacity;
+      while(capacity - journal->length < size)
+         capacity *= 2;
+      buffer = realloc(journal->buffer, capacity);
+      if(buffer == NULL) {
+         journal->hasFailed = TRUE;
+         return;
+      }
+      journal->buffer = buffer;
+      journal->capacity = capacity;
+   }
+
+   if(journal->length == 0)
+      (void) clock_gettime(CLOCK_MONOTONIC, &journal->oldest);
+   at = journal->buffer + journal->length;
+   memcpy(at, &record, sizeof(record));
+   at = FT_putPadded(at + sizeof(record), path, record.pathLength + 1);
+   if(kind == JOURNAL_INSERT_FILE || kind == JOURNAL_REPLACE)
+      at = FT_putPadded(at, contents, length);
+   journal->length = (size_t) (at - journal->buffer);
+
+   if(journal->length >= journal->syncBytes ||
+      FT_millisSince(&journal->oldest) >= journal->syncMillis)
+      (void) FT_flushJournal(journal);
+}
+
+/* Does FT_openJournalIn with ft's lock held. */
+static int FT_openJournalLocked(FT_T ft, const char* path,
+                                size_t syncBytes, size_t syncMillis) {
+   struct FT_JournalHeader header;
+   struct FT_JournalHeader existing;
+   struct FT_Journal* journal;
+   struct stat status;
+   int fd;
+
+   assert(ft != NULL);
+   assert(path != NULL);
+
+   if(!FT_isWritable(ft) || ft->journal != NULL)
+      return INITIALIZATION_ERROR;
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, journalMagic, sizeof(header.magic));
+   header.recordSize = sizeof(struct FT_JournalRecord);
+
+   fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0666);
+   if(fd < 0)
+      return NO_SUCH_PATH;
+   if(fstat(fd, &status) != 0) {
+      (void) close(fd);
+      return NO_SUCH_PATH;
+   }
+
+   /* A new journal gets its header at once, and an existing one must
+      have the same header */
+   if(status.st_size == 0) {
+      if(!FT_writeAll(fd, (const char*) &header, sizeof(header)) ||
+         fsync(fd) != 0) {
+         (void) close(fd);
+         return EOF;
+      }
+   }
+   else if(pread(fd, &existing, sizeof(existing), 0) !=
+           (ssize_t) sizeof(existing) ||
+           memcmp(&existing, &header, sizeof(header)) != 0) {
+      (void) close(fd);
+      return PARENT_CHILD_ERROR;
+   }
+
+   journal = malloc(sizeof(struct FT_Journal));
+   if(journal == NULL) {
+      (void) close(fd);
+      return MEMORY_ERROR;
+   }
+   journal->fd = fd;
+   journal->buffer = NULL;
+   journal->length = 0;
+   journal->capacity = 0;
+   journal->syncBytes = syncBytes;
+   journal->syncMillis = syncMillis;
+   journal->hasFailed = FALSE;
+   ft->journal = journal;
+   return SUCCESS;
+}
+
+/* Does FT_syncJournalIn with ft's lock held. */
+static int FT_syncJournalLocked(FT_T ft) {
+   assert(ft != NULL);
+
+   if(ft->journal == NULL)
+      return INITIALIZATION_ERROR;
+   return FT_flushJournal(ft->journal) ? SUCCESS : EOF;
+}
+
+/* Makes the change that record, whose path is path and whose new
+   contents are contents, describes to ft. Returns the status of the
+   change. */
+static int FT_applyRecord(FT_T ft, const struct FT_JournalRecord* record,
+                          const char* path, void* contents) {
+   boolean isReplaced;
+
+   assert(ft != NULL);
+   assert(record != NULL);
+   assert(path != NULL);
+
+   switch(record->kind) {
+      case JOURNAL_INSERT_DIR:
+         return FT_insertDirLocked(ft, path);
+      case JOURNAL_INSERT_FILE:
+      case JOURNAL_INSERT_NULL_FILE:
+         return FT_insertFileLocked(ft, path, contents, record->length);
+      case JOURNAL_RM_DIR:
+         return FT_rmDirLocked(ft, path);
+      case JOURNAL_RM_FILE:
+         return FT_rmFileLocked(ft, path);
+      default:
+         if(IndexFT_getFile(ft->pathIndex, path) == NULL)
+            return NO_SUCH_PATH;
+         (void) FT_replaceFileContentsLocked(ft, path, contents,
+                                             record->length,
+                                             &isReplaced);
+         return isReplaced ? SUCCESS : MEMORY_ERROR;
+   }
+}
+
+/* Does FT_replayIn with ft's lock held. */
+static int FT_replayLocked(FT_T ft, const char* path) {
+   const struct FT_JournalHeader* header;
+   const struct FT_JournalRecord* record;
+   struct FT_Mapping* mapping;
+   struct stat status;
+   const char* at;
+   const char* end;
+   const char* name;
+   void* contents;
+   boolean isMappingUsed = FALSE;
+   size_t kind;
+   void* base;
+   int fd;
+   int result = SUCCESS;
+
+   assert(ft != NULL);
+   assert(path != NULL);
+
+   if(!FT_isWritable(ft) || ft->journal != NULL)
+      return INITIALIZATION_ERROR;
+
+   fd = open(path, O_RDWR);
+   if(fd < 0)
+      return NO_SUCH_PATH;
+   if(fstat(fd, &status) != 0) {
+      (void) close(fd);
+      return NO_SUCH_PATH;
+   }
+   if((size_t) status.st_size < sizeof(struct FT_JournalHeader)) {
+      (void) close(fd);
+      return (status.st_size == 0) ? SUCCESS : PARENT_CHILD_ERROR;
+   }
+   base = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE,
+               fd, 0);
+   if(base == MAP_FAILED) {
+      (void) close(fd);
+      return NO_SUCH_PATH;
+   }
+
+   mapping = malloc(sizeof(struct FT_Mapping));
+   if(mapping == NULL) {
+      (void) munmap(base, (size_t) status.st_size);
+      (void) close(fd);
+      return MEMORY_ERROR;
+   }
+   mapping->base = base;
+   mapping->size = (size_t) status.st_size;
+
+   header = base;
+   if(memcmp(header->magic, journalMagic, sizeof(header->magic)) != 0
+      || header->recordSize != sizeof(struct FT_JournalRecord))
+      result = PARENT_CHILD_ERROR;
+
+   /* As with a snapshot, the contents of files stay in the mapping */
+   at = (const char*) base + sizeof(struct FT_JournalHeader);
+   end = (const char*) base + mapping->size;
+   while(result == SUCCESS && at != end) {
+      /* A record cut short is the last one, written when the process
+         died, and is dropped from the file so that appending after it
+         works */
+      record = (const struct FT_JournalRecord*) at;
+      name = at + sizeof(struct FT_JournalRecord);
+      if((size_t) (end - at) < sizeof(struct FT_JournalRecord) ||
+         record->pathLength >= (size_t) (end - name) ||
+         FT_snapshotAlign(record->pathLength + 1) >
+         (size_t) (end - name)) {
+         if(ftruncate(fd, (off_t) (at - (const char*) base)) != 0)
+            result = EOF;
+         break;
+      }
+      kind = record->kind;
+      contents = (void*) (name + FT_snapshotAlign(record->pathLength +
+                                                  1));
+      if(kind == JOURNAL_INSERT_FILE || kind == JOURNAL_REPLACE) {
+         if(record->length > (size_t) (end - (const char*) contents) ||
+            FT_snapshotAlign(record->length) >
+            (size_t) (end - (const char*) contents)) {
+            if(ftruncate(fd, (off_t) (at - (const char*) base)) != 0)
+               result = EOF;
+            break;
+         }
+         at = (const char*) contents + FT_snapshotAlign(record->length);
+         /* An FT that owns its contents copies them out instead */
+         if(FT_getStore(ft) == NULL)
+            isMappingUsed = TRUE;
+      }
+      else {
+         at = (const char*) contents;
+         contents = NULL;
+      }
+
+      if(kind > JOURNAL_REPLACE_NULL ||
+         memchr(name, '\0', record->pathLength) != NULL ||
+         name[record->pathLength] != '\0') {
+         result = PARENT_CHILD_ERROR;
+         break;
+      }
+      result = FT_applyRecord(ft, record, name, contents);
+   }
+   (void) close(fd);
+
+   if(isMappingUsed) {
+      mapping->next = ft->mappings;
+      ft->mappings = mapping;
+   }
+   else {
+      (void) munmap(base, mapping->size);
+      free(mapping);
+   }
+
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_insertDirIn(FT_T ft, const char* path) {
+   int result;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   result = FT_insertDirLocked(ft, path);
+   if(result == SUCCESS)
+      FT_journal(ft, JOURNAL_INSERT_DIR, path, NULL, 0);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+boolean FT_containsDirIn(FT_T ft, const char* path) {
+   boolean result;
+
+   assert(ft != NULL);
+
+   FT_readLock(ft);
+   result = FT_containsDirLocked(ft, path);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_rmDirIn(FT_T ft, const char* path) {
+   int result;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   result = FT_rmDirLocked(ft, path);
+   if(result == SUCCESS)
+      FT_journal(ft, JOURNAL_RM_DIR, path, NULL, 0);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_insertFileIn(FT_T ft, const char* path, void* contents,
+                    size_t length) {
+   int result;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   result = FT_insertFileLocked(ft, path, contents, length);
+   if(result == SUCCESS)
+      FT_journal(ft, (contents == NULL) ? JOURNAL_INSERT_NULL_FILE :
+                 JOURNAL_INSERT_FILE, path, contents, length);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+boolean FT_containsFileIn(FT_T ft, const char* path) {
+   boolean result;
+
+   assert(ft != NULL);
+
+   FT_readLock(ft);
+   result = FT_containsFileLocked(ft, path);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_rmFileIn(FT_T ft, const char* path) {
+   int result;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   result = FT_rmFileLocked(ft, path);
+   if(result == SUCCESS)
+      FT_journal(ft, JOURNAL_RM_FILE, path, NULL, 0);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+void* FT_getFileContentsIn(FT_T ft, const char* path) {
+   void* result;
+
+   assert(ft != NULL);
+
+   FT_readLock(ft);
+   result = FT_getFileContentsLocked(ft, path);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+void* FT_replaceFileContentsIn(FT_T ft, const char* path,
+                               void* newContents, size_t newLength) {
+   void* result;
+   boolean isReplaced;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   /* NULL is also what a file's old contents may be */
+   result = FT_replaceFileContentsLocked(ft, path, newContents,
+                                         newLength, &isReplaced);
+   if(isReplaced)
+      FT_journal(ft, (newContents == NULL) ? JOURNAL_REPLACE_NULL :
+                 JOURNAL_REPLACE, path, newContents, newLength);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_statIn(FT_T ft, const char* path, boolean* type,
+              size_t* length) {
+   int result;
+
+   assert(ft != NULL);
+
+   FT_readLock(ft);
+   result = FT_statLocked(ft, path, type, length);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_toStreamIn(FT_T ft, FT_WriteFn write, void* extra) {
+   int result;
+
+   assert(ft != NULL);
+
+   FT_readLock(ft);
+   result = FT_toStreamLocked(ft, write, extra);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+char* FT_toStringIn(FT_T ft) {
+   char* result;
+   size_t length;
+
+   assert(ft != NULL);
+
+   /* Copying a listing that is cached, or streaming a snapshot's, is
+      only a query. Rebuilding the listings of dirty directories changes
+      them and uses ft's work stack, so it waits to hold the lock
+      alone, and other queries meanwhile see the listings as they
+      were */
+   FT_readLock(ft);
+   if(ft->isInitialized && ft->origin == NULL && ft->root != NULL &&
+      NodeD_getListing(ft->root, &length) == NULL) {
+      FT_unlock(ft);
+      FT_writeLock(ft);
+   }
+   result = FT_toStringLocked(ft);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_insertBatchIn(FT_T ft, char* paths[], void* contents[],
+                     size_t lengths[], size_t n, int results[]) {
+   int result;
+   size_t i;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   result = FT_insertBatchLocked(ft, paths, contents, lengths, n,
+                                 results);
+   /* The files inserted cannot conflict with each other, so inserting
+      them in the batch's order gives the same tree */
+   if(result == SUCCESS && ft->journal != NULL)
+      for(i = 0; i < n; i++)
+         if(results[i] == SUCCESS)
+            FT_journal(ft, (contents[i] == NULL) ?
+                       JOURNAL_INSERT_NULL_FILE : JOURNAL_INSERT_FILE,
+                       paths[i], contents[i], lengths[i]);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_bulkLoadIn(FT_T ft, char* paths[], void* contents[],
+                  size_t lengths[], size_t n) {
+   int result;
+   size_t i;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   result = FT_bulkLoadLocked(ft, paths, contents, lengths, n);
+   /* FT_insertFile does not create the root of an empty tree */
+   if(result == SUCCESS && ft->journal != NULL) {
+      FT_journal(ft, JOURNAL_INSERT_DIR, NodeD_getName(ft->root), NULL,
+                 0);
+      for(i = 0; i < n; i++)
+         FT_journal(ft, (contents[i] == NULL) ?
+                    JOURNAL_INSERT_NULL_FILE : JOURNAL_INSERT_FILE,
+                    paths[i], contents[i], lengths[i]);
+   }
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_drainIn(FT_T ft) {
+   int result = SUCCESS;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   if(ft->isInitialized == FALSE)
+      result = INITIALIZATION_ERROR;
+   else
+      FT_reclaimSlice(ft, ~(size_t) 0);
+   assert(CheckerFT_isValid(ft->isInitialized, ft->root, ft->count));
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_saveSnapshotIn(FT_T ft, const char* path) {
+   int result;
+
+   assert(ft != NULL);
+   assert(path != NULL);
+
+   FT_readLock(ft);
+   result = FT_saveSnapshotLocked(ft, path);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_loadSnapshotIn(FT_T ft, const char* path) {
+   int result;
+
+   assert(ft != NULL);
+   assert(path != NULL);
+
+   FT_writeLock(ft);
+   result = FT_loadSnapshotLocked(ft, path);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_openJournalIn(FT_T ft, const char* path, size_t syncBytes,
+                     size_t syncMillis) {
+   int result;
+
+   assert(ft != NULL);
+   assert(path != NULL);
+
+   FT_writeLock(ft);
+   result = FT_openJournalLocked(ft, path, syncBytes, syncMillis);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_syncJournalIn(FT_T ft) {
+   int result;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   result = FT_syncJournalLocked(ft);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_closeJournalIn(FT_T ft) {
+   int result;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   result = FT_closeJournalLocked(ft);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_replayIn(FT_T ft, const char* path) {
+   int result;
+
+   assert(ft != NULL);
+   assert(path != NULL);
+
+   FT_writeLock(ft);
+   result = FT_replayLocked(ft, path);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_ownContentsIn(FT_T ft) {
+   int result;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   result = FT_ownContentsLocked(ft, FALSE);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_dedupContentsIn(FT_T ft) {
+   int result;
+
+   assert(ft != NULL);
+
+   FT_writeLock(ft);
+   result = FT_ownContentsLocked(ft, TRUE);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_getIndexStatsIn(FT_T ft, struct FT_IndexStats* stats) {
+   int result = SUCCESS;
+
+   assert(ft != NULL);
+   assert(stats != NULL);
+
+   FT_readLock(ft);
+   if(ft->isInitialized)
+      FT_getIndexStatsLocked(ft, stats);
+   else
+      result = INITIALIZATION_ERROR;
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_getContentStatsIn(FT_T ft, struct FT_ContentStats* stats) {
+   FT_T owner;
+   int result = SUCCESS;
+
+   assert(ft != NULL);
+   assert(stats != NULL);
+
+   /* A snapshot reports on the store of its tree, which changes under
+      that tree's lock, and which it keeps even if the tree is
+      destroyed */
+   owner = FT_getLockTree(ft);
+   FT_readLock(owner);
+   (void) pthread_mutex_lock(&owner->viewLock);
+   if(ft->isInitialized)
+      FT_getContentStatsLocked(owner, stats);
+   else
+      result = INITIALIZATION_ERROR;
+   (void) pthread_mutex_unlock(&owner->viewLock);
+   FT_unlock(owner);
+   return result;
+}
+
+/* see ftExt.h for specification */
+int FT_acquireContentsIn(FT_T ft, const char* path,
+                         struct FT_ContentView* view) {
+   FT_T owner;
+   int result;
+
+   assert(ft != NULL);
+   assert(path != NULL);
+   assert(view != NULL);
+
+   /* A view of a snapshot's file pins a node that the snapshot's tree
+      may share, and is counted by that tree */
+   owner = FT_getLockTree(ft);
+   FT_readLock(owner);
+   (void) pthread_mutex_lock(&owner->viewLock);
+   result = FT_acquireContentsLocked(ft, owner, path, view);
+   (void) pthread_mutex_unlock(&owner->viewLock);
+   FT_unlock(owner);
+   return result;
+}
+
+/* see ftExt.h for specification */
+void FT_releaseContents(struct FT_ContentView* view) {
+   FT_T ft;
+   boolean isLast;
+
+   assert(view != NULL);
+   assert(view->ft != NULL);
+   assert(view->file != NULL);
+
+   ft = view->ft;
+   FT_readLock(ft);
+   (void) pthread_mutex_lock(&ft->viewLock);
+   (void) NodeF_removeFile(view->file);
+   assert(ft->numViews > 0);
+   ft->numViews--;
+   FT_releaseStorage(ft);
+   isLast = FT_isAbandoned(ft);
+   (void) pthread_mutex_unlock(&ft->viewLock);
+   FT_unlock(ft);
+   if(isLast)
+      FT_freeAbandoned(ft);
+
+   view->contents = NULL;
+   view->length = 0;
+   view->ft = NULL;
+   view->file = NULL;
+}
+
+/* see ftExt.h for specification */
+FT_T FT_new(void) {
+   FT_T ft;
+
+   ft = malloc(sizeof(struct FT));
+   if(ft == NULL)
+      return NULL;
+
+   ft->isInitialized = FALSE;
+   ft->root = NULL;
+   ft->count = 0;
+   ft->pathIndex = NULL;
+   ft->walk = NULL;
+   ft->walkCapacity = 0;
+   ft->reclaim = NULL;
+   ft->isQueued = FALSE;
+   ft->nextQueued = NULL;
+   ft->mappings = NULL;
+   ft->journal = NULL;
+   ft->origin = NULL;
+   ft->frozenRoot = NULL;
+   ft->numSnapshots = 0;
+   ft->ownsContents = FALSE;
+   ft->store = NULL;
+   ft->numViews = 0;
+   ft->isFreed = FALSE;
+   (void) pthread_once(&setupOnce, FT_setup);
+   if(!FT_initLocks(ft)) {
+      free(ft);
+      return NULL;
+   }
+   if(FT_initTree(ft) != SUCCESS) {
+      FT_destroyLocks(ft);
+      free(ft);
+      return NULL;
+   }
+
+   return ft;
+}
+
+/* see ftExt.h for specification */
+FT_T FT_snapshotIn(FT_T ft) {
+   FT_T origin;
+   FT_T snapshot;
+
+   assert(ft != NULL);
+
+   /* A snapshot of a snapshot shares the same hierarchy */
+   origin = (ft->origin != NULL) ? ft->origin : ft;
+
+   /* A snapshot has no locks of its own; it uses those of origin */
+   snapshot = malloc(sizeof(struct FT));
+   if(snapshot == NULL)
+      return NULL;
+
+   snapshot->isInitialized = TRUE;
+   snapshot->root = NULL;
+   snapshot->count = 0;
+   snapshot->pathIndex = NULL;
+   snapshot->walk = NULL;
+   snapshot->reclaim = NULL;
+   snapshot->isQueued = FALSE;
+   snapshot->nextQueued = NULL;
+   snapshot->mappings = NULL;
+   snapshot->journal = NULL;
+   snapshot->origin = origin;
+   snapshot->numSnapshots = 0;
+   snapshot->ownsContents = FALSE;
+   snapshot->store = NULL;
+   snapshot->numViews = 0;
+   snapshot->isFreed = FALSE;
+
+   /* The tree's root gains a reference, and nothing is copied until
+      the tree changes */
+   FT_writeLock(origin);
+   if(ft->isInitialized == FALSE) {
+      FT_unlock(origin);
+      free(snapshot);
+      return NULL;
+   }
+   snapshot->frozenRoot = FT_getRoot(ft);
+   if(snapshot->frozenRoot != NULL)
+      NodeD_share(snapshot->frozenRoot);
+   snapshot->walkCapacity = ft->walkCapacity;
+   origin->numSnapshots++;
+   FT_unlock(origin);
+
+   return snapshot;
+}
+
+/* Releases snapshot's references to the nodes it shares with the tree
+   it was taken of, freeing those that no longer belong to the tree or
+   to another snapshot, and the tree too if it was left to snapshot to
+   free. */
+static void FT_releaseSnapshot(FT_T snapshot) {
+   FT_T origin;
+   boolean isLast;
+
+   assert(snapshot != NULL);
+   assert(snapshot->origin != NULL);
+
+   origin = snapshot->origin;
+   FT_writeLock(origin);
+   if(snapshot->frozenRoot != NULL)
+      (void) NodeD_destroy(snapshot->frozenRoot);
+   assert(origin->numSnapshots > 0);
+   origin->numSnapshots--;
+   FT_releaseStorage(origin);
+   isLast = FT_isAbandoned(origin);
+   FT_unlock(origin);
+   if(isLast)
+      FT_freeAbandoned(origin);
+}
+
+/* see ftExt.h for specification */
+void FT_free(FT_T ft) {
+   boolean isLast;
+
+   assert(ft != NULL);
+   assert(ft != &defaultTree);
+
+   if(ft->origin != NULL) {
+      FT_releaseSnapshot(ft);
+      free(ft);
+      return;
+   }
+
+   /* The reclaimer may still be freeing nodes of ft. Snapshots and
+      views keep the nodes they share, and the locks they take, so
+      ft itself outlives them */
+   FT_writeLock(ft);
+   (void) FT_destroyTree(ft);
+   ft->isFreed = TRUE;
+   isLast = FT_isAbandoned(ft);
+   FT_unlock(ft);
+   FT_forgetReclaim(ft);
+   if(isLast)
+      FT_freeAbandoned(ft);
+}
+
+/* The functions of ft.h operate on defaultTree. */
+
+/* see ft.h for specification */
+int FT_insertDir(char *path) {
+   return FT_insertDirIn(FT_getDefault(), path);
+}
+
+/* see ft.h for specification */
+boolean FT_containsDir(char *path) {
+   return FT_containsDirIn(FT_getDefault(), path);
+}
+
+/* see ft.h for specification */
+int FT_rmDir(char *path) {
+   return FT_rmDirIn(FT_getDefault(), path);
+}
+
+/* see ft.h for specification */
+int FT_insertFile(char *path, void *contents, size_t length) {
+   return FT_insertFileIn(FT_getDefault(), path, contents, length);
+}
+
+/* see ft.h for specification */
+boolean FT_containsFile(char *path) {
+   return FT_containsFileIn(FT_getDefault(), path);
+}
+
+/* see ft.h for specification */
+int FT_rmFile(char *path) {
+   return FT_rmFileIn(FT_getDefault(), path);
+}
+
+/* see ft.h for specification */
+void *FT_getFileContents(char *path) {
+   return FT_getFileContentsIn(FT_getDefault(), path);
+}
+
+/* see ft.h for specification */
+void *FT_replaceFileContents(char *path, void *newContents,
+size_t newLength) {
+   return FT_replaceFileContentsIn(FT_getDefault(), path, newContents,
+                                   newLength);
+}
+
+/* see ft.h for specification */
+int FT_stat(char *path, boolean *type, size_t *length) {
+   return FT_statIn(FT_getDefault(), path, type, length);
+}
+
+/* see ft.h for specification. */
+int FT_init(void) {
+   FT_T ft;
+   int result;
+
+   ft = FT_getDefault();
+   FT_writeLock(ft);
+   result = FT_initTree(ft);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ft.h for specification */
+int FT_destroy(void) {
+   FT_T ft;
+   int result;
+
+   ft = FT_getDefault();
+   FT_writeLock(ft);
+   result = FT_destroyTree(ft);
+   FT_unlock(ft);
+   return result;
+}
+
+/* see ft.h for specification */
+char *FT_toString(void) {
+   return FT_toStringIn(FT_getDefault());
+}
+
+/* see ftExt.h for specification */
+int FT_toStream(FT_WriteFn write, void* extra) {
+   return FT_toStreamIn(FT_getDefault(), write, extra);
+}
+
+/* see ftExt.h for specification */
+int FT_toFile(FILE* stream) {
+   return FT_toFileIn(FT_getDefault(), stream);
+}
+
+/* see ftExt.h for specification */
+int FT_insertBatch(char* paths[], void* contents[], size_t lengths[],
+                   size_t n, int results[]) {
+   return FT_insertBatchIn(FT_getDefault(), paths, contents, lengths, n,
+                           results);
+}
+
+/* see ftExt.h for specification */
+int FT_bulkLoad(char* paths[], void* contents[], size_t lengths[],
+                size_t n) {
+   return FT_bulkLoadIn(FT_getDefault(), paths, contents, lengths, n);
+}
+
+/* see ftExt.h for specification */
+int FT_drain(void) {
+   return FT_drainIn(FT_getDefault());
+}
+
+/* see ftExt.h for specification */
+int FT_saveSnapshot(const char* path) {
+   return FT_saveSnapshotIn(FT_getDefault(), path);
+}
+
+/* see ftExt.h for specification */
+int FT_loadSnapshot(const char* path) {
+   return FT_loadSnapshotIn(FT_getDefault(), path);
+}
+
+/* see ftExt.h for specification */
+int FT_openJournal(const char* path, size_t syncBytes,
+                   size_t syncMillis) {
+   return FT_openJournalIn(FT_getDefault(), path, syncBytes, syncMillis);
+}
+
+/* see ftExt.h for specification */
+int FT_syncJournal(void) {
+   return FT_syncJournalIn(FT_getDefault());
+}
+
+/* see ftExt.h for specification */
+int FT_closeJournal(void) {
+   return FT_closeJournalIn(FT_getDefault());
+}
+
+/* see ftExt.h for specification */
+int FT_replay(const char* path) {
+   return FT_replayIn(FT_getDefault(), path);
+}
+
+/* see ftExt.h for specification */
+int FT_ownContents(void) {
+   return FT_ownContentsIn(FT_getDefault());
+}
+
+/* see ftExt.h for specification */
+int FT_dedupContents(void) {
+   return FT_dedupContentsIn(FT_getDefault());
+}
+
+/* see ftExt.h for specification */
+int FT_getIndexStats(struct FT_IndexStats* stats) {
+   return FT_getIndexStatsIn(FT_getDefault(), stats);
+}
+
+/* see ftExt.h for specification */
+int FT_getContentStats(struct FT_ContentStats* stats) {
+   return FT_getContentStatsIn(FT_getDefault(), stats);
+}
+
+/* see ftExt.h for specification */
+int FT_acquireContents(const char* path, struct FT_ContentView* view) {
+   return FT_acquireContentsIn(FT_getDefault(), path, view);
+}
+
+/* see ftExt.h for specification */
+FT_T FT_snapshot(void) {
+   return FT_snapshotIn(FT_getDefault());
 }
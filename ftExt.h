@@ -0,0 +1,407 @@
+/*--------------------------------------------------------------------*/
+/* ftExt.h                                                            */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+#ifndef FTEXT_INCLUDED
+#define FTEXT_INCLUDED
+
+#include <stddef.h>
+#include <stdio.h>
+#include "a4def.h"
+
+/* Operations on the FT beyond those of ft.h. */
+
+/* An FT_T is a file tree of its own, independent of every other one
+   and of the tree that the functions of ft.h operate on. Each function
+   below whose name ends in "In" does on ft exactly what the function
+   of the same name without "In" does on that tree, with the same
+   return values. Different trees may be used from different threads
+   at the same time, and so may a single tree: queries on a tree
+   share its lock, while operations that change it hold it alone, as
+   FT_toString does only when it must rebuild part of its cached
+   listing after a change. A snapshot uses the lock of the tree it was
+   taken of. */
+typedef struct FT* FT_T;
+
+/* What FT_getIndexStats reports about the index from the full path of
+   each node of an FT to that node, which answers the FT's queries of
+   exact paths: the number of paths it holds, including those of
+   removed directories not yet freed, the number of bytes of memory it
+   occupies, and the number of those bytes per path, 0 when there are
+   none. */
+struct FT_IndexStats {
+   size_t numPaths;
+   size_t bytes;
+   double bytesPerPath;
+};
+
+/* What FT_getContentStats reports about the contents that an FT owns
+   and keeps apart from its files' nodes, as FT_ownContents describes:
+   the number of files whose contents it holds that way, including
+   those that only its snapshots still share and those of removed
+   directories not yet freed, and their total length; the number of
+   distinct copies it keeps of those contents, and their total length;
+   how many bytes sharing copies saves, and the ratio of the contents'
+   length to that of the copies, 1 when there are none; and the number
+   of bytes of memory that the copies occupy, together with the room
+   kept for later copies and the record of them all, 0 when the FT has
+   not owned contents since it was initialized. */
+struct FT_ContentStats {
+   size_t numFiles;
+   size_t bytes;
+   size_t numBlobs;
+   size_t storedBytes;
+   size_t savedBytes;
+   double ratio;
+   size_t memoryBytes;
+};
+
+/* A view of the contents of a file, filled in by FT_acquireContents:
+   the length bytes beginning at contents. The other fields are for
+   FT_releaseContents only. */
+struct FT_ContentView {
+   const void* contents;
+   size_t length;
+   FT_T ft;
+   void* file;
+};
+
+/* Returns a new, initialized, empty tree, or NULL if there is an
+   allocation error. */
+FT_T FT_new(void);
+
+/* Frees ft and everything in it. The contents of its files are not
+   freed, since they are owned by the client, unless ft owns them as
+   FT_ownContents describes. Snapshots of ft, and views of the
+   contents of its files or of those of its snapshots, may outlive ft:
+   ft is then emptied at once, as FT_destroy would, and the last of
+   them to be freed or released frees what they still keep, and what
+   is left of ft. ft must not be used after it is freed; freeing a
+   snapshot leaves its tree as it is. */
+void FT_free(FT_T ft);
+
+int FT_insertDirIn(FT_T ft, const char* path);
+boolean FT_containsDirIn(FT_T ft, const char* path);
+int FT_rmDirIn(FT_T ft, const char* path);
+int FT_insertFileIn(FT_T ft, const char* path, void* contents,
+                    size_t length);
+boolean FT_containsFileIn(FT_T ft, const char* path);
+int FT_rmFileIn(FT_T ft, const char* path);
+void* FT_getFileContentsIn(FT_T ft, const char* path);
+void* FT_replaceFileContentsIn(FT_T ft, const char* path,
+                               void* newContents, size_t newLength);
+int FT_statIn(FT_T ft, const char* path, boolean* type, size_t* length);
+char* FT_toStringIn(FT_T ft);
+int FT_insertBatchIn(FT_T ft, char* paths[], void* contents[],
+                     size_t lengths[], size_t n, int results[]);
+int FT_bulkLoadIn(FT_T ft, char* paths[], void* contents[],
+                  size_t lengths[], size_t n);
+int FT_drainIn(FT_T ft);
+int FT_saveSnapshotIn(FT_T ft, const char* path);
+int FT_loadSnapshotIn(FT_T ft, const char* path);
+int FT_openJournalIn(FT_T ft, const char* path, size_t syncBytes,
+                     size_t syncMillis);
+int FT_syncJournalIn(FT_T ft);
+int FT_closeJournalIn(FT_T ft);
+int FT_replayIn(FT_T ft, const char* path);
+int FT_ownContentsIn(FT_T ft);
+int FT_dedupContentsIn(FT_T ft);
+int FT_getIndexStatsIn(FT_T ft, struct FT_IndexStats* stats);
+int FT_getContentStatsIn(FT_T ft, struct FT_ContentStats* stats);
+int FT_acquireContentsIn(FT_T ft, const char* path,
+                         struct FT_ContentView* view);
+FT_T FT_snapshotIn(FT_T ft);
+
+/*
+  Inserts n files, as if by calling FT_insertFile(paths[i],
+  contents[i], lengths[i]) for each i in increasing order, and stores
+  the status that call would return in results[i]. The batch is sorted
+  so that each directory is found once for all of its new files, which
+  are then merged into it together. Since the files are inserted in
+  that sorted order, when two paths of the batch conflict, because
+  they name the same file in different ways or because one needs as a
+  directory what the other inserts as a file, which of them succeeds
+  may differ from what calls in the batch's order would give.
+  Returns SUCCESS if the batch was processed, even if some of its files
+  could not be inserted, INITIALIZATION_ERROR if the FT is not
+  initialized, or MEMORY_ERROR if there is an allocation error before
+  any file is inserted, in which case every results[i] is MEMORY_ERROR.
+*/
+int FT_insertBatch(char* paths[], void* contents[], size_t lengths[],
+                   size_t n, int results[]);
+
+/*
+  Fills the FT, which must be initialized and empty, with n files, the
+  ith of which has path paths[i] and stores contents[i] and lengths[i].
+  The paths must be distinct and sorted in increasing strcmp order, and
+  must all lie below a single root directory; the directories between
+  are created as needed. The tree is built from the bottom up, in time
+  linear in the total length of the paths.
+  Returns SUCCESS if every file was loaded. Otherwise, loads nothing
+  and returns:
+  * INITIALIZATION_ERROR if the FT is not initialized or not empty
+  * ALREADY_IN_TREE if a path is repeated
+  * PARENT_CHILD_ERROR if the paths are not sorted
+  * CONFLICTING_PATH if a path is not below the same root as the
+    others or has an empty component
+  * NOT_A_DIRECTORY if a file's path is a prefix of another path
+  * MEMORY_ERROR if there is an allocation error
+*/
+int FT_bulkLoad(char* paths[], void* contents[], size_t lengths[],
+                size_t n);
+
+/*
+  FT_rmDir detaches the directory from the FT at once, so that none of
+  the paths below it exist any more when it returns, but leaves the
+  freeing of its nodes to a background thread, which frees a bounded
+  number of them each time it takes the FT's lock. FT_drain frees
+  every node still waiting right away instead, as FT_destroy does.
+  Returns SUCCESS, or INITIALIZATION_ERROR if the FT is not
+  initialized.
+*/
+int FT_drain(void);
+
+/*
+  Saves the hierarchy to the file at path, replacing it, as a snapshot
+  that FT_loadSnapshot can load back, together with the contents of
+  every file. The snapshot is a binary image for a machine with the
+  same word size and byte order. It is written to a new file in the
+  same directory, synced, and then renamed to path, so that path may
+  be the file that the FT was loaded from, and a save that fails
+  leaves the file at path as it was.
+  Returns SUCCESS if the snapshot was written, INITIALIZATION_ERROR if
+  the FT is not initialized, NO_SUCH_PATH if the new file cannot be
+  created, MEMORY_ERROR if there is an allocation error, or EOF if
+  writing or renaming it fails.
+*/
+int FT_saveSnapshot(const char* path);
+
+/*
+  Fills the FT, which must be initialized and empty, with the hierarchy
+  of the snapshot at path, written by FT_saveSnapshot. The file is
+  mapped into memory rather than read: the nodes are rebuilt from it in
+  a single pass without looking up any path, and the contents of its
+  files are left in the mapping, which stays in place until the FT is
+  destroyed. Loading thus takes time linear in the number of nodes,
+  as building the tree with FT_bulkLoad does; only the contents are
+  left to be read in from the file as they are used. Those contents
+  are read-only; a file's contents can be changed only by replacing
+  them with FT_replaceFileContents. Loading an empty snapshot leaves
+  the FT empty.
+  Returns SUCCESS if the snapshot was loaded. Otherwise, loads nothing
+  and returns:
+  * INITIALIZATION_ERROR if the FT is not initialized or not empty
+  * NO_SUCH_PATH if the file cannot be opened or mapped
+  * PARENT_CHILD_ERROR if the file is not a valid snapshot
+  * MEMORY_ERROR if there is an allocation error
+*/
+int FT_loadSnapshot(const char* path);
+
+/*
+  Opens the journal at path, creating it if it does not exist, and from
+  then on appends a record to it of every change made to the FT by
+  FT_insertDir, FT_insertFile, FT_rmDir, FT_rmFile, and
+  FT_replaceFileContents, and of each file inserted by FT_insertBatch
+  or FT_bulkLoad, including the contents of every file. FT_loadSnapshot
+  is not recorded: a journal is meant to be opened on an empty FT, or
+  right after loading or saving a snapshot, and replayed onto the same
+  state.
+  Records are gathered in memory and written and synced to the file as
+  a group once they take up syncBytes bytes, or once the oldest of them
+  is syncMillis milliseconds old when another is added, whichever comes
+  first. With either limit 0, every change is synced before the call
+  that makes it returns. Records still gathered are written by
+  FT_syncJournal, FT_closeJournal, and FT_destroy.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is not initialized or already has a
+    journal open
+  * NO_SUCH_PATH if the file cannot be opened
+  * PARENT_CHILD_ERROR if the file exists but is not a journal
+  * MEMORY_ERROR if there is an allocation error
+  * EOF if the header of a new journal cannot be written
+*/
+int FT_openJournal(const char* path, size_t syncBytes,
+                   size_t syncMillis);
+
+/*
+  Writes and syncs the records of the FT's journal gathered so far.
+  Returns SUCCESS, INITIALIZATION_ERROR if the FT has no journal open,
+  or EOF if any record has been lost since the journal was opened,
+  because a write, a sync, or an allocation failed.
+*/
+int FT_syncJournal(void);
+
+/*
+  Writes out the records of the FT's journal, as FT_syncJournal does,
+  and closes it. Returns what FT_syncJournal would, or EOF if closing
+  the file fails; the journal is closed either way.
+*/
+int FT_closeJournal(void);
+
+/*
+  Makes the changes recorded in the journal at path to the FT, in
+  order. The FT must be initialized and must not have a journal open;
+  to go on recording to the same journal, open it afterwards. If the
+  journal ends in a record that was cut short, that record is dropped
+  from the file. The contents of the files that the journal inserts
+  are left in the file, which is mapped into memory until the FT is
+  destroyed, and are read-only, unless the FT owns the contents of its
+  files.
+  Returns SUCCESS if every change was made. Otherwise, stops at the
+  first change that cannot be made, leaving those before it made, and
+  returns:
+  * INITIALIZATION_ERROR if the FT is not initialized or has a journal
+    open
+  * NO_SUCH_PATH if the file cannot be opened or mapped
+  * PARENT_CHILD_ERROR if the file is not a journal or a record in it
+    is malformed
+  * MEMORY_ERROR if there is an allocation error
+  * EOF if a record cut short cannot be dropped
+  * the status that the change's own call returns, if it fails, or
+    NO_SUCH_PATH for a replacement of a file's contents that fails
+*/
+int FT_replay(const char* path);
+
+/*
+  Makes the FT, which must be initialized and empty, own the contents
+  of its files from then on until it is destroyed. Each file inserted
+  with FT_insertFile, FT_insertBatch, FT_bulkLoad, or FT_replay, and
+  each new contents given to FT_replaceFileContents, is copied into
+  memory that the FT manages, so the client may reuse or free its own
+  buffer as soon as the call returns. Contents of up to 32 bytes are
+  kept inside the file's own node, unless they replace longer ones;
+  other contents of up to 1024 bytes are packed together into slabs
+  shared by every file of a similar size, and larger ones are allocated
+  one by one. A file's copy is freed when
+  it is replaced or the file is removed, and every copy when the FT is
+  destroyed, or, for files that a snapshot still shares, when the last
+  such snapshot is freed. FT_getFileContents then returns the FT's
+  copy, which stays valid only until the file is replaced or removed,
+  and FT_replaceFileContents returns the FT's copy of the new
+  contents, since the old ones are freed. Files loaded with
+  FT_loadSnapshot are not copied, and keep their contents in the
+  mapped snapshot.
+  Returns SUCCESS, INITIALIZATION_ERROR if the FT is not initialized or
+  not empty, or MEMORY_ERROR if there is an allocation error.
+*/
+int FT_ownContents(void);
+
+/*
+  Makes the FT own the contents of its files as FT_ownContents does,
+  but keeps a single copy of the contents that any number of files have
+  in common, other than those kept inside the files' nodes. The
+  contents of each file inserted, or given as a replacement, are hashed
+  and compared with the copies already kept, and a file with the same
+  bytes as one of them is given that copy, which is freed once no file,
+  in the FT or in a snapshot of it, has it any more. FT_getFileContents
+  and FT_replaceFileContents return the copy, which may thus be the
+  contents of other files too and must not be changed.
+  Returns SUCCESS, INITIALIZATION_ERROR if the FT is not initialized or
+  not empty, or MEMORY_ERROR if there is an allocation error.
+*/
+int FT_dedupContents(void);
+
+/*
+  Fills in *stats with how many paths the index of the FT holds, and
+  how much memory it takes, as struct FT_IndexStats describes. A
+  snapshot, which answers its queries without an index, reports none.
+  Returns SUCCESS, or INITIALIZATION_ERROR if the FT is not
+  initialized.
+*/
+int FT_getIndexStats(struct FT_IndexStats* stats);
+
+/*
+  Fills in *stats with how many files' contents the FT owns, and how
+  much memory keeping a single copy of equal contents saves, as
+  struct FT_ContentStats describes. The counts are 0 if the FT does not
+  own its contents. Returns SUCCESS, or INITIALIZATION_ERROR if the FT
+  is not initialized.
+*/
+int FT_getContentStats(struct FT_ContentStats* stats);
+
+/*
+  Fills in *view with the contents of the file at path, without
+  copying them, and pins them: they stay as they are, and where they
+  are, until the view is released with FT_releaseContents, however the
+  FT changes in the meantime, from any thread. A file that the FT
+  replaces the contents of, removes, or frees while a view pins it,
+  with FT_replaceFileContents, FT_rmFile, FT_rmDir or FT_destroy, is
+  only taken out of the FT, and goes on holding the contents that the
+  view shows; replacing the contents of a pinned file thus copies its
+  node, and may return NULL if that copy cannot be made. Contents
+  that the FT owns, as FT_ownContents describes, are freed once no
+  file, view or snapshot has them any more; those of the client must
+  still be kept by the client for as long as a view of them is not
+  released. Viewed contents must not be changed.
+  Returns SUCCESS, INITIALIZATION_ERROR if the FT is not initialized,
+  NOT_A_FILE if path is that of a directory, or NO_SUCH_PATH if there
+  is no file at path.
+*/
+int FT_acquireContents(const char* path, struct FT_ContentView* view);
+
+/*
+  Releases view, filled in by FT_acquireContents or
+  FT_acquireContentsIn, after which its contents may be changed or
+  freed by the FT or the client. Each view must be released once, but
+  may be released after the tree it was acquired from is freed with
+  FT_free, as FT_free describes.
+*/
+void FT_releaseContents(struct FT_ContentView* view);
+
+/*
+  Returns a snapshot of the FT: a read-only tree that goes on holding
+  the hierarchy, and the contents of every file, that the FT has now,
+  however the FT changes afterwards. Taking a snapshot copies nothing;
+  the snapshot shares every node with the FT, which copies a directory
+  only when it changes it while a snapshot still shares it, together
+  with the directories above it that are shared. The queries of
+  ftExt.h, with names ending in "In", work on the snapshot as on any
+  tree, sharing the FT's lock with the FT's own queries, so that they
+  run between the FT's changes, and FT_toStringIn streams the
+  snapshot's listing rather than caching it. Every operation that
+  would change the snapshot returns INITIALIZATION_ERROR, or NULL for
+  FT_replaceFileContentsIn. A snapshot of a snapshot is another
+  snapshot of the same hierarchy. The snapshot must be freed with
+  FT_free.
+  While a snapshot is not freed, FT_rmDir frees the nodes that it
+  removes right away, rather than in the background, and any change
+  to the FT may also return MEMORY_ERROR, or NULL for
+  FT_replaceFileContents, if a node cannot be copied, in which case
+  that change is not made.
+  Returns the snapshot, or NULL if the FT is not initialized or there
+  is an allocation error.
+*/
+FT_T FT_snapshot(void);
+
+/* A function that FT_toStream calls with each piece of its output: the
+   len characters beginning at buf, which are not '\0'-terminated, and
+   the extra argument that was passed to FT_toStream. It returns
+   SUCCESS to continue, or any other value to stop the output. */
+typedef int (*FT_WriteFn)(const char* buf, size_t len, void* extra);
+
+/*
+  Writes the same listing of the hierarchy that FT_toString returns,
+  one line at a time through write, without building the listing in
+  memory. Every line is passed in a single call to write. The tree is
+  locked for reading while write is called, so write must not call
+  the functions of the FT on it, since a change waiting for the lock
+  holds back queries as well.
+  Returns SUCCESS if the whole listing was written.
+  Otherwise, returns INITIALIZATION_ERROR if the FT is not initialized,
+  MEMORY_ERROR if there is an allocation error, or the first value
+  other than SUCCESS that write returns.
+*/
+int FT_toStream(FT_WriteFn write, void* extra);
+
+/*
+  Writes the listing of the hierarchy to stream as FT_toStream does.
+  Returns SUCCESS, INITIALIZATION_ERROR, or MEMORY_ERROR as
+  FT_toStream does, or EOF if writing to stream fails.
+*/
+int FT_toFile(FILE* stream);
+
+int FT_toStreamIn(FT_T ft, FT_WriteFn write, void* extra);
+int FT_toFileIn(FT_T ft, FILE* stream);
+
+#endif
@@ -0,0 +1,361 @@
+/*--------------------------------------------------------------------*/
+/* indexFT.c                                                          */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "indexFT.h"
+#include "NodeD.h"
+#include "NodeF.h"
+
+/* The index is an open-addressing hash table with linear probing. Its
+   capacity is always a power of two, and it grows so that at most half
+   of its slots are in use. */
+enum {MIN_CAPACITY = 16};
+
+/* An entry of the index: a node and the hash of its path. A slot whose
+   node is NULL is empty. */
+struct IndexEntry
+{
+   /* the hash of the node's full path */
+   size_t hash;
+
+   /* the indexed node: a Node_D, or a Node_F if isFile is TRUE */
+   void* node;
+
+   /* TRUE if node is a file and FALSE if it is a directory */
+   boolean isFile;
+};
+
+/* An IndexFT is a table of IndexEntry slots. */
+struct IndexFT
+{
+   /* the slots of the table */
+   struct IndexEntry* entries;
+
+   /* the number of slots in entries, a power of two */
+   size_t capacity;
+
+   /* the number of slots in use */
+   size_t size;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+IndexFT_T IndexFT_new(void)
+{
+   IndexFT_T index;
+
+   index = malloc(sizeof(struct IndexFT));
+   if(index == NULL)
+      return NULL;
+
+   index->entries = calloc(MIN_CAPACITY, sizeof(struct IndexEntry));
+   if(index->entries == NULL) {
+      free(index);
+      return NULL;
+   }
+   index->capacity = MIN_CAPACITY;
+   index->size = 0;
+
+   return index;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+void IndexFT_free(IndexFT_T index)
+{
+   assert(index != NULL);
+
+   free(index->entries);
+   free(index);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+size_t IndexFT_hash(size_t hash, const char* s, size_t len)
+{
+   const size_t HASH_MULTIPLIER = 65599;
+   size_t i;
+
+   assert(s != NULL);
+
+   for(i = 0; i < len; i++)
+      hash = hash * HASH_MULTIPLIER + (size_t)(unsigned char)s[i];
+
+   return hash;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns TRUE if the node of entry has path, which is len characters
+   long, as its path. */
+static boolean IndexFT_entryHasPath(struct IndexEntry* entry,
+                                    const char* path, size_t len)
+{
+   assert(entry != NULL);
+   assert(path != NULL);
+
+   if(entry->isFile)
+      return NodeF_hasPath(entry->node, path, len);
+   else
+      return NodeD_hasPath(entry->node, path, len);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Places entry into the first free slot of its probe sequence in
+   entries, which has capacity slots. */
+static void IndexFT_place(struct IndexEntry* entries, size_t capacity,
+                          struct IndexEntry entry)
+{
+   size_t i;
+
+   assert(entries != NULL);
+
+   i = entry.hash & (capacity - 1);
+   while(entries[i].node != NULL)
+      i = (i + 1) & (capacity - 1);
+   entries[i] = entry;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Moves every entry of index into a new table with newCapacity slots.
+   Returns TRUE on success or FALSE if there is an allocation error, in
+   which case index is unchanged. */
+static boolean IndexFT_resize(IndexFT_T index, size_t newCapacity)
+{
+   struct IndexEntry* newEntries;
+   size_t i;
+
+   assert(index != NULL);
+
+   newEntries = calloc(newCapacity, sizeof(struct IndexEntry));
+   if(newEntries == NULL)
+      return FALSE;
+
+   for(i = 0; i < index->capacity; i++)
+      if(index->entries[i].node != NULL)
+         IndexFT_place(newEntries, newCapacity, index->entries[i]);
+
+   free(index->entries);
+   index->entries = newEntries;
+   index->capacity = newCapacity;
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Adds node, a file if isFile is TRUE or a directory otherwise, whose
+   path has hash hash, to index. Returns TRUE on success or FALSE if
+   there is an allocation error. */
+static boolean IndexFT_put(IndexFT_T index, size_t hash, void* node,
+                           boolean isFile)
+{
+   struct IndexEntry entry;
+
+   assert(index != NULL);
+   assert(node != NULL);
+
+   if(2 * (index->size + 1) > index->capacity)
+      if(!IndexFT_resize(index, 2 * index->capacity))
+         return FALSE;
+
+   entry.hash = hash;
+   entry.node = node;
+   entry.isFile = isFile;
+   IndexFT_place(index->entries, index->capacity, entry);
+   index->size++;
+
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+boolean IndexFT_putDir(IndexFT_T index, size_t hash, Node_D n)
+{
+   return IndexFT_put(index, hash, n, FALSE);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+boolean IndexFT_putFile(IndexFT_T index, size_t hash, Node_F n)
+{
+   return IndexFT_put(index, hash, n, TRUE);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Removes node, whose path has hash hash, from index. Returns TRUE if
+   node was in index and FALSE otherwise. */
+static boolean IndexFT_remove(IndexFT_T index, size_t hash, void* node)
+{
+   size_t mask;
+   size_t i;
+   size_t j;
+   size_t home;
+
+   assert(index != NULL);
+   assert(node != NULL);
+
+   mask = index->capacity - 1;
+   for(i = hash & mask; index->entries[i].node != node; i = (i + 1) & mask)
+      if(index->entries[i].node == NULL)
+         return FALSE;
+
+   /* Shift later entries of the probe run back over the hole, so that
+      lookups never stop early at an empty slot */
+   for(j = (i + 1) & mask; index->entries[j].node != NULL;
+       j = (j + 1) & mask)
+   {
+      home = index->entries[j].hash & mask;
+      /* The entry at j may fill the hole at i only if its home slot
+         does not lie cyclically within (i, j] */
+      if(((j - home) & mask) >= ((j - i) & mask))
+      {
+         index->entries[i] = index->entries[j];
+         i = j;
+      }
+   }
+   index->entries[i].node = NULL;
+   index->size--;
+
+   /* Give memory back after large removals, ignoring failure */
+   if(index->capacity > MIN_CAPACITY && 8 * index->size < index->capacity)
+      (void) IndexFT_resize(index, index->capacity / 2);
+
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+boolean IndexFT_removeDir(IndexFT_T index, size_t hash, Node_D n)
+{
+   return IndexFT_remove(index, hash, n);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+boolean IndexFT_removeFile(IndexFT_T index, size_t hash, Node_F n)
+{
+   return IndexFT_remove(index, hash, n);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Makes the entry of old, whose path has hash hash, refer to new
+   instead. Returns TRUE if old was in index and FALSE otherwise. */
+static boolean IndexFT_replace(IndexFT_T index, size_t hash, void* old,
+                               void* new)
+{
+   size_t mask;
+   size_t i;
+
+   assert(index != NULL);
+   assert(old != NULL);
+   assert(new != NULL);
+
+   mask = index->capacity - 1;
+   for(i = hash & mask; index->entries[i].node != old; i = (i + 1) & mask)
+      if(index->entries[i].node == NULL)
+         return FALSE;
+
+   index->entries[i].node = new;
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+boolean IndexFT_replaceDir(IndexFT_T index, size_t hash, Node_D old,
+                           Node_D new)
+{
+   return IndexFT_replace(index, hash, old, new);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+boolean IndexFT_replaceFile(IndexFT_T index, size_t hash, Node_F old,
+                            Node_F new)
+{
+   return IndexFT_replace(index, hash, old, new);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the node in index with path path that is a file if isFile
+   is TRUE or a directory otherwise, or NULL if there is none. */
+static void* IndexFT_get(IndexFT_T index, const char* path,
+                         boolean isFile)
+{
+   struct IndexEntry* entry;
+   size_t len;
+   size_t hash;
+   size_t mask;
+   size_t i;
+
+   assert(index != NULL);
+   assert(path != NULL);
+
+   len = strlen(path);
+   hash = IndexFT_hash(0, path, len);
+   mask = index->capacity - 1;
+   for(i = hash & mask; index->entries[i].node != NULL; i = (i + 1) & mask)
+   {
+      entry = &index->entries[i];
+      if(entry->hash == hash && entry->isFile == isFile &&
+         IndexFT_entryHasPath(entry, path, len))
+         return entry->node;
+   }
+
+   return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+Node_D IndexFT_getDir(IndexFT_T index, const char* path)
+{
+   return IndexFT_get(index, path, FALSE);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+Node_F IndexFT_getFile(IndexFT_T index, const char* path)
+{
+   return IndexFT_get(index, path, TRUE);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+size_t IndexFT_getNumEntries(IndexFT_T index)
+{
+   assert(index != NULL);
+
+   return index->size;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see indexFT.h for specification */
+size_t IndexFT_getMemoryUsage(IndexFT_T index)
+{
+   assert(index != NULL);
+
+   return sizeof(struct IndexFT) +
+      index->capacity * sizeof(struct IndexEntry);
+}
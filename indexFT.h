@@ -0,0 +1,72 @@
+/*--------------------------------------------------------------------*/
+/* indexFT.h                                                          */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+#ifndef INDEX_INCLUDED
+#define INDEX_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodes.h"
+
+/* An IndexFT_T maps the full path of every node in a file tree to that
+   node, so that exact-path queries need not walk down from the root.
+   The index stores only a hash and a node pointer per entry; paths are
+   compared against the nodes themselves. */
+typedef struct IndexFT* IndexFT_T;
+
+/* Returns a new, empty index, or NULL if there is an allocation
+   error. */
+IndexFT_T IndexFT_new(void);
+
+/* Frees all memory occupied by index. The indexed nodes are not
+   affected. */
+void IndexFT_free(IndexFT_T index);
+
+/* Returns the hash of the len characters beginning at s, continuing
+   from hash, the hash of the characters that precede them. Pass 0 as
+   hash to start a new string. */
+size_t IndexFT_hash(size_t hash, const char* s, size_t len);
+
+/* Adds directory n to index, where hash is the hash of n's path.
+   Returns TRUE on success or FALSE if there is an allocation error. */
+boolean IndexFT_putDir(IndexFT_T index, size_t hash, Node_D n);
+
+/* Adds file n to index, where hash is the hash of n's path.
+   Returns TRUE on success or FALSE if there is an allocation error. */
+boolean IndexFT_putFile(IndexFT_T index, size_t hash, Node_F n);
+
+/* Removes directory n, whose path has hash hash, from index.
+   Returns TRUE if n was in index and FALSE otherwise. */
+boolean IndexFT_removeDir(IndexFT_T index, size_t hash, Node_D n);
+
+/* Removes file n, whose path has hash hash, from index.
+   Returns TRUE if n was in index and FALSE otherwise. */
+boolean IndexFT_removeFile(IndexFT_T index, size_t hash, Node_F n);
+
+/* Makes the entry of directory old, whose path has hash hash, refer
+   to new, which takes old's place at that path, without moving it.
+   Returns TRUE if old was in index and FALSE otherwise. */
+boolean IndexFT_replaceDir(IndexFT_T index, size_t hash, Node_D old,
+                           Node_D new);
+
+/* Same as IndexFT_replaceDir, but for files. */
+boolean IndexFT_replaceFile(IndexFT_T index, size_t hash, Node_F old,
+                            Node_F new);
+
+/* Returns the directory in index whose path is path, or NULL if there
+   is none. */
+Node_D IndexFT_getDir(IndexFT_T index, const char* path);
+
+/* Returns the file in index whose path is path, or NULL if there is
+   none. */
+Node_F IndexFT_getFile(IndexFT_T index, const char* path);
+
+/* Returns the number of paths in index. */
+size_t IndexFT_getNumEntries(IndexFT_T index);
+
+/* Returns the number of bytes of memory occupied by index. */
+size_t IndexFT_getMemoryUsage(IndexFT_T index);
+
+#endif
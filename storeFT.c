@@ -0,0 +1,600 @@
+/*--------------------------------------------------------------------*/
+/* storeFT.c                                                          */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "a4def.h"
+#include "storeFT.h"
+
+/* Copies are aligned to, and small ones sized in multiples of,
+   STORE_ALIGN bytes. Copies of up to MAX_SMALL bytes are carved from
+   slabs; the first slab of a size class holds FIRST_SLAB_BLOCKS of
+   them, and each later one twice as many as the one before, up to
+   MAX_SLAB_BYTES. */
+enum {STORE_ALIGN = 16, MAX_SMALL = 1024, FIRST_SLAB_BLOCKS = 16,
+      MAX_SLAB_BYTES = 65536};
+
+/* The table of distinct copies is an open-addressing hash table with
+   linear probing, like the path index. Its capacity is zero until the
+   first copy is shared, and then always a power of two, at least
+   MIN_BLOBS, and at least twice the number of blobs in it. */
+enum {MIN_BLOBS = 16};
+
+/* The block sizes of the size classes, in increasing order: every
+   multiple of STORE_ALIGN up to 128 bytes, and then four classes for
+   each doubling, so that no more than a fifth of a block is wasted
+   beyond that. */
+static const size_t classSizes[] = {
+   16, 32, 48, 64, 80, 96, 112, 128,
+   160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 896, 1024
+};
+
+enum {NUM_CLASSES = sizeof(classSizes) / sizeof(classSizes[0])};
+
+/* A slab: this header, padded to STORE_ALIGN bytes, and then the
+   blocks carved from it. */
+struct StoreSlab
+{
+   /* the next slab of the store */
+   struct StoreSlab* next;
+
+   /* the size of the slab, header included */
+   size_t size;
+};
+
+/* A released block, waiting to be reused by a copy of its class. */
+struct StoreFreeBlock
+{
+   /* the next released block of the same class */
+   struct StoreFreeBlock* next;
+};
+
+/* The blocks of one size class. */
+struct StoreClass
+{
+   /* the released blocks, most recent first */
+   struct StoreFreeBlock* free;
+
+   /* the part of the class's newest slab that has not been carved into
+      blocks yet, from next up to end */
+   char* next;
+   char* end;
+
+   /* the number of blocks that the class's next slab holds */
+   size_t slabBlocks;
+};
+
+/* A copy too large for any class: this header, padded to STORE_ALIGN
+   bytes, and then the copy. */
+struct StoreLarge
+{
+   /* the neighbours of the copy in the store's list of large copies */
+   struct StoreLarge* prev;
+   struct StoreLarge* next;
+
+   /* the size of the allocation, header included */
+   size_t size;
+};
+
+/* A distinct copy shared by every file whose contents are equal to
+   it. A slot whose copy is NULL is empty. */
+struct StoreBlob
+{
+   /* the hash of the copy's bytes */
+   size_t hash;
+
+   /* the copy and its length */
+   void* copy;
+   size_t length;
+
+   /* the number of times StoreFT_copy has returned the copy without a
+      matching StoreFT_release */
+   size_t refs;
+};
+
+/* A StoreFT is a set of slabs for each size class, a list of large
+   copies, and the table of the copies that are shared. */
+struct StoreFT
+{
+   /* the size classes */
+   struct StoreClass classes[NUM_CLASSES];
+
+   /* every slab of every class */
+   struct StoreSlab* slabs;
+
+   /* every large copy not yet released */
+   struct StoreLarge* large;
+
+   /* the number of bytes in slabs and large copies */
+   size_t memory;
+
+   /* whether equal contents are given a single copy */
+   boolean isDeduplicating;
+
+   /* the slots of the table of shared copies, the number of them, and
+      the number in use */
+   struct StoreBlob* blobs;
+   size_t capacity;
+   size_t numShared;
+
+   /* the number of copies returned and not yet released, and their
+      total length; and the number of distinct copies among them, and
+      their total length */
+   size_t numCopies;
+   size_t copyBytes;
+   size_t numBlobs;
+   size_t blobBytes;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Returns n rounded up to a multiple of STORE_ALIGN. */
+static size_t StoreFT_align(size_t n)
+{
+   return (n + STORE_ALIGN - 1) / STORE_ALIGN * STORE_ALIGN;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the hash of the length bytes at contents. They are mixed a
+   word at a time, which makes hashing even large contents cheap next to
+   comparing them with an equal copy. */
+static size_t StoreFT_hash(const void* contents, size_t length)
+{
+   const size_t HASH_MULTIPLIER = 0x9E3779B1;
+   const unsigned char* bytes = contents;
+   size_t hash = length;
+   size_t word;
+   size_t i;
+
+   assert(contents != NULL || length == 0);
+
+   for(i = 0; i + sizeof(size_t) <= length; i += sizeof(size_t))
+   {
+      memcpy(&word, bytes + i, sizeof(size_t));
+      hash = (hash ^ word) * HASH_MULTIPLIER;
+   }
+   if(i < length)
+   {
+      word = 0;
+      memcpy(&word, bytes + i, length - i);
+      hash = (hash ^ word) * HASH_MULTIPLIER;
+   }
+
+   /* Bring the high bits, which the multiplications move everything
+      towards, down to the low ones that pick a slot */
+   hash ^= hash >> 16 >> 16;
+   return hash ^ (hash >> 15);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the index of the smallest class whose blocks can hold length
+   bytes, which must be at most MAX_SMALL. */
+static size_t StoreFT_classOf(size_t length)
+{
+   size_t c = 0;
+
+   assert(length <= MAX_SMALL);
+
+   while(classSizes[c] < length)
+      c++;
+   return c;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see storeFT.h for specification */
+StoreFT_T StoreFT_new(boolean isDeduplicating)
+{
+   StoreFT_T store;
+   size_t c;
+
+   store = malloc(sizeof(struct StoreFT));
+   if(store == NULL)
+      return NULL;
+
+   for(c = 0; c < NUM_CLASSES; c++)
+   {
+      store->classes[c].free = NULL;
+      store->classes[c].next = NULL;
+      store->classes[c].end = NULL;
+      store->classes[c].slabBlocks = FIRST_SLAB_BLOCKS;
+   }
+   store->slabs = NULL;
+   store->large = NULL;
+   store->memory = 0;
+   store->isDeduplicating = isDeduplicating;
+   store->blobs = NULL;
+   store->capacity = 0;
+   store->numShared = 0;
+   store->numCopies = 0;
+   store->copyBytes = 0;
+   store->numBlobs = 0;
+   store->blobBytes = 0;
+
+   return store;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see storeFT.h for specification */
+void StoreFT_free(StoreFT_T store)
+{
+   struct StoreSlab* slab;
+   struct StoreLarge* large;
+
+   assert(store != NULL);
+
+   while(store->slabs != NULL)
+   {
+      slab = store->slabs;
+      store->slabs = slab->next;
+      free(slab);
+   }
+   while(store->large != NULL)
+   {
+      large = store->large;
+      store->large = large->next;
+      free(large);
+   }
+   free(store->blobs);
+   free(store);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see storeFT.h for specification */
+void StoreFT_setDeduplicating(StoreFT_T store, boolean isDeduplicating)
+{
+   assert(store != NULL);
+
+   store->isDeduplicating = isDeduplicating;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Gives class c of store a new slab to carve blocks from, once its
+   newest one is used up. A slab holds a whole number of blocks, so
+   nothing of it is left over. Returns TRUE on success or FALSE if there
+   is an allocation error, in which case store is unchanged. */
+static boolean StoreFT_addSlab(StoreFT_T store, size_t c)
+{
+   struct StoreClass* class;
+   struct StoreSlab* slab;
+   size_t header;
+   size_t size;
+
+   assert(store != NULL);
+   assert(c < NUM_CLASSES);
+
+   class = &store->classes[c];
+   header = StoreFT_align(sizeof(struct StoreSlab));
+   size = header + class->slabBlocks * classSizes[c];
+   slab = malloc(size);
+   if(slab == NULL)
+      return FALSE;
+
+   slab->next = store->slabs;
+   slab->size = size;
+   store->slabs = slab;
+   store->memory += size;
+
+   class->next = (char*) slab + header;
+   class->end = (char*) slab + size;
+   if(2 * class->slabBlocks * classSizes[c] <= MAX_SLAB_BYTES)
+      class->slabBlocks *= 2;
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns a copy in store of the length bytes at contents, which are
+   more than MAX_SMALL, in an allocation of its own, or NULL if there
+   is an allocation error. */
+static void* StoreFT_copyLarge(StoreFT_T store, const void* contents,
+                               size_t length)
+{
+   struct StoreLarge* large;
+   size_t header;
+
+   assert(store != NULL);
+   assert(contents != NULL);
+
+   header = StoreFT_align(sizeof(struct StoreLarge));
+   if(length > (size_t) -1 - header)
+      return NULL;
+   large = malloc(header + length);
+   if(large == NULL)
+      return NULL;
+
+   large->prev = NULL;
+   large->next = store->large;
+   large->size = header + length;
+   if(store->large != NULL)
+      store->large->prev = large;
+   store->large = large;
+   store->memory += large->size;
+
+   return memcpy((char*) large + header, contents, length);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns a new copy in store of the length bytes at contents, or NULL
+   if there is an allocation error. */
+static void* StoreFT_allocate(StoreFT_T store, const void* contents,
+                              size_t length)
+{
+   struct StoreClass* class;
+   struct StoreFreeBlock* block;
+   size_t c;
+   char* copy;
+
+   assert(store != NULL);
+   assert(contents != NULL || length == 0);
+
+   if(length > MAX_SMALL)
+      return StoreFT_copyLarge(store, contents, length);
+
+   /* Reuse the most recently released block of the class, which is
+      the likeliest to still be in the cache, or else carve the next
+      one from its newest slab */
+   c = StoreFT_classOf(length);
+   class = &store->classes[c];
+   if(class->free != NULL)
+   {
+      block = class->free;
+      class->free = block->next;
+      copy = (char*) block;
+   }
+   else
+   {
+      if(class->next == class->end && !StoreFT_addSlab(store, c))
+         return NULL;
+      copy = class->next;
+      class->next += classSizes[c];
+   }
+
+   if(length != 0)
+      memcpy(copy, contents, length);
+   return copy;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Gives copy, of length bytes, back to store. */
+static void StoreFT_deallocate(StoreFT_T store, void* copy,
+                               size_t length)
+{
+   struct StoreClass* class;
+   struct StoreFreeBlock* block;
+   struct StoreLarge* large;
+
+   assert(store != NULL);
+   assert(copy != NULL);
+
+   if(length > MAX_SMALL)
+   {
+      large = (struct StoreLarge*)
+         ((char*) copy - StoreFT_align(sizeof(struct StoreLarge)));
+      if(large->prev == NULL)
+         store->large = large->next;
+      else
+         large->prev->next = large->next;
+      if(large->next != NULL)
+         large->next->prev = large->prev;
+      store->memory -= large->size;
+      free(large);
+      return;
+   }
+
+   class = &store->classes[StoreFT_classOf(length)];
+   block = copy;
+   block->next = class->free;
+   class->free = block;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Places blob into the first free slot of its probe sequence in blobs,
+   which has capacity slots. */
+static void StoreFT_place(struct StoreBlob* blobs, size_t capacity,
+                          struct StoreBlob blob)
+{
+   size_t i;
+
+   assert(blobs != NULL);
+
+   i = blob.hash & (capacity - 1);
+   while(blobs[i].copy != NULL)
+      i = (i + 1) & (capacity - 1);
+   blobs[i] = blob;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Moves every shared copy of store into a new table with newCapacity
+   slots. Returns TRUE on success or FALSE if there is an allocation
+   error, in which case store is unchanged. */
+static boolean StoreFT_resize(StoreFT_T store, size_t newCapacity)
+{
+   struct StoreBlob* newBlobs;
+   size_t i;
+
+   assert(store != NULL);
+
+   newBlobs = calloc(newCapacity, sizeof(struct StoreBlob));
+   if(newBlobs == NULL)
+      return FALSE;
+
+   for(i = 0; i < store->capacity; i++)
+      if(store->blobs[i].copy != NULL)
+         StoreFT_place(newBlobs, newCapacity, store->blobs[i]);
+
+   free(store->blobs);
+   store->blobs = newBlobs;
+   store->capacity = newCapacity;
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Removes the shared copy in slot i of store's table. */
+static void StoreFT_removeBlob(StoreFT_T store, size_t i)
+{
+   size_t mask;
+   size_t j;
+   size_t home;
+
+   assert(store != NULL);
+   assert(i < store->capacity);
+
+   /* Shift later entries of the probe run back over the hole, as the
+      path index does */
+   mask = store->capacity - 1;
+   for(j = (i + 1) & mask; store->blobs[j].copy != NULL;
+       j = (j + 1) & mask)
+   {
+      home = store->blobs[j].hash & mask;
+      if(((j - home) & mask) >= ((j - i) & mask))
+      {
+         store->blobs[i] = store->blobs[j];
+         i = j;
+      }
+   }
+   store->blobs[i].copy = NULL;
+   store->numShared--;
+
+   /* Give memory back after large removals, ignoring failure */
+   if(store->capacity > MIN_BLOBS && 8 * store->numShared <
+      store->capacity)
+      (void) StoreFT_resize(store, store->capacity / 2);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see storeFT.h for specification */
+void* StoreFT_copy(StoreFT_T store, const void* contents, size_t length)
+{
+   struct StoreBlob blob;
+   size_t mask;
+   size_t i;
+
+   assert(store != NULL);
+   assert(contents != NULL || length == 0);
+
+   if(!store->isDeduplicating)
+   {
+      blob.copy = StoreFT_allocate(store, contents, length);
+      if(blob.copy == NULL)
+         return NULL;
+      store->numBlobs++;
+      store->blobBytes += length;
+   }
+   else
+   {
+      /* Share the copy of equal contents if there is one */
+      blob.hash = StoreFT_hash(contents, length);
+      mask = store->capacity - 1;
+      for(i = blob.hash & mask; store->capacity != 0 &&
+             store->blobs[i].copy != NULL; i = (i + 1) & mask)
+         if(store->blobs[i].hash == blob.hash &&
+            store->blobs[i].length == length &&
+            memcmp(store->blobs[i].copy, contents, length) == 0)
+         {
+            store->blobs[i].refs++;
+            store->numCopies++;
+            store->copyBytes += length;
+            return store->blobs[i].copy;
+         }
+
+      if(2 * (store->numShared + 1) > store->capacity &&
+         !StoreFT_resize(store, (store->capacity == 0) ? MIN_BLOBS :
+                         2 * store->capacity))
+         return NULL;
+      blob.copy = StoreFT_allocate(store, contents, length);
+      if(blob.copy == NULL)
+         return NULL;
+      blob.length = length;
+      blob.refs = 1;
+      StoreFT_place(store->blobs, store->capacity, blob);
+      store->numShared++;
+      store->numBlobs++;
+      store->blobBytes += length;
+   }
+
+   store->numCopies++;
+   store->copyBytes += length;
+   return blob.copy;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see storeFT.h for specification */
+void StoreFT_release(StoreFT_T store, void* copy, size_t length)
+{
+   size_t mask;
+   size_t i;
+
+   assert(store != NULL);
+   assert(copy != NULL);
+   assert(store->numCopies > 0);
+
+   store->numCopies--;
+   store->copyBytes -= length;
+
+   /* A shared copy is found by its address, since copies made before
+      the store began deduplicating may be equal to it */
+   if(store->numShared != 0)
+   {
+      mask = store->capacity - 1;
+      for(i = StoreFT_hash(copy, length) & mask;
+          store->blobs[i].copy != NULL; i = (i + 1) & mask)
+         if(store->blobs[i].copy == copy)
+         {
+            if(--store->blobs[i].refs != 0)
+               return;
+            StoreFT_removeBlob(store, i);
+            break;
+         }
+   }
+
+   store->numBlobs--;
+   store->blobBytes -= length;
+   StoreFT_deallocate(store, copy, length);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see storeFT.h for specification */
+void StoreFT_getStats(StoreFT_T store, size_t* pNumCopies,
+                      size_t* pCopyBytes, size_t* pNumBlobs,
+                      size_t* pBlobBytes)
+{
+   assert(store != NULL);
+   assert(pNumCopies != NULL);
+   assert(pCopyBytes != NULL);
+   assert(pNumBlobs != NULL);
+   assert(pBlobBytes != NULL);
+
+   *pNumCopies = store->numCopies;
+   *pCopyBytes = store->copyBytes;
+   *pNumBlobs = store->numBlobs;
+   *pBlobBytes = store->blobBytes;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* see storeFT.h for specification */
+size_t StoreFT_getMemoryUsage(StoreFT_T store)
+{
+   assert(store != NULL);
+
+   return sizeof(struct StoreFT) + store->memory +
+      store->capacity * sizeof(struct StoreBlob);
+}
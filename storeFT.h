@@ -0,0 +1,53 @@
+/*--------------------------------------------------------------------*/
+/* storeFT.h                                                          */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+#ifndef STORE_INCLUDED
+#define STORE_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/* A StoreFT_T holds copies of the contents of the files of a file tree
+   that owns them. Small contents are packed together into slabs, one
+   set of slabs for each size class, so that copying a file's contents
+   costs no allocation of its own most of the time; larger contents are
+   allocated one by one. A store may also deduplicate, keeping a single
+   copy of equal contents for every file that has them. */
+typedef struct StoreFT* StoreFT_T;
+
+/* Returns a new, empty store, which deduplicates if isDeduplicating is
+   TRUE, or NULL if there is an allocation error. */
+StoreFT_T StoreFT_new(boolean isDeduplicating);
+
+/* Frees store and every copy still in it. */
+void StoreFT_free(StoreFT_T store);
+
+/* Sets whether store deduplicates the copies it makes from now on.
+   Copies made before are released as they were made. */
+void StoreFT_setDeduplicating(StoreFT_T store, boolean isDeduplicating);
+
+/* Returns a copy in store of the length bytes beginning at contents,
+   or NULL if there is an allocation error. If store deduplicates, the
+   copy is shared with every other copy of equal contents, and must not
+   be changed. The copy stays until each time it was returned is
+   matched by a release with StoreFT_release, or store is freed. */
+void* StoreFT_copy(StoreFT_T store, const void* contents, size_t length);
+
+/* Gives copy, a copy of length bytes returned by StoreFT_copy, back to
+   store, for a later copy of the same size class to reuse. */
+void StoreFT_release(StoreFT_T store, void* copy, size_t length);
+
+/* Stores in *pNumCopies and *pCopyBytes the number of copies that
+   store has returned and that have not been released, and their total
+   length, and in *pNumBlobs and *pBlobBytes the number of distinct
+   copies among them, and their total length. */
+void StoreFT_getStats(StoreFT_T store, size_t* pNumCopies,
+                      size_t* pCopyBytes, size_t* pNumBlobs,
+                      size_t* pBlobBytes);
+
+/* Returns the number of bytes of memory occupied by store. */
+size_t StoreFT_getMemoryUsage(StoreFT_T store);
+
+#endif
@@ -0,0 +1,122 @@
+/*--------------------------------------------------------------------*/
+/* ft_alloc.c                                                         */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks that the queries of ft.h make no heap allocations, on the
+   default tree and on a snapshot of it, whether they find what they
+   look for or not. The allocation functions are counted by linking
+   with the GNU linker's --wrap option:
+
+   gcc -I. -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc \
+      tests/ft_alloc.c ft.c NodeD.c NodeF.c checkerFT.c indexFT.c \
+      storeFT.c dynarray.c -lpthread -o ft_alloc
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t num, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+/* The number of allocations made since the count was last reset */
+static size_t numAllocs;
+
+void* __wrap_malloc(size_t size) {
+   numAllocs++;
+   return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size) {
+   numAllocs++;
+   return __real_calloc(num, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+   numAllocs++;
+   return __real_realloc(ptr, size);
+}
+
+/* The paths that the queries are asked about: directories, files,
+   the only child of a directory, and paths that name nothing or go
+   through a file */
+static char* paths[] = {
+   "a", "a/b", "a/b/c", "a/b/c/f1", "a/b/f2", "a/b/c/f3",
+   "a/only", "a/only/f4", "a/x", "a/b/x", "a/b/c/f1/x", "b",
+   "a/b/c/d/e/f/g"
+};
+
+/* Runs every query of ft.h on every path in paths, in ft, or in the
+   default tree if ft is NULL, and returns the number of allocations
+   they made. */
+static size_t countQueries(FT_T ft) {
+   size_t i;
+   boolean type;
+   size_t length;
+
+   numAllocs = 0;
+   for(i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+      if(ft == NULL) {
+         (void) FT_containsDir(paths[i]);
+         (void) FT_containsFile(paths[i]);
+         (void) FT_stat(paths[i], &type, &length);
+         (void) FT_getFileContents(paths[i]);
+      }
+      else {
+         (void) FT_containsDirIn(ft, paths[i]);
+         (void) FT_containsFileIn(ft, paths[i]);
+         (void) FT_statIn(ft, paths[i], &type, &length);
+         (void) FT_getFileContentsIn(ft, paths[i]);
+      }
+   return numAllocs;
+}
+
+/* Returns TRUE if the queries of ft, as in countQueries, made no
+   allocations, and otherwise reports how many they made, in what. */
+static boolean checkQueries(FT_T ft, const char* what) {
+   size_t count;
+
+   count = countQueries(ft);
+   if(count == 0)
+      return TRUE;
+   fprintf(stderr, "%lu allocations in queries %s\n",
+           (unsigned long) count, what);
+   return FALSE;
+}
+
+int main(void) {
+   static char contents[] = "contents";
+   FT_T snapshot;
+   boolean isClean = TRUE;
+
+   if(!checkQueries(NULL, "before FT_init"))
+      isClean = FALSE;
+
+   (void) FT_init();
+   (void) FT_insertDir("a/b/c");
+   (void) FT_insertFile("a/b/c/f1", contents, sizeof(contents));
+   (void) FT_insertFile("a/b/f2", contents, sizeof(contents));
+   (void) FT_insertFile("a/b/c/f3", NULL, 0);
+   (void) FT_insertFile("a/only/f4", contents, sizeof(contents));
+   if(!checkQueries(NULL, "of the tree"))
+      isClean = FALSE;
+
+   snapshot = FT_snapshot();
+   if(snapshot == NULL) {
+      fprintf(stderr, "FT_snapshot failed\n");
+      return EXIT_FAILURE;
+   }
+   if(!checkQueries(snapshot, "of a snapshot"))
+      isClean = FALSE;
+   FT_free(snapshot);
+   (void) FT_destroy();
+
+   if(!isClean)
+      return EXIT_FAILURE;
+   printf("no allocations in queries\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+/*--------------------------------------------------------------------*/
+/* ft_batch.c                                                         */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks FT_insertBatch against FT_insertFile: each round fills two
+   trees alike, inserts a random batch into one of them with
+   FT_insertBatchIn and the same files into the other one at a time,
+   and checks that every file got the same status and that the trees
+   end up the same. The batches repeat paths, name files where
+   directories are, use other roots and empty components, and insert
+   into trees with no root, so that every status but MEMORY_ERROR is
+   returned. No two paths of a batch name the same file in different
+   ways, since those may be inserted in another order: the paths with
+   empty components name files "g", which no other path does. An
+   optional argument seeds the batches.
+
+   gcc -I. tests/ft_batch.c ft.c NodeD.c NodeF.c checkerFT.c \
+      indexFT.c storeFT.c dynarray.c -lpthread -o ft_batch
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of rounds, and the most files in a batch */
+enum {NUM_ROUNDS = 3000, MAX_BATCH = 40};
+
+/* The state of the pseudo-random sequence */
+static unsigned seed = 1;
+
+/* Returns the next value of the pseudo-random sequence, less than n. */
+static unsigned next(unsigned n) {
+   seed = seed * 1103515245u + 12345u;
+   return (seed >> 8) % n;
+}
+
+/* Writes a random path to path: usually a file up to four levels
+   below "r", whose directories are named "d" and whose files are named
+   "f", but sometimes the root itself, a path below another root, or a
+   path with an empty component, whose file is named "g". */
+static void makePath(char* path) {
+   unsigned depth;
+   unsigned i;
+
+   switch(next(20)) {
+      case 0:
+         strcpy(path, "r");
+         return;
+      case 1:
+         strcpy(path, "x/f1");
+         return;
+      case 2:
+         strcpy(path, "r//g1");
+         return;
+      case 3:
+         strcpy(path, "r/d0//g1");
+         return;
+      default:
+         break;
+   }
+   depth = next(4);
+   path += sprintf(path, "r");
+   for(i = 0; i < depth; i++)
+      path += sprintf(path, "/d%u", next(3));
+   (void) sprintf(path, "/f%u", next(6));
+}
+
+/* Makes the same random changes to a and b, which must be empty. */
+static void fillBoth(FT_T a, FT_T b) {
+   char path[64];
+   char* lastSlash;
+   int i;
+
+   if(next(5) != 0) {
+      (void) FT_insertDirIn(a, "r");
+      (void) FT_insertDirIn(b, "r");
+   }
+   for(i = 0; i < 6; i++) {
+      makePath(path);
+      if(next(2) == 0) {
+         (void) FT_insertFileIn(a, path, NULL, 3);
+         (void) FT_insertFileIn(b, path, NULL, 3);
+      }
+      else {
+         lastSlash = strrchr(path, '/');
+         if(lastSlash != NULL)
+            *lastSlash = '\0';
+         (void) FT_insertDirIn(a, path);
+         (void) FT_insertDirIn(b, path);
+      }
+   }
+   /* A file where the batches put directories */
+   if(next(4) == 0) {
+      (void) FT_insertFileIn(a, "r/d1", NULL, 0);
+      (void) FT_insertFileIn(b, "r/d1", NULL, 0);
+   }
+}
+
+/* Returns TRUE if a and b have the same listing, and each of the n
+   paths has the same status, type, length, and contents in both. */
+static boolean isSame(FT_T a, FT_T b, char* paths[], size_t n) {
+   char* listingA;
+   char* listingB;
+   boolean typeA;
+   boolean typeB;
+   size_t lengthA;
+   size_t lengthB;
+   int status;
+   boolean result;
+   size_t i;
+
+   listingA = FT_toStringIn(a);
+   listingB = FT_toStringIn(b);
+   result = (boolean) (listingA != NULL && listingB != NULL &&
+                       strcmp(listingA, listingB) == 0);
+   free(listingA);
+   free(listingB);
+   for(i = 0; result && i < n; i++) {
+      status = FT_statIn(a, paths[i], &typeA, &lengthA);
+      if(status != FT_statIn(b, paths[i], &typeB, &lengthB) ||
+         (status == SUCCESS &&
+          (typeA != typeB || (typeA && lengthA != lengthB))) ||
+         FT_getFileContentsIn(a, paths[i]) !=
+         FT_getFileContentsIn(b, paths[i]))
+         result = FALSE;
+   }
+   return result;
+}
+
+int main(int argc, char* argv[]) {
+   static char pathBuffers[MAX_BATCH][64];
+   char* paths[MAX_BATCH];
+   void* contents[MAX_BATCH];
+   size_t lengths[MAX_BATCH];
+   int results[MAX_BATCH];
+   FT_T a;
+   FT_T b;
+   size_t n;
+   size_t i;
+   int round;
+
+   if(argc > 1)
+      seed = (unsigned) atoi(argv[1]);
+
+   /* The empty batch, and a tree that is not initialized */
+   (void) FT_init();
+   if(FT_insertBatch(paths, contents, lengths, 0, results) != SUCCESS) {
+      fprintf(stderr, "an empty batch failed\n");
+      return EXIT_FAILURE;
+   }
+   (void) FT_destroy();
+   paths[0] = "r/f";
+   contents[0] = NULL;
+   lengths[0] = 0;
+   if(FT_insertBatch(paths, contents, lengths, 1, results) !=
+      INITIALIZATION_ERROR) {
+      fprintf(stderr, "inserted into a tree not initialized\n");
+      return EXIT_FAILURE;
+   }
+
+   for(round = 0; round < NUM_ROUNDS; round++) {
+      a = FT_new();
+      b = FT_new();
+      if(a == NULL || b == NULL)
+         return EXIT_FAILURE;
+      fillBoth(a, b);
+
+      n = next(MAX_BATCH);
+      for(i = 0; i < n; i++) {
+         makePath(pathBuffers[i]);
+         paths[i] = pathBuffers[i];
+         contents[i] = pathBuffers[i];
+         lengths[i] = i;
+      }
+      if(FT_insertBatchIn(a, paths, contents, lengths, n, results) !=
+         SUCCESS) {
+         fprintf(stderr, "round %d: the batch failed\n", round);
+         return EXIT_FAILURE;
+      }
+      for(i = 0; i < n; i++)
+         if(FT_insertFileIn(b, paths[i], contents[i], lengths[i]) !=
+            results[i]) {
+            fprintf(stderr, "round %d: %s got status %d\n", round,
+                    paths[i], results[i]);
+            return EXIT_FAILURE;
+         }
+      if(!isSame(a, b, paths, n)) {
+         fprintf(stderr, "round %d: the trees differ\n", round);
+         return EXIT_FAILURE;
+      }
+      FT_free(a);
+      FT_free(b);
+   }
+
+   printf("batch ok\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+/*--------------------------------------------------------------------*/
+/* ft_bulk.c                                                          */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks FT_bulkLoad. First, each of its errors is provoked by a
+   small set of paths, which must leave the tree empty. Then, in each
+   of a number of rounds, a random sorted set of paths is loaded into
+   one tree with FT_bulkLoadIn and inserted into another one at a time,
+   and the trees must end up the same; a set that FT_insertFile cannot
+   insert must fail to load and leave the tree empty. The names are
+   chosen so that '/' does not sort first among their characters, and
+   some sets are left unsorted. An optional argument seeds the sets.
+
+   gcc -I. tests/ft_bulk.c ft.c NodeD.c NodeF.c checkerFT.c \
+      indexFT.c storeFT.c dynarray.c -lpthread -o ft_bulk
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of rounds, and the most paths in a set */
+enum {NUM_ROUNDS = 3000, MAX_PATHS = 120};
+
+/* A set of paths that FT_bulkLoad must reject with status */
+struct BadSet {
+   const char* paths[3];
+   int status;
+};
+
+/* The sets of paths that provoke each error */
+static const struct BadSet badSets[] = {
+   {{"r/a", "r/a", NULL}, ALREADY_IN_TREE},
+   {{"r/b", "r/a", NULL}, PARENT_CHILD_ERROR},
+   {{"r/a", "s/a", NULL}, CONFLICTING_PATH},
+   {{"r//a", NULL, NULL}, CONFLICTING_PATH},
+   {{"r/a", "r/a/b", NULL}, NOT_A_DIRECTORY}
+};
+
+/* The names of directories and files: '-' and '.' sort before '/' */
+static const char* names[] = {"a", "a-b", "a.c", "b", "a0", "z"};
+
+/* The state of the pseudo-random sequence */
+static unsigned seed = 1;
+
+/* Returns the next value of the pseudo-random sequence, less than n. */
+static unsigned next(unsigned n) {
+   seed = seed * 1103515245u + 12345u;
+   return (seed >> 8) % n;
+}
+
+/* Writes a random path below "r" to path. Most files are named with
+   an "f" in front of one of names, but some have the same names as
+   directories. */
+static void makePath(char* path) {
+   unsigned depth;
+   unsigned i;
+
+   depth = next(4);
+   path += sprintf(path, "r");
+   for(i = 0; i < depth; i++)
+      path += sprintf(path, "/%s", names[next(6)]);
+   (void) sprintf(path, next(8) != 0 ? "/f%s" : "/%s", names[next(6)]);
+}
+
+/* Compares the paths that a and b point to, for qsort. */
+static int comparePaths(const void* a, const void* b) {
+   return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/* Returns TRUE if ft is empty. */
+static boolean isEmpty(FT_T ft) {
+   char* listing;
+   boolean result;
+
+   listing = FT_toStringIn(ft);
+   result = (boolean) (listing != NULL && *listing == '\0');
+   free(listing);
+   return result;
+}
+
+/* Checks that each of badSets fails to load with its status and leaves
+   the tree empty. Returns the number of mismatches. */
+static int checkBadSets(void) {
+   char* paths[3];
+   void* contents[3] = {NULL, NULL, NULL};
+   size_t lengths[3] = {0, 0, 0};
+   int failures = 0;
+   size_t n;
+   size_t s;
+   FT_T ft;
+
+   for(s = 0; s < sizeof(badSets) / sizeof(badSets[0]); s++) {
+      for(n = 0; n < 3 && badSets[s].paths[n] != NULL; n++)
+         paths[n] = (char*) badSets[s].paths[n];
+      ft = FT_new();
+      if(ft == NULL)
+         return failures + 1;
+      if(FT_bulkLoadIn(ft, paths, contents, lengths, n) !=
+         badSets[s].status || !isEmpty(ft)) {
+         fprintf(stderr, "set %lu was not rejected\n", (unsigned long) s);
+         failures++;
+      }
+      FT_free(ft);
+   }
+
+   /* A tree that is not empty, and one that is not initialized */
+   paths[0] = "r/a";
+   ft = FT_new();
+   if(ft == NULL)
+      return failures + 1;
+   if(FT_insertDirIn(ft, "r") != SUCCESS ||
+      FT_bulkLoadIn(ft, paths, contents, lengths, 1) !=
+      INITIALIZATION_ERROR) {
+      fprintf(stderr, "loaded into a tree that is not empty\n");
+      failures++;
+   }
+   FT_free(ft);
+   (void) FT_destroy();
+   if(FT_bulkLoad(paths, contents, lengths, 1) != INITIALIZATION_ERROR) {
+      fprintf(stderr, "loaded into a tree not initialized\n");
+      failures++;
+   }
+   return failures;
+}
+
+/* Loads a random set of paths into a new tree and checks it against
+   one with the same files inserted one at a time, in round round.
+   Returns TRUE if they match. */
+static boolean checkRandomSet(int round) {
+   static char pathBuffers[MAX_PATHS][64];
+   char* paths[MAX_PATHS];
+   void* contents[MAX_PATHS];
+   size_t lengths[MAX_PATHS];
+   char* listingA;
+   char* listingB;
+   char* swap;
+   int expected = SUCCESS;
+   int status;
+   boolean result = TRUE;
+   FT_T a;
+   FT_T b;
+   size_t n;
+   size_t i;
+   size_t j;
+
+   /* A sorted set of distinct paths, sometimes put out of order */
+   n = next(MAX_PATHS) + 1;
+   for(i = 0; i < n; i++) {
+      makePath(pathBuffers[i]);
+      paths[i] = pathBuffers[i];
+   }
+   qsort(paths, n, sizeof(char*), comparePaths);
+   for(i = j = 1; i < n; i++)
+      if(strcmp(paths[i], paths[j - 1]) != 0)
+         paths[j++] = paths[i];
+   n = j;
+   if(n > 1 && next(10) == 0) {
+      swap = paths[0];
+      paths[0] = paths[n - 1];
+      paths[n - 1] = swap;
+   }
+   for(i = 0; i < n; i++) {
+      contents[i] = paths[i];
+      lengths[i] = i;
+   }
+
+   a = FT_new();
+   b = FT_new();
+   if(a == NULL || b == NULL)
+      return FALSE;
+   (void) FT_insertDirIn(b, "r");
+   for(i = 0; i < n; i++) {
+      status = FT_insertFileIn(b, paths[i], contents[i], lengths[i]);
+      if(status != SUCCESS)
+         expected = status;
+   }
+
+   status = FT_bulkLoadIn(a, paths, contents, lengths, n);
+   if(status != SUCCESS) {
+      /* Unsorted sets are rejected before FT_insertFile could fail */
+      if(!isEmpty(a) ||
+         (status != expected && status != PARENT_CHILD_ERROR)) {
+         fprintf(stderr, "round %d: status %d, expected %d\n", round,
+                 status, expected);
+         result = FALSE;
+      }
+   }
+   else if(expected != SUCCESS) {
+      fprintf(stderr, "round %d: loaded a bad set\n", round);
+      result = FALSE;
+   }
+   else {
+      listingA = FT_toStringIn(a);
+      listingB = FT_toStringIn(b);
+      if(listingA == NULL || listingB == NULL ||
+         strcmp(listingA, listingB) != 0) {
+         fprintf(stderr, "round %d: the trees differ\n", round);
+         result = FALSE;
+      }
+      free(listingA);
+      free(listingB);
+      for(i = 0; result && i < n; i++)
+         if(FT_getFileContentsIn(a, paths[i]) != contents[i]) {
+            fprintf(stderr, "round %d: wrong contents\n", round);
+            result = FALSE;
+         }
+   }
+   FT_free(a);
+   FT_free(b);
+   return result;
+}
+
+int main(int argc, char* argv[]) {
+   int round;
+
+   if(argc > 1)
+      seed = (unsigned) atoi(argv[1]);
+
+   if(checkBadSets() != 0)
+      return EXIT_FAILURE;
+   for(round = 0; round < NUM_ROUNDS; round++)
+      if(!checkRandomSet(round))
+         return EXIT_FAILURE;
+
+   printf("bulk load ok\n");
+   return EXIT_SUCCESS;
+}
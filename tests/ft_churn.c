@@ -0,0 +1,94 @@
+/*--------------------------------------------------------------------*/
+/* ft_churn.c                                                         */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Measures insert and remove churn: each round inserts a file two
+   directories below one of NUM_DIRS directories, creating the
+   directory between, and removes that directory again, leaving the
+   tree as it was. It prints the heap allocations and the time per
+   round. The allocation functions are counted by linking with the GNU
+   linker's --wrap option, as in ft_alloc.c. Only the functions of
+   ft.h are used, so it builds against any version of the FT. An
+   optional argument sets the number of rounds.
+
+   gcc -I. -O2 -DNDEBUG -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc \
+      tests/ft_churn.c ft.c NodeD.c NodeF.c checkerFT.c indexFT.c \
+      storeFT.c dynarray.c -lpthread -o ft_churn
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ft.h"
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t num, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+/* The number of directories that the rounds insert below */
+enum {NUM_DIRS = 100};
+
+/* The number of allocations made so far */
+static size_t numAllocs;
+
+void* __wrap_malloc(size_t size) {
+   numAllocs++;
+   return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size) {
+   numAllocs++;
+   return __real_calloc(num, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+   numAllocs++;
+   return __real_realloc(ptr, size);
+}
+
+int main(int argc, char* argv[]) {
+   long numRounds = 1000000;
+   char path[64];
+   struct timespec start;
+   struct timespec end;
+   double seconds;
+   size_t allocs;
+   long failures = 0;
+   long i;
+
+   if(argc > 1)
+      numRounds = atol(argv[1]);
+
+   (void) FT_init();
+   (void) FT_insertDir("r");
+   for(i = 0; i < NUM_DIRS; i++) {
+      sprintf(path, "r/d%ld", i);
+      (void) FT_insertDir(path);
+   }
+
+   allocs = numAllocs;
+   (void) clock_gettime(CLOCK_MONOTONIC, &start);
+   for(i = 0; i < numRounds; i++) {
+      sprintf(path, "r/d%ld/e%ld/f", i % NUM_DIRS, i % 7);
+      if(FT_insertFile(path, NULL, 0) != SUCCESS)
+         failures++;
+      path[7 + (i % NUM_DIRS >= 10)] = '\0';
+      if(FT_rmDir(path) != SUCCESS)
+         failures++;
+   }
+   (void) clock_gettime(CLOCK_MONOTONIC, &end);
+   allocs = numAllocs - allocs;
+   (void) FT_destroy();
+
+   seconds = (double) (end.tv_sec - start.tv_sec) +
+      (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+   printf("%ld rounds: %.2f allocations, %.0f ns per round%s\n",
+          numRounds, (double) allocs / (double) numRounds,
+          seconds * 1e9 / (double) numRounds,
+          failures == 0 ? "" : " (failures)");
+   return EXIT_SUCCESS;
+}
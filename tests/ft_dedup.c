@@ -0,0 +1,294 @@
+/*--------------------------------------------------------------------*/
+/* ft_dedup.c                                                         */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks FT_dedupContents and FT_getContentStats. Files are given a
+   few distinct contents, some short enough to be kept inside their
+   nodes, some packed into slabs, and some allocated one by one. Files
+   with equal contents must share one copy, and FT_getContentStats
+   must count exactly the copies that the files and a snapshot still
+   hold, as files are replaced and removed and the snapshot is freed.
+   A tree that only owns its contents must keep a copy per file.
+   Random changes then check the stats against the files that the tree
+   holds. An optional argument seeds those changes.
+
+   gcc -I. tests/ft_dedup.c ft.c NodeD.c NodeF.c checkerFT.c \
+      indexFT.c storeFT.c dynarray.c -lpthread -o ft_dedup
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of files, and the number of distinct contents they are
+   given in turn */
+enum {NUM_FILES = 240, NUM_CONTENTS = 6};
+
+/* The number of random rounds, and the most changes made in each */
+enum {NUM_ROUNDS = 100, MAX_CHANGES = 300};
+
+/* The length of each of the distinct contents: two are kept inside
+   the nodes, two in slabs, and two are allocated one by one */
+static const size_t lengths[NUM_CONTENTS] = {8, 32, 100, 1000, 2000,
+                                             5000};
+
+/* The distinct contents, and a buffer that they are handed in */
+static char contents[NUM_CONTENTS][5000];
+static char buffer[5000];
+
+/* The number of mismatches found */
+static size_t numFailures;
+
+/* The state of the pseudo-random sequence */
+static unsigned seed = 1;
+
+/* Returns the next value of the pseudo-random sequence, less than n. */
+static unsigned next(unsigned n) {
+   seed = seed * 1103515245u + 12345u;
+   return (seed >> 8) % n;
+}
+
+/* Records a mismatch, described by what. */
+static void fail(const char* what) {
+   numFailures++;
+   fprintf(stderr, "%s\n", what);
+}
+
+/* Writes the path of file i to path. */
+static void makePath(char* path, int i) {
+   sprintf(path, "r/d%d/f%d", i % 10, i);
+}
+
+/* Copies contents c into buffer, which is overwritten once the FT has
+   been handed it, and returns buffer. */
+static void* fillBuffer(int c) {
+   memcpy(buffer, contents[c], lengths[c]);
+   return buffer;
+}
+
+/* Checks that ft's stats count numFiles files holding bytes bytes in
+   numBlobs copies holding storedBytes bytes, reporting a mismatch as
+   what. */
+static void checkStats(FT_T ft, size_t numFiles, size_t bytes,
+                       size_t numBlobs, size_t storedBytes,
+                       const char* what) {
+   struct FT_ContentStats stats;
+
+   if(FT_getContentStatsIn(ft, &stats) != SUCCESS ||
+      stats.numFiles != numFiles || stats.bytes != bytes ||
+      stats.numBlobs != numBlobs || stats.storedBytes != storedBytes ||
+      stats.savedBytes != bytes - storedBytes ||
+      (storedBytes != 0 && stats.ratio !=
+       (double) bytes / (double) storedBytes) ||
+      (numFiles != 0 && stats.memoryBytes < storedBytes))
+      fail(what);
+}
+
+/* Returns TRUE if contents c are kept apart from the nodes. */
+static boolean isApart(int c) {
+   return (boolean) (lengths[c] > 32);
+}
+
+/* Checks the sharing and stats of a tree that dedups, or only owns if
+   isDedup is FALSE, its contents, as its files change. */
+static void checkSharing(boolean isDedup) {
+   char path[64];
+   size_t numFiles = 0;
+   size_t bytes = 0;
+   size_t numBlobs = 0;
+   size_t storedBytes = 0;
+   void* first[NUM_CONTENTS];
+   void* found;
+   FT_T snapshot;
+   FT_T ft;
+   int c;
+   int i;
+
+   ft = FT_new();
+   if(ft == NULL ||
+      (isDedup ? FT_dedupContentsIn(ft) : FT_ownContentsIn(ft)) !=
+      SUCCESS || FT_insertDirIn(ft, "r") != SUCCESS) {
+      fail("could not make the tree");
+      return;
+   }
+   checkStats(ft, 0, 0, 0, 0, "an empty store has stats");
+
+   /* File i gets contents i % NUM_CONTENTS */
+   for(i = 0; i < NUM_FILES; i++) {
+      c = i % NUM_CONTENTS;
+      makePath(path, i);
+      if(FT_insertFileIn(ft, path, fillBuffer(c), lengths[c]) !=
+         SUCCESS)
+         fail("could not insert a file");
+      memset(buffer, 'X', sizeof(buffer));
+      if(isApart(c)) {
+         numFiles++;
+         bytes += lengths[c];
+      }
+   }
+   for(c = 0; c < NUM_CONTENTS; c++) {
+      makePath(path, c);
+      first[c] = FT_getFileContentsIn(ft, path);
+      if(isApart(c)) {
+         numBlobs += isDedup ? 1 : (size_t) (NUM_FILES / NUM_CONTENTS);
+         storedBytes += isDedup ? lengths[c] :
+            lengths[c] * (NUM_FILES / NUM_CONTENTS);
+      }
+   }
+   for(i = 0; i < NUM_FILES; i++) {
+      c = i % NUM_CONTENTS;
+      makePath(path, i);
+      found = FT_getFileContentsIn(ft, path);
+      if(found == NULL || memcmp(found, contents[c], lengths[c]) != 0)
+         fail("a file has the wrong contents");
+      else if(i >= NUM_CONTENTS &&
+              (found == first[c]) != (isDedup && isApart(c)))
+         fail(isDedup ? "equal contents are not shared" :
+              "contents are shared without dedup");
+   }
+   checkStats(ft, numFiles, bytes, numBlobs, storedBytes,
+              "the stats are wrong after inserting");
+   if(FT_dedupContentsIn(ft) != INITIALIZATION_ERROR)
+      fail("deduped the contents of a tree that is not empty");
+
+   /* A snapshot keeps the copies of the files removed after it */
+   snapshot = FT_snapshotIn(ft);
+   if(snapshot == NULL)
+      fail("could not take a snapshot");
+   for(i = 2; i < NUM_FILES; i += NUM_CONTENTS) {
+      makePath(path, i);
+      if(FT_rmFileIn(ft, path) != SUCCESS)
+         fail("could not remove a file");
+   }
+   checkStats(ft, numFiles, bytes, numBlobs, storedBytes,
+              "a snapshot's copies are not counted");
+   FT_free(snapshot);
+   numFiles -= NUM_FILES / NUM_CONTENTS;
+   bytes -= lengths[2] * (NUM_FILES / NUM_CONTENTS);
+   numBlobs -= isDedup ? 1 : (size_t) (NUM_FILES / NUM_CONTENTS);
+   storedBytes -= lengths[2] * (isDedup ? 1 : NUM_FILES / NUM_CONTENTS);
+   checkStats(ft, numFiles, bytes, numBlobs, storedBytes,
+              "the stats are wrong after freeing the snapshot");
+
+   /* Replacing a shared copy leaves it to the other files */
+   makePath(path, 3);
+   found = FT_replaceFileContentsIn(ft, path, fillBuffer(4),
+                                    lengths[4]);
+   memset(buffer, 'X', sizeof(buffer));
+   if(found == NULL || (isDedup && found != first[4]) ||
+      memcmp(FT_getFileContentsIn(ft, "r/d9/f9"), contents[3],
+             lengths[3]) != 0)
+      fail("replacing a shared copy changed another file");
+   bytes += lengths[4] - lengths[3];
+   if(!isDedup)
+      storedBytes += lengths[4] - lengths[3];
+   checkStats(ft, numFiles, bytes, numBlobs, storedBytes,
+              "the stats are wrong after replacing");
+
+   /* Removing every file with contents frees their copy */
+   if(FT_rmDirIn(ft, "r") != SUCCESS || FT_drainIn(ft) != SUCCESS)
+      fail("could not remove the files");
+   checkStats(ft, 0, 0, 0, 0, "the stats are wrong after removing");
+   FT_free(ft);
+}
+
+/* Checks that after random changes, ft's stats count one copy of
+   each of the distinct contents apart from the nodes that some file
+   still holds. Short contents that replace longer ones are stored
+   too, so they may add a copy each, but no more. */
+static void checkRandom(int round) {
+   char path[64];
+   struct FT_ContentStats stats;
+   boolean isUsed[NUM_CONTENTS];
+   boolean isFile;
+   size_t length;
+   size_t minBlobs = 0;
+   size_t maxBlobs = 0;
+   size_t minBytes = 0;
+   size_t maxBytes = 0;
+   unsigned n;
+   unsigned i;
+   int c;
+   FT_T ft;
+
+   ft = FT_new();
+   if(ft == NULL || FT_dedupContentsIn(ft) != SUCCESS ||
+      FT_insertDirIn(ft, "r") != SUCCESS) {
+      fail("could not make the tree");
+      return;
+   }
+   n = next(MAX_CHANGES);
+   for(i = 0; i < n; i++) {
+      c = (int) next(NUM_CONTENTS);
+      makePath(path, (int) next(40));
+      switch(next(3)) {
+         case 0:
+            (void) FT_insertFileIn(ft, path, fillBuffer(c), lengths[c]);
+            break;
+         case 1:
+            (void) FT_replaceFileContentsIn(ft, path, fillBuffer(c),
+                                            lengths[c]);
+            break;
+         default:
+            (void) FT_rmFileIn(ft, path);
+            break;
+      }
+      memset(buffer, 'X', sizeof(buffer));
+   }
+
+   /* Only the contents still in some file may have a copy */
+   for(c = 0; c < NUM_CONTENTS; c++)
+      isUsed[c] = FALSE;
+   for(i = 0; i < 40; i++) {
+      makePath(path, (int) i);
+      if(FT_statIn(ft, path, &isFile, &length) != SUCCESS || !isFile)
+         continue;
+      for(c = 0; c < NUM_CONTENTS; c++)
+         if(length == lengths[c] &&
+            memcmp(FT_getFileContentsIn(ft, path), contents[c],
+                   length) == 0)
+            isUsed[c] = TRUE;
+   }
+   for(c = 0; c < NUM_CONTENTS; c++)
+      if(isUsed[c]) {
+         maxBlobs++;
+         maxBytes += lengths[c];
+         if(isApart(c)) {
+            minBlobs++;
+            minBytes += lengths[c];
+         }
+      }
+   if(FT_getContentStatsIn(ft, &stats) != SUCCESS ||
+      stats.numBlobs < minBlobs || stats.numBlobs > maxBlobs ||
+      stats.storedBytes < minBytes || stats.storedBytes > maxBytes) {
+      fprintf(stderr, "round %d: ", round);
+      fail("the copies are not those of the files");
+   }
+   FT_free(ft);
+}
+
+int main(int argc, char* argv[]) {
+   int round;
+   int c;
+   size_t j;
+
+   if(argc > 1)
+      seed = (unsigned) atoi(argv[1]);
+   for(c = 0; c < NUM_CONTENTS; c++)
+      for(j = 0; j < sizeof(contents[c]); j++)
+         contents[c][j] = (char) ('a' + (c * 7 + (int) j) % 26);
+
+   checkSharing(TRUE);
+   checkSharing(FALSE);
+   for(round = 0; round < NUM_ROUNDS; round++)
+      checkRandom(round);
+
+   if(numFailures != 0)
+      return EXIT_FAILURE;
+   printf("dedup ok\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+/*--------------------------------------------------------------------*/
+/* ft_deep.c                                                          */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks that a chain of directories 100000 deep, "r", "r/a", "r/a/a"
+   and so on, can be listed, removed and destroyed without running out
+   of stack, on a thread with a stack of only 256 KB. The listing of
+   such a chain is about 10 GB long, so it is counted as FT_toStream
+   writes it rather than built with FT_toString, which is checked on a
+   shorter chain instead.
+
+   gcc -I. tests/ft_deep.c ft.c NodeD.c NodeF.c checkerFT.c \
+      indexFT.c storeFT.c dynarray.c -lpthread -o ft_deep
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The depth of the chain, the depth of the chain that FT_toString
+   lists, and the size of the stack of the thread that uses them */
+enum {DEPTH = 100000, LISTED_DEPTH = 500, STACK_SIZE = 256 * 1024};
+
+/* Adds len, the length of a piece of the listing, to the total at
+   extra, for FT_toStream. */
+static int countOutput(const char* buf, size_t len, void* extra) {
+   (void) buf;
+   *(size_t*) extra += len;
+   return SUCCESS;
+}
+
+/* Returns the length of the listing of a chain depth directories
+   deep: the lengths of all of their paths, each followed by a
+   newline. */
+static size_t getListingLength(size_t depth) {
+   return depth * (depth + 1);
+}
+
+/* Returns the path of the directory at the bottom of a chain depth
+   directories deep, or NULL if there is an allocation error. The
+   path of the directory at level k, counting the root as level 1,
+   is its first 2 * k - 1 characters. */
+static char* makeChain(size_t depth) {
+   char* path;
+   char* end;
+   size_t level;
+
+   path = malloc(2 * depth);
+   if(path == NULL)
+      return NULL;
+   end = path;
+   *end++ = 'r';
+   for(level = 1; level < depth; level++) {
+      *end++ = '/';
+      *end++ = 'a';
+   }
+   *end = '\0';
+   return path;
+}
+
+/* Builds the deep chain at path in the default tree, lists it,
+   removes its bottom half and destroys the rest, then builds it in a
+   tree of its own and frees it, and finally lists a shorter chain
+   with FT_toString. Returns a description of the first step that
+   failed, or NULL if none did. */
+static const char* runChains(char* path) {
+   size_t total = 0;
+   char* listing;
+   FT_T ft;
+   boolean isListed;
+
+   (void) FT_init();
+   if(FT_insertDir(path) != SUCCESS)
+      return "inserting the chain";
+   if(FT_toStream(countOutput, &total) != SUCCESS ||
+      total != getListingLength(DEPTH))
+      return "streaming the listing";
+   path[DEPTH - 1] = '\0';
+   if(FT_rmDir(path) != SUCCESS)
+      return "removing half the chain";
+   path[DEPTH - 1] = '/';
+   if(FT_containsDir(path))
+      return "removing the bottom";
+   if(FT_destroy() != SUCCESS)
+      return "destroying the chain";
+
+   ft = FT_new();
+   if(ft == NULL)
+      return "making a tree";
+   if(FT_insertDirIn(ft, path) != SUCCESS) {
+      FT_free(ft);
+      return "inserting the chain again";
+   }
+   FT_free(ft);
+
+   (void) FT_init();
+   path[2 * LISTED_DEPTH - 1] = '\0';
+   if(FT_insertDir(path) != SUCCESS)
+      return "inserting the shorter chain";
+   listing = FT_toString();
+   if(listing == NULL)
+      return "listing the shorter chain";
+   isListed = (boolean)
+      (strlen(listing) == getListingLength(LISTED_DEPTH));
+   free(listing);
+   if(!isListed)
+      return "listing every directory";
+   if(FT_destroy() != SUCCESS)
+      return "destroying the shorter chain";
+   return NULL;
+}
+
+/* Runs the chains, for a thread, and returns a description of the
+   first step that failed, or NULL if none did. */
+static void* run(void* arg) {
+   char* path;
+   const char* failure;
+
+   (void) arg;
+
+   path = makeChain(DEPTH);
+   if(path == NULL)
+      return "allocating the path";
+   failure = runChains(path);
+   free(path);
+   return (void*) failure;
+}
+
+int main(void) {
+   pthread_attr_t attr;
+   pthread_t thread;
+   void* failure;
+
+   if(pthread_attr_init(&attr) != 0 ||
+      pthread_attr_setstacksize(&attr, STACK_SIZE) != 0 ||
+      pthread_create(&thread, &attr, run, NULL) != 0 ||
+      pthread_join(thread, &failure) != 0) {
+      fprintf(stderr, "could not run the test thread\n");
+      return EXIT_FAILURE;
+   }
+   if(failure != NULL) {
+      fprintf(stderr, "failed %s\n", (const char*) failure);
+      return EXIT_FAILURE;
+   }
+   printf("deep chains ok\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+/*--------------------------------------------------------------------*/
+/* ft_free.c                                                          */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks that snapshots and views may outlive the tree they were
+   taken of. Each round fills a tree, which owns its contents or not,
+   takes snapshots of it and of those snapshots, and acquires views of
+   its files and of theirs, then frees the tree before some or all of
+   them. What they show must not change, whatever order the tree, the
+   snapshots, and the views are freed and released in; the last of
+   them frees the tree, which the leak checker of a sanitized build
+   confirms. An optional argument seeds the rounds.
+
+   gcc -I. tests/ft_free.c ft.c NodeD.c NodeF.c checkerFT.c \
+      indexFT.c storeFT.c dynarray.c -lpthread -o ft_free
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of rounds, the number of files in each tree, and the
+   most snapshots and views kept of it */
+enum {NUM_ROUNDS = 500, NUM_FILES = 40, NUM_SNAPSHOTS = 4};
+enum {NUM_VIEWS = 8};
+
+/* The longest contents */
+enum {MAX_LENGTH = 2000};
+
+/* The contents that files are given, and the buffer that owning trees
+   are handed them in */
+static char contents[MAX_LENGTH];
+static char buffer[MAX_LENGTH];
+
+/* The number of mismatches found */
+static size_t numFailures;
+
+/* The state of the pseudo-random sequence */
+static unsigned seed = 1;
+
+/* Returns the next value of the pseudo-random sequence, less than n. */
+static unsigned next(unsigned n) {
+   seed = seed * 1103515245u + 12345u;
+   return (seed >> 8) % n;
+}
+
+/* Records a mismatch, described by what, in round round. */
+static void fail(int round, const char* what) {
+   numFailures++;
+   fprintf(stderr, "round %d: %s\n", round, what);
+}
+
+/* Writes the path of file i to path. */
+static void makePath(char* path, int i) {
+   sprintf(path, "r/d%d/f%d", i % 3, i);
+}
+
+/* Returns the length of file i. */
+static size_t lengthOf(int i) {
+   return (size_t) (i * 47) % MAX_LENGTH;
+}
+
+/* Returns TRUE if snapshot holds every file with its contents. */
+static boolean isWhole(FT_T snapshot) {
+   char path[64];
+   boolean isFile;
+   size_t length;
+   void* found;
+   int i;
+
+   for(i = 0; i < NUM_FILES; i++) {
+      makePath(path, i);
+      found = FT_getFileContentsIn(snapshot, path);
+      if(FT_statIn(snapshot, path, &isFile, &length) != SUCCESS ||
+         !isFile || length != lengthOf(i) || found == NULL ||
+         memcmp(found, contents, length) != 0)
+         return FALSE;
+   }
+   return TRUE;
+}
+
+/* Returns TRUE if view shows the contents of file i. */
+static boolean isShown(struct FT_ContentView* view, int i) {
+   return (boolean) (view->length == lengthOf(i) &&
+                     memcmp(view->contents, contents, view->length) ==
+                     0);
+}
+
+/* Fills a tree, frees it while snapshots and views of it are kept,
+   and then frees and releases those in a random order, in round
+   round. */
+static void checkRound(int round) {
+   char path[64];
+   FT_T snapshots[NUM_SNAPSHOTS];
+   struct FT_ContentView views[NUM_VIEWS];
+   int viewFiles[NUM_VIEWS];
+   size_t numSnapshots;
+   size_t numViews;
+   boolean isOwner;
+   size_t k;
+   FT_T ft;
+   int i;
+
+   ft = FT_new();
+   isOwner = (boolean) (next(2) == 0);
+   if(ft == NULL || (isOwner && FT_ownContentsIn(ft) != SUCCESS) ||
+      FT_insertDirIn(ft, "r") != SUCCESS) {
+      fail(round, "could not make the tree");
+      return;
+   }
+   for(i = 0; i < NUM_FILES; i++) {
+      makePath(path, i);
+      memcpy(buffer, contents, MAX_LENGTH);
+      if(FT_insertFileIn(ft, path, isOwner ? buffer : contents,
+                         lengthOf(i)) != SUCCESS)
+         fail(round, "could not insert a file");
+      memset(buffer, 'X', MAX_LENGTH);
+   }
+
+   /* Snapshots of the tree and of each other, and views of the files
+      of either */
+   numSnapshots = next(NUM_SNAPSHOTS + 1);
+   for(k = 0; k < numSnapshots; k++) {
+      snapshots[k] = FT_snapshotIn(k == 0 ? ft : snapshots[next(k)]);
+      if(snapshots[k] == NULL) {
+         fail(round, "could not take a snapshot");
+         numSnapshots = k;
+      }
+   }
+   numViews = next(NUM_VIEWS + 1);
+   for(k = 0; k < numViews; k++) {
+      viewFiles[k] = (int) next(NUM_FILES);
+      makePath(path, viewFiles[k]);
+      if(FT_acquireContentsIn(numSnapshots != 0 && next(2) == 0 ?
+                              snapshots[next(numSnapshots)] : ft,
+                              path, &views[k]) != SUCCESS) {
+         fail(round, "could not acquire a view");
+         numViews = k;
+      }
+   }
+
+   /* The tree goes first, then the snapshots and views in turn, each
+      of which may be the last */
+   FT_free(ft);
+   while(numSnapshots + numViews != 0) {
+      for(k = 0; k < numSnapshots; k++)
+         if(!isWhole(snapshots[k]))
+            fail(round, "a snapshot changed");
+      for(k = 0; k < numViews; k++)
+         if(!isShown(&views[k], viewFiles[k]))
+            fail(round, "a view changed");
+      if(numViews == 0 || (numSnapshots != 0 && next(2) == 0)) {
+         k = next(numSnapshots);
+         FT_free(snapshots[k]);
+         snapshots[k] = snapshots[--numSnapshots];
+      }
+      else {
+         k = next(numViews);
+         FT_releaseContents(&views[k]);
+         views[k] = views[--numViews];
+         viewFiles[k] = viewFiles[numViews];
+      }
+   }
+}
+
+int main(int argc, char* argv[]) {
+   int round;
+   size_t j;
+
+   if(argc > 1)
+      seed = (unsigned) atoi(argv[1]);
+   for(j = 0; j < MAX_LENGTH; j++)
+      contents[j] = (char) ('a' + j % 26);
+
+   for(round = 0; round < NUM_ROUNDS; round++)
+      checkRound(round);
+
+   if(numFailures != 0)
+      return EXIT_FAILURE;
+   printf("free ok\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,271 @@
+/*--------------------------------------------------------------------*/
+/* ft_inline.c                                                        */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks that a tree owning its contents keeps short ones inside the
+   files' nodes. Files of every length up to a little past the limit
+   are inserted from a buffer that is overwritten after each call, and
+   must keep their contents, while FT_getContentStats must count only
+   the longer ones. With FT_dedupContents, equal short contents must
+   still get a copy per file. The files are then replaced with random
+   lengths, and short contents that fit in the room a file was created
+   with must stay inline, while others go to the store. A snapshot must
+   keep the contents of inline files replaced and removed after it,
+   and a tree that does not own its contents must hand back the
+   client's own pointers, however short. An optional argument seeds the
+   replacements.
+
+   gcc -I. tests/ft_inline.c ft.c NodeD.c NodeF.c checkerFT.c \
+      indexFT.c storeFT.c dynarray.c -lpthread -o ft_inline
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The longest contents kept inline, as NodeF.h's NODEF_INLINE, and
+   the longest contents given to a file */
+enum {INLINE = 32, MAX_LENGTH = 48};
+
+/* The number of files, and the number of rounds of replacements */
+enum {NUM_FILES = 2 * (MAX_LENGTH + 1), NUM_ROUNDS = 50};
+
+/* The contents that files are given, and the buffer they are handed
+   in */
+static char contents[MAX_LENGTH];
+static char buffer[MAX_LENGTH];
+
+/* For each file, its length, the mark its contents start with,
+   whether it has contents, and the room for inline contents that it
+   was created with */
+static size_t lengths[NUM_FILES];
+static int marks[NUM_FILES];
+static boolean hasContents[NUM_FILES];
+static size_t rooms[NUM_FILES];
+
+/* The number of mismatches found */
+static size_t numFailures;
+
+/* The state of the pseudo-random sequence */
+static unsigned seed = 1;
+
+/* Returns the next value of the pseudo-random sequence, less than n. */
+static unsigned next(unsigned n) {
+   seed = seed * 1103515245u + 12345u;
+   return (seed >> 8) % n;
+}
+
+/* Records a mismatch, described by what. */
+static void fail(const char* what) {
+   numFailures++;
+   fprintf(stderr, "%s\n", what);
+}
+
+/* Writes the path of file i to path. */
+static void makePath(char* path, int i) {
+   sprintf(path, "r/d%d/f%d", i % 4, i);
+}
+
+/* Copies the first length bytes of contents into buffer, starting
+   with mark instead, and returns buffer. */
+static void* fillBuffer(int mark, size_t length) {
+   memcpy(buffer, contents, length);
+   if(length != 0)
+      buffer[0] = (char) ('A' + mark);
+   return buffer;
+}
+
+/* Returns TRUE if found holds what fillBuffer(mark, length) would. */
+static boolean isFilled(const char* found, int mark, size_t length) {
+   return (boolean) (length == 0 ||
+                     (found[0] == (char) ('A' + mark) &&
+                      memcmp(found + 1, contents + 1, length - 1) ==
+                      0));
+}
+
+/* Checks that each file of ft has the contents recorded for it, and
+   that ft's stats count exactly those kept apart from the nodes. */
+static void checkFiles(FT_T ft, const char* what) {
+   char path[64];
+   struct FT_ContentStats stats;
+   size_t numFiles = 0;
+   size_t bytes = 0;
+   boolean isFile;
+   size_t length;
+   void* found;
+   int i;
+
+   for(i = 0; i < NUM_FILES; i++) {
+      makePath(path, i);
+      found = FT_getFileContentsIn(ft, path);
+      if(FT_statIn(ft, path, &isFile, &length) != SUCCESS || !isFile ||
+         length != lengths[i] || (found != NULL) != hasContents[i] ||
+         (found != NULL && !isFilled(found, marks[i], length)))
+         fail(what);
+      if(hasContents[i] && lengths[i] > rooms[i]) {
+         numFiles++;
+         bytes += lengths[i];
+      }
+   }
+   if(FT_getContentStatsIn(ft, &stats) != SUCCESS ||
+      stats.numFiles != numFiles || stats.bytes != bytes)
+      fail(what);
+}
+
+/* Inserts every file into a new tree that owns, or dedups if isDedup
+   is TRUE, its contents, and checks them. Returns the tree. */
+static FT_T checkOwned(boolean isDedup) {
+   char path[64];
+   void* first;
+   FT_T ft;
+   int i;
+
+   ft = FT_new();
+   if(ft == NULL ||
+      (isDedup ? FT_dedupContentsIn(ft) : FT_ownContentsIn(ft)) !=
+      SUCCESS || FT_insertDirIn(ft, "r") != SUCCESS) {
+      fail("could not make the tree");
+      exit(EXIT_FAILURE);
+   }
+
+   /* File i is i % (MAX_LENGTH + 1) bytes long, and the second file of
+      each length has contents equal to the first's */
+   for(i = 0; i < NUM_FILES; i++) {
+      makePath(path, i);
+      lengths[i] = (size_t) (i % (MAX_LENGTH + 1));
+      marks[i] = 0;
+      hasContents[i] = TRUE;
+      /* NodeF_create rounds the room up to 16 bytes */
+      rooms[i] = (lengths[i] <= INLINE) ? (lengths[i] + 15) / 16 * 16 :
+         0;
+      if(FT_insertFileIn(ft, path, fillBuffer(marks[i], lengths[i]),
+                         lengths[i]) != SUCCESS)
+         fail("could not insert a file");
+      memset(buffer, 'X', sizeof(buffer));
+   }
+   checkFiles(ft, "a file is wrong after inserting");
+
+   /* Equal short contents get a copy each, even with dedup */
+   makePath(path, INLINE);
+   first = FT_getFileContentsIn(ft, path);
+   makePath(path, INLINE + MAX_LENGTH + 1);
+   if(FT_getFileContentsIn(ft, path) == first)
+      fail("short contents are shared");
+   makePath(path, MAX_LENGTH);
+   first = FT_getFileContentsIn(ft, path);
+   makePath(path, 2 * MAX_LENGTH + 1);
+   if((FT_getFileContentsIn(ft, path) == first) != isDedup)
+      fail(isDedup ? "long contents are not shared" :
+           "long contents are shared without dedup");
+   return ft;
+}
+
+/* Replaces the files of ft in NUM_ROUNDS rounds with random lengths,
+   some with no contents, checking them after each round. */
+static void replaceFiles(FT_T ft) {
+   char path[64];
+   void* returned;
+   void* newContents;
+   size_t length;
+   int round;
+   int i;
+
+   for(round = 0; round < NUM_ROUNDS; round++) {
+      for(i = 0; i < NUM_FILES; i++) {
+         if(next(2) == 0)
+            continue;
+         makePath(path, i);
+         length = next(MAX_LENGTH + 1);
+         marks[i] = (int) next(26);
+         newContents = next(8) == 0 ? NULL :
+            fillBuffer(marks[i], length);
+         returned = FT_replaceFileContentsIn(ft, path, newContents,
+                                             length);
+         memset(buffer, 'X', sizeof(buffer));
+         if(returned != FT_getFileContentsIn(ft, path))
+            fail("replacing did not return the tree's copy");
+         lengths[i] = length;
+         hasContents[i] = (boolean) (newContents != NULL);
+         /* A file's room does not change, even if its contents are
+            moved to the store */
+      }
+      checkFiles(ft, "a file is wrong after replacing");
+   }
+}
+
+/* Checks that a snapshot of ft keeps the contents of its inline files
+   as they are replaced in and removed from ft. Frees ft. */
+static void checkSnapshot(FT_T ft) {
+   char path[64];
+   FT_T snapshot;
+   int i;
+
+   snapshot = FT_snapshotIn(ft);
+   if(snapshot == NULL) {
+      fail("could not take a snapshot");
+      return;
+   }
+   for(i = 0; i < NUM_FILES; i += 2) {
+      makePath(path, i);
+      (void) FT_replaceFileContentsIn(ft, path,
+                                      fillBuffer(marks[i] + 1, 8), 8);
+      memset(buffer, 'X', sizeof(buffer));
+   }
+   if(FT_rmDirIn(ft, "r/d1") != SUCCESS)
+      fail("could not remove a directory");
+   checkFiles(snapshot, "a snapshot's file changed");
+   FT_free(snapshot);
+   FT_free(ft);
+}
+
+/* Checks that a tree that does not own its contents keeps the client's
+   pointers to short contents. */
+static void checkNotOwned(void) {
+   char path[64];
+   FT_T ft;
+   int i;
+
+   ft = FT_new();
+   if(ft == NULL || FT_insertDirIn(ft, "r") != SUCCESS) {
+      fail("could not make the tree");
+      return;
+   }
+   for(i = 0; i <= INLINE; i++) {
+      makePath(path, i);
+      if(FT_insertFileIn(ft, path, contents + i, (size_t) i) !=
+         SUCCESS || FT_getFileContentsIn(ft, path) != contents + i)
+         fail("a short file was copied without FT_ownContents");
+   }
+   makePath(path, 0);
+   if(FT_replaceFileContentsIn(ft, path, contents, 1) != contents ||
+      FT_getFileContentsIn(ft, path) != contents)
+      fail("a short replacement was copied without FT_ownContents");
+   FT_free(ft);
+}
+
+int main(int argc, char* argv[]) {
+   boolean isDedup;
+   FT_T ft;
+   size_t j;
+
+   if(argc > 1)
+      seed = (unsigned) atoi(argv[1]);
+   for(j = 0; j < MAX_LENGTH; j++)
+      contents[j] = (char) ('a' + j % 26);
+
+   for(isDedup = FALSE; isDedup <= TRUE; isDedup++) {
+      ft = checkOwned(isDedup);
+      replaceFiles(ft);
+      checkSnapshot(ft);
+   }
+   checkNotOwned();
+
+   if(numFailures != 0)
+      return EXIT_FAILURE;
+   printf("inline contents ok\n");
+   return EXIT_SUCCESS;
+}
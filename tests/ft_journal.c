@@ -0,0 +1,125 @@
+/*--------------------------------------------------------------------*/
+/* ft_journal.c                                                       */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Measures what the journal costs writers at each durability setting:
+   a number of changes, inserting files of LENGTH bytes into NUM_DIRS
+   directories and replacing the contents of every fourth one, made
+   with no journal, with every change synced, and with changes synced
+   in groups of a given size or age. The time includes closing the
+   journal, which syncs the last group. It prints the changes per
+   second for each setting. An optional argument sets the number of
+   changes, and a second one the journal file to use, which should be
+   on the disk to be measured.
+
+   gcc -I. -O2 -DNDEBUG tests/ft_journal.c ft.c NodeD.c NodeF.c \
+      checkerFT.c indexFT.c storeFT.c dynarray.c -lpthread -o ft_journal
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of directories the files go into, and the length of
+   their contents */
+enum {NUM_DIRS = 100, LENGTH = 64};
+
+/* A durability setting: its name, whether it journals at all, and the
+   limits given to FT_openJournal */
+struct Setting {
+   const char* name;
+   boolean isJournaled;
+   size_t syncBytes;
+   size_t syncMillis;
+};
+
+/* The settings measured. The group limits are each given with the
+   other limit too large to be reached. */
+static const struct Setting settings[] = {
+   {"no journal", FALSE, 0, 0},
+   {"sync every change", TRUE, 0, 0},
+   {"groups of 4 KB", TRUE, 4096, 1000000},
+   {"groups of 64 KB", TRUE, 65536, 1000000},
+   {"groups of 1 MB", TRUE, 1048576, 1000000},
+   {"groups of 1 ms", TRUE, 1 << 30, 1},
+   {"groups of 10 ms", TRUE, 1 << 30, 10}
+};
+
+/* Returns the seconds elapsed since start. */
+static double secondsSince(const struct timespec* start) {
+   struct timespec now;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &now);
+   return (double) (now.tv_sec - start->tv_sec) +
+      (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Makes n changes to a new default tree, journaled to journal as
+   setting says, and returns the seconds they take, or a negative
+   number if any of them fails. */
+static double measure(const struct Setting* setting,
+                      const char* journal, long n) {
+   static char contents[LENGTH];
+   char path[64];
+   struct timespec start;
+   int failures = 0;
+   long i;
+
+   (void) remove(journal);
+   (void) FT_init();
+   (void) FT_insertDir("r");
+   memset(contents, 'c', sizeof(contents));
+   (void) clock_gettime(CLOCK_MONOTONIC, &start);
+   if(setting->isJournaled &&
+      FT_openJournal(journal, setting->syncBytes,
+                     setting->syncMillis) != SUCCESS)
+      failures++;
+   for(i = 0; i < n; i++) {
+      if(i % 4 == 3) {
+         sprintf(path, "r/d%02ld/f%07ld", (i - 1) % NUM_DIRS, i - 1);
+         if(FT_replaceFileContents(path, contents, LENGTH) == NULL)
+            failures++;
+      }
+      else {
+         sprintf(path, "r/d%02ld/f%07ld", i % NUM_DIRS, i);
+         if(FT_insertFile(path, contents, LENGTH) != SUCCESS)
+            failures++;
+      }
+   }
+   if(setting->isJournaled && FT_closeJournal() != SUCCESS)
+      failures++;
+   if(failures != 0)
+      return -1.0;
+   return secondsSince(&start);
+}
+
+int main(int argc, char* argv[]) {
+   const char* journal = "ft_journal.log";
+   long n = 100000;
+   double seconds;
+   size_t s;
+
+   if(argc > 1)
+      n = atol(argv[1]);
+   if(argc > 2)
+      journal = argv[2];
+
+   for(s = 0; s < sizeof(settings) / sizeof(settings[0]); s++) {
+      seconds = measure(&settings[s], journal, n);
+      (void) FT_destroy();
+      if(seconds < 0)
+         printf("%-18s failed\n", settings[s].name);
+      else
+         printf("%-18s %10.0f changes/s\n", settings[s].name,
+                (double) n / seconds);
+   }
+   (void) remove(journal);
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+/*--------------------------------------------------------------------*/
+/* ft_listing.c                                                       */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Measures FT_toString on a large tree that changes a little between
+   calls: a root with NUM_DIRS directories of NUM_FILES files each,
+   listed once and then again after each of a number of single-file
+   edits, which alternately insert a file into one directory and remove
+   it. It prints the time of the first listing and the average time of
+   the listings after an edit. Only the functions of ft.h are used, so
+   it builds against any version of the FT. An optional argument sets
+   the number of edits.
+
+   gcc -I. -O2 -DNDEBUG tests/ft_listing.c ft.c NodeD.c NodeF.c \
+      checkerFT.c indexFT.c storeFT.c dynarray.c -lpthread -o ft_listing
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ft.h"
+
+/* The number of directories, and the number of files in each */
+enum {NUM_DIRS = 1000, NUM_FILES = 100};
+
+/* Returns the microseconds elapsed since start. */
+static double microsSince(const struct timespec* start) {
+   struct timespec now;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &now);
+   return (double) (now.tv_sec - start->tv_sec) * 1e6 +
+      (double) (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+int main(int argc, char* argv[]) {
+   long numEdits = 200;
+   char path[64];
+   char* listing;
+   struct timespec start;
+   double firstMicros;
+   double editMicros;
+   size_t length;
+   long i;
+
+   if(argc > 1)
+      numEdits = atol(argv[1]);
+
+   (void) FT_init();
+   (void) FT_insertDir("r");
+   for(i = 0; i < (long) NUM_DIRS * NUM_FILES; i++) {
+      sprintf(path, "r/d%04ld/f%03ld", i / NUM_FILES, i % NUM_FILES);
+      (void) FT_insertFile(path, NULL, 0);
+   }
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &start);
+   listing = FT_toString();
+   firstMicros = microsSince(&start);
+   if(listing == NULL)
+      return EXIT_FAILURE;
+   length = strlen(listing);
+   free(listing);
+
+   /* Only the listings are timed, not the edits before them */
+   editMicros = 0;
+   for(i = 0; i < numEdits; i++) {
+      sprintf(path, "r/d%04ld/new", (i / 2 * 389) % NUM_DIRS);
+      if(i % 2 == 0)
+         (void) FT_insertFile(path, NULL, 0);
+      else
+         (void) FT_rmFile(path);
+      (void) clock_gettime(CLOCK_MONOTONIC, &start);
+      listing = FT_toString();
+      editMicros += microsSince(&start);
+      if(listing == NULL)
+         return EXIT_FAILURE;
+      free(listing);
+   }
+   (void) FT_destroy();
+
+   printf("%lu bytes: first listing %.0f us, after an edit %.0f us\n",
+          (unsigned long) length, firstMicros,
+          numEdits > 0 ? editMicros / (double) numEdits : 0.0);
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+/*--------------------------------------------------------------------*/
+/* ft_load.c                                                          */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Measures how long it takes to restore a tree of files: replaying an
+   FT_insertFile for each of them, loading them with FT_bulkLoad, and
+   loading a snapshot of them with FT_loadSnapshot, followed in each
+   case by looking up every file once. An optional argument sets the
+   number of files, and a second one the image file to use.
+
+   gcc -I. -O2 -DNDEBUG tests/ft_load.c ft.c NodeD.c NodeF.c \
+      checkerFT.c indexFT.c storeFT.c dynarray.c -lpthread -o ft_load
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of directories the files are spread over, and the
+   length of their contents */
+enum {NUM_DIRS = 1000, LENGTH = 64};
+
+/* Returns the seconds elapsed since start. */
+static double secondsSince(const struct timespec* start) {
+   struct timespec now;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &now);
+   return (double) (now.tv_sec - start->tv_sec) +
+      (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Compares the paths that a and b point to, for qsort. */
+static int comparePaths(const void* a, const void* b) {
+   return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/* Looks up each of the n paths in the default tree, and returns the
+   number that are missing. */
+static long lookUpAll(char* paths[], long n) {
+   long missing = 0;
+   long i;
+
+   for(i = 0; i < n; i++)
+      if(FT_getFileContents(paths[i]) == NULL)
+         missing++;
+   return missing;
+}
+
+/* Prints the time since start taken by what, and then how long
+   looking up the n paths takes. */
+static void report(const char* what, const struct timespec* start,
+                   char* paths[], long n) {
+   struct timespec lookups;
+   double seconds;
+   long missing;
+
+   seconds = secondsSince(start);
+   (void) clock_gettime(CLOCK_MONOTONIC, &lookups);
+   missing = lookUpAll(paths, n);
+   printf("%-14s %8.1f ms, then lookups %8.1f ms%s\n", what,
+          seconds * 1e3, secondsSince(&lookups) * 1e3,
+          missing == 0 ? "" : " (files missing)");
+}
+
+int main(int argc, char* argv[]) {
+   static char contents[LENGTH];
+   const char* image = "ft_load.img";
+   long n = 200000;
+   char** paths;
+   void** contentsOf;
+   size_t* lengths;
+   char path[64];
+   struct timespec start;
+   long i;
+
+   if(argc > 1)
+      n = atol(argv[1]);
+   if(argc > 2)
+      image = argv[2];
+
+   /* The paths, sorted as FT_bulkLoad needs them */
+   paths = malloc((size_t) n * sizeof(char*));
+   contentsOf = malloc((size_t) n * sizeof(void*));
+   lengths = malloc((size_t) n * sizeof(size_t));
+   if(paths == NULL || contentsOf == NULL || lengths == NULL)
+      return EXIT_FAILURE;
+   memset(contents, 'c', sizeof(contents));
+   for(i = 0; i < n; i++) {
+      sprintf(path, "r/d%04ld/f%07ld", i % NUM_DIRS, i);
+      paths[i] = malloc(strlen(path) + 1);
+      if(paths[i] == NULL)
+         return EXIT_FAILURE;
+      strcpy(paths[i], path);
+      contentsOf[i] = contents;
+      lengths[i] = LENGTH;
+   }
+   qsort(paths, (size_t) n, sizeof(char*), comparePaths);
+
+   (void) FT_init();
+   (void) clock_gettime(CLOCK_MONOTONIC, &start);
+   (void) FT_insertDir("r");
+   for(i = 0; i < n; i++)
+      (void) FT_insertFile(paths[i], contents, LENGTH);
+   report("replay", &start, paths, n);
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &start);
+   if(FT_saveSnapshot(image) != SUCCESS)
+      return EXIT_FAILURE;
+   printf("%-14s %8.1f ms\n", "save", secondsSince(&start) * 1e3);
+   (void) FT_destroy();
+
+   (void) FT_init();
+   (void) clock_gettime(CLOCK_MONOTONIC, &start);
+   if(FT_bulkLoad(paths, contentsOf, lengths, (size_t) n) != SUCCESS)
+      return EXIT_FAILURE;
+   report("bulk load", &start, paths, n);
+   (void) FT_destroy();
+
+   (void) FT_init();
+   (void) clock_gettime(CLOCK_MONOTONIC, &start);
+   if(FT_loadSnapshot(image) != SUCCESS)
+      return EXIT_FAILURE;
+   report("load snapshot", &start, paths, n);
+   (void) FT_destroy();
+
+   (void) remove(image);
+   for(i = 0; i < n; i++)
+      free(paths[i]);
+   free(paths);
+   free(contentsOf);
+   free(lengths);
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,406 @@
+/*--------------------------------------------------------------------*/
+/* ft_own.c                                                           */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks FT_ownContents. Each round makes the same random changes to
+   a tree that owns its contents and to one that does not. The owning
+   tree is handed a buffer that is overwritten as soon as each call
+   returns, while the other tree is handed contents that never change,
+   so the two must stay alike only if the owning tree made copies.
+   Snapshots are taken of both along the way and must keep their
+   contents after the files are replaced or removed. Then files are
+   bulk loaded and replayed into an owning tree, and a snapshot must
+   keep its contents after the default tree is destroyed. An optional
+   argument seeds the changes.
+
+   gcc -I. tests/ft_own.c ft.c NodeD.c NodeF.c checkerFT.c \
+      indexFT.c storeFT.c dynarray.c -lpthread -o ft_own
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of rounds, the most changes made in a round, the number
+   of snapshots kept at once, and the number of files loaded in bulk */
+enum {NUM_ROUNDS = 300, MAX_CHANGES = 300, NUM_SNAPSHOTS = 4};
+enum {NUM_LOADED = 300};
+
+/* The number of different contents, and the longest contents */
+enum {NUM_CONTENTS = 64, MAX_LENGTH = 3000};
+
+/* The contents that files are given, which never change */
+static char contents[NUM_CONTENTS][MAX_LENGTH];
+
+/* The buffer that the owning tree is handed contents in */
+static char buffer[MAX_LENGTH];
+
+/* The number of mismatches found */
+static size_t numFailures;
+
+/* The state of the pseudo-random sequence */
+static unsigned seed = 1;
+
+/* Returns the next value of the pseudo-random sequence, less than n. */
+static unsigned next(unsigned n) {
+   seed = seed * 1103515245u + 12345u;
+   return (seed >> 8) % n;
+}
+
+/* Records a mismatch, described by what, in round round. */
+static void fail(int round, const char* what) {
+   numFailures++;
+   fprintf(stderr, "round %d: %s\n", round, what);
+}
+
+/* Writes a random file path below "r" to path. */
+static void makePath(char* path) {
+   unsigned depth;
+   unsigned i;
+
+   depth = next(4);
+   path += sprintf(path, "r");
+   for(i = 0; i < depth; i++)
+      path += sprintf(path, "/d%u", next(3));
+   (void) sprintf(path, "/f%u", next(4));
+}
+
+/* Returns a random length: mostly short enough to be kept inside a
+   node, or in a slab, but sometimes longer. */
+static size_t makeLength(void) {
+   unsigned kind;
+
+   kind = next(10);
+   if(kind < 6)
+      return next(40);
+   if(kind < 9)
+      return next(1100);
+   return 1000 + next(MAX_LENGTH - 1000);
+}
+
+/* Copies contents c into buffer and returns buffer. */
+static void* fillBuffer(unsigned c) {
+   memcpy(buffer, contents[c], MAX_LENGTH);
+   return buffer;
+}
+
+/* Overwrites buffer, as a client reusing it would. */
+static void clobberBuffer(void) {
+   memset(buffer, 'X', MAX_LENGTH);
+}
+
+/* Checks that owner and other have the same hierarchy and contents,
+   and that owner's contents are its own copies, in round round. */
+static void checkSame(FT_T owner, FT_T other, int round) {
+   char* listing;
+   char* otherListing;
+   char* line;
+   char* end;
+   void* owned;
+   void* given;
+   boolean type;
+   size_t length;
+   size_t otherLength;
+
+   listing = FT_toStringIn(owner);
+   otherListing = FT_toStringIn(other);
+   if(listing == NULL || otherListing == NULL ||
+      strcmp(listing, otherListing) != 0) {
+      fail(round, "the trees differ");
+      free(listing);
+      free(otherListing);
+      return;
+   }
+
+   /* The listing has one path per line */
+   for(line = listing; *line != '\0'; line = end + 1) {
+      end = strchr(line, '\n');
+      *end = '\0';
+      if(!FT_containsFileIn(other, line))
+         continue;
+      owned = FT_getFileContentsIn(owner, line);
+      given = FT_getFileContentsIn(other, line);
+      if(FT_statIn(owner, line, &type, &length) != SUCCESS ||
+         FT_statIn(other, line, &type, &otherLength) != SUCCESS ||
+         length != otherLength || (owned == NULL) != (given == NULL) ||
+         (owned != NULL && memcmp(owned, given, length) != 0))
+         fail(round, "the contents differ");
+      else if(owned != NULL && owned == given)
+         fail(round, "the contents were not copied");
+   }
+   free(listing);
+   free(otherListing);
+}
+
+/* Makes one random change to both owner and other, in round round.
+   snapshots and otherSnapshots hold snapshots of each, or NULL. */
+static void changeBoth(FT_T owner, FT_T other, FT_T snapshots[],
+                       FT_T otherSnapshots[], int round) {
+   char path[64];
+   unsigned kind;
+   unsigned c;
+   unsigned s;
+   boolean isNull;
+   boolean type;
+   size_t length;
+   void* result;
+   int status = 0;
+   int otherStatus = 0;
+
+   makePath(path);
+   kind = next(100);
+   c = next(NUM_CONTENTS);
+   isNull = (boolean) (next(6) == 0);
+   length = makeLength();
+   if(kind < 4) {
+      /* Take a snapshot of each, or check and free one */
+      s = next(NUM_SNAPSHOTS);
+      if(snapshots[s] == NULL) {
+         snapshots[s] = FT_snapshotIn(owner);
+         otherSnapshots[s] = FT_snapshotIn(other);
+      }
+      else {
+         checkSame(snapshots[s], otherSnapshots[s], round);
+         FT_free(snapshots[s]);
+         FT_free(otherSnapshots[s]);
+         snapshots[s] = NULL;
+         otherSnapshots[s] = NULL;
+      }
+   }
+   else if(kind < 35) {
+      status = FT_insertFileIn(owner, path,
+                               isNull ? NULL : fillBuffer(c), length);
+      clobberBuffer();
+      otherStatus = FT_insertFileIn(other, path,
+                                    isNull ? NULL : contents[c], length);
+   }
+   else if(kind < 50) {
+      *strrchr(path, '/') = '\0';
+      status = FT_insertDirIn(owner, path);
+      otherStatus = FT_insertDirIn(other, path);
+   }
+   else if(kind < 60) {
+      status = FT_rmFileIn(owner, path);
+      otherStatus = FT_rmFileIn(other, path);
+   }
+   else if(kind < 65) {
+      *strrchr(path, '/') = '\0';
+      status = FT_rmDirIn(owner, path);
+      otherStatus = FT_rmDirIn(other, path);
+   }
+   else if(kind < 85) {
+      /* The owner returns its own copy of the new contents */
+      result = FT_replaceFileContentsIn(owner, path,
+                                        isNull ? NULL : fillBuffer(c),
+                                        length);
+      clobberBuffer();
+      (void) FT_replaceFileContentsIn(other, path,
+                                      isNull ? NULL : contents[c],
+                                      length);
+      if(FT_containsFileIn(owner, path) &&
+         (isNull ? result != NULL :
+          (result == NULL || result == buffer ||
+           result != FT_getFileContentsIn(owner, path) ||
+           memcmp(result, contents[c], length) != 0)))
+         fail(round, "FT_replaceFileContents returned the wrong copy");
+   }
+   else if(kind < 88) {
+      /* A file replaced with a prefix of its own contents */
+      result = FT_getFileContentsIn(owner, path);
+      if(result != NULL &&
+         FT_statIn(owner, path, &type, &length) == SUCCESS) {
+         length = (length == 0) ? 0 : next((unsigned) length);
+         (void) FT_replaceFileContentsIn(owner, path, result, length);
+         (void) FT_replaceFileContentsIn(
+            other, path, FT_getFileContentsIn(other, path), length);
+      }
+   }
+   else if(kind < 89) {
+      status = FT_rmDirIn(owner, "r");
+      otherStatus = FT_rmDirIn(other, "r");
+   }
+   else {
+      status = FT_insertDirIn(owner, "r");
+      otherStatus = FT_insertDirIn(other, "r");
+   }
+   if(status != otherStatus)
+      fail(round, "a change got a different status");
+}
+
+/* Makes random changes to an owning tree and to another one, and
+   checks them and their snapshots, in round round. */
+static void checkRound(int round) {
+   FT_T snapshots[NUM_SNAPSHOTS];
+   FT_T otherSnapshots[NUM_SNAPSHOTS];
+   FT_T owner;
+   FT_T other;
+   unsigned n;
+   unsigned i;
+   int s;
+
+   owner = FT_new();
+   other = FT_new();
+   if(owner == NULL || other == NULL ||
+      FT_ownContentsIn(owner) != SUCCESS) {
+      fail(round, "could not make the trees");
+      return;
+   }
+   for(s = 0; s < NUM_SNAPSHOTS; s++) {
+      snapshots[s] = NULL;
+      otherSnapshots[s] = NULL;
+   }
+
+   n = next(MAX_CHANGES);
+   for(i = 0; i < n; i++)
+      changeBoth(owner, other, snapshots, otherSnapshots, round);
+   checkSame(owner, other, round);
+
+   for(s = 0; s < NUM_SNAPSHOTS; s++)
+      if(snapshots[s] != NULL) {
+         checkSame(snapshots[s], otherSnapshots[s], round);
+         FT_free(snapshots[s]);
+         FT_free(otherSnapshots[s]);
+      }
+   FT_free(owner);
+   FT_free(other);
+}
+
+/* Checks that FT_ownContents fails on a tree that is not empty, and
+   that an owning tree copies the contents of files loaded in bulk and
+   replayed from a journal at journal. */
+static void checkLoading(const char* journal) {
+   static char pathBuffers[NUM_LOADED][32];
+   static char loaded[NUM_LOADED][MAX_LENGTH];
+   char* paths[NUM_LOADED];
+   void* loadedContents[NUM_LOADED];
+   size_t lengths[NUM_LOADED];
+   FT_T owner;
+   FT_T other;
+   FT_T replayed;
+   int i;
+
+   owner = FT_new();
+   other = FT_new();
+   replayed = FT_new();
+   if(owner == NULL || other == NULL || replayed == NULL)
+      return;
+   if(FT_insertDirIn(other, "r") != SUCCESS ||
+      FT_ownContentsIn(other) != INITIALIZATION_ERROR)
+      fail(0, "owned the contents of a tree that is not empty");
+   FT_free(other);
+   other = FT_new();
+   if(other == NULL)
+      return;
+
+   for(i = 0; i < NUM_LOADED; i++) {
+      sprintf(pathBuffers[i], "r/d%02d/f%03d", i / 20, i);
+      paths[i] = pathBuffers[i];
+      memcpy(loaded[i], contents[i % NUM_CONTENTS], MAX_LENGTH);
+      loadedContents[i] = (i % 7 == 0) ? NULL : loaded[i];
+      lengths[i] = (i % 5 == 0) ? 1500 : (size_t) (i % 40);
+   }
+   if(FT_ownContentsIn(owner) != SUCCESS ||
+      FT_ownContentsIn(replayed) != SUCCESS ||
+      FT_bulkLoadIn(owner, paths, loadedContents, lengths,
+                    NUM_LOADED) != SUCCESS ||
+      FT_bulkLoadIn(replayed, paths, loadedContents, lengths,
+                    NUM_LOADED) != SUCCESS) {
+      fail(0, "could not load the files");
+      return;
+   }
+
+   /* other gets its own copies, since loaded is overwritten next */
+   (void) FT_insertDirIn(other, "r");
+   for(i = 0; i < NUM_LOADED; i++)
+      (void) FT_insertFileIn(other, paths[i],
+                             loadedContents[i] == NULL ? NULL :
+                             contents[i % NUM_CONTENTS], lengths[i]);
+   memset(loaded, 'Y', sizeof(loaded));
+   checkSame(owner, other, 0);
+
+   (void) remove(journal);
+   if(FT_openJournalIn(owner, journal, 1 << 20, 1000) != SUCCESS) {
+      fail(0, "could not open the journal");
+      return;
+   }
+   (void) FT_rmFileIn(owner, "r/d00/f001");
+   (void) FT_rmFileIn(other, "r/d00/f001");
+   (void) FT_replaceFileContentsIn(owner, "r/d01/f020", fillBuffer(5),
+                                   2000);
+   clobberBuffer();
+   (void) FT_replaceFileContentsIn(other, "r/d01/f020", contents[5],
+                                   2000);
+   (void) FT_insertFileIn(owner, "r/x/y", fillBuffer(6), 17);
+   clobberBuffer();
+   (void) FT_insertFileIn(other, "r/x/y", contents[6], 17);
+   (void) FT_closeJournalIn(owner);
+   FT_free(owner);
+
+   /* The replayed tree copies the contents out of the journal */
+   if(FT_replayIn(replayed, journal) != SUCCESS)
+      fail(0, "could not replay the journal");
+   (void) remove(journal);
+   checkSame(replayed, other, 0);
+   FT_free(replayed);
+   FT_free(other);
+}
+
+/* Checks that a snapshot of the default tree keeps the contents that
+   the tree owns after the tree is destroyed. */
+static void checkDestroyed(void) {
+   FT_T snapshot;
+   void* found;
+
+   if(FT_init() != SUCCESS || FT_ownContents() != SUCCESS ||
+      FT_insertDir("r/a") != SUCCESS ||
+      FT_insertFile("r/a/f", fillBuffer(0), 3) != SUCCESS ||
+      FT_insertFile("r/a/g", fillBuffer(1), 2000) != SUCCESS) {
+      fail(0, "could not fill the default tree");
+      return;
+   }
+   clobberBuffer();
+   snapshot = FT_snapshot();
+   (void) FT_destroy();
+   if(snapshot == NULL) {
+      fail(0, "could not take a snapshot");
+      return;
+   }
+   (void) FT_init();
+   (void) FT_ownContents();
+   (void) FT_insertDir("q");
+   (void) FT_insertFile("q/g", fillBuffer(2), 2000);
+   found = FT_getFileContentsIn(snapshot, "r/a/g");
+   if(found == NULL || memcmp(found, contents[1], 2000) != 0 ||
+      memcmp(FT_getFileContentsIn(snapshot, "r/a/f"), contents[0], 3)
+      != 0)
+      fail(0, "a snapshot lost its contents with the tree");
+   FT_free(snapshot);
+   (void) FT_destroy();
+}
+
+int main(int argc, char* argv[]) {
+   const char* journal = "ft_own.log";
+   int round;
+   int i;
+   int j;
+
+   if(argc > 1)
+      seed = (unsigned) atoi(argv[1]);
+   for(i = 0; i < NUM_CONTENTS; i++)
+      for(j = 0; j < MAX_LENGTH; j++)
+         contents[i][j] = (char) ('a' + (i * 7 + j) % 26);
+
+   for(round = 0; round < NUM_ROUNDS; round++)
+      checkRound(round);
+   checkLoading(journal);
+   checkDestroyed();
+
+   if(numFailures != 0)
+      return EXIT_FAILURE;
+   printf("owned contents ok\n");
+   return EXIT_SUCCESS;
+}
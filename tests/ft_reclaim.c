@@ -0,0 +1,132 @@
+/*--------------------------------------------------------------------*/
+/* ft_reclaim.c                                                       */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks the background freeing of directories removed by FT_rmDir:
+   that a removed subtree leaves the namespace at once, that its paths
+   can be used again before it is freed, that FT_drain frees it, that
+   the reclaimer frees it in time without FT_drain, and that a tree can
+   be freed while the reclaimer is still working on it. Build it with
+   AddressSanitizer to catch the reclaimer touching a freed tree:
+
+   gcc -I. -fsanitize=address tests/ft_reclaim.c ft.c NodeD.c \
+      NodeF.c checkerFT.c indexFT.c storeFT.c dynarray.c -lpthread \
+      -o ft_reclaim
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of files in the removed subtree, the number of
+   directories they are spread over, and the number of trees built */
+enum {NUM_FILES = 100000, NUM_DIRS = 100, NUM_ROUNDS = 6};
+
+/* The most milliseconds that the reclaimer may take to free the
+   removed subtree on its own */
+enum {MAX_WAIT = 60000};
+
+/* The number of mismatches found */
+static size_t numFailures;
+
+/* Records a mismatch, described by message, in round round. */
+static void fail(int round, const char* message) {
+   numFailures++;
+   fprintf(stderr, "round %d: %s\n", round, message);
+}
+
+/* Inserts the root "r" and NUM_FILES files below "r/big" in ft, which
+   must be empty. Returns TRUE on success or FALSE if any insertion
+   fails. */
+static boolean fill(FT_T ft) {
+   char path[64];
+   long i;
+
+   if(FT_insertDirIn(ft, "r") != SUCCESS)
+      return FALSE;
+   for(i = 0; i < NUM_FILES; i++) {
+      sprintf(path, "r/big/d%ld/f%ld", i % NUM_DIRS, i);
+      if(FT_insertFileIn(ft, path, NULL, 0) != SUCCESS)
+         return FALSE;
+   }
+   return TRUE;
+}
+
+/* Removes "r/big" from ft, which fill has filled, and checks that its
+   paths are gone and can be used again at once, in round round. */
+static void removeBig(FT_T ft, int round) {
+   if(FT_rmDirIn(ft, "r/big") != SUCCESS)
+      fail(round, "could not remove the subtree");
+   if(FT_containsDirIn(ft, "r/big") ||
+      FT_containsFileIn(ft, "r/big/d0/f0"))
+      fail(round, "found a removed path");
+   if(FT_insertFileIn(ft, "r/big/d0/f0", NULL, 0) != SUCCESS ||
+      !FT_containsFileIn(ft, "r/big/d0/f0"))
+      fail(round, "could not use a removed path again");
+}
+
+/* Checks that after FT_drainIn, only the four paths that removeBig
+   left are in ft's index, in round round. */
+static void drain(FT_T ft, int round) {
+   struct FT_IndexStats stats;
+
+   if(FT_drainIn(ft) != SUCCESS ||
+      FT_getIndexStatsIn(ft, &stats) != SUCCESS)
+      fail(round, "could not drain the tree");
+   else if(stats.numPaths != 4)
+      fail(round, "left removed paths in the index");
+}
+
+/* Checks that the reclaimer alone frees what removeBig removed from
+   ft, leaving only its four paths in ft's index, within MAX_WAIT
+   milliseconds, in round round. */
+static void waitForReclaimer(FT_T ft, int round) {
+   struct FT_IndexStats stats;
+   struct timespec pause;
+   int waited;
+
+   pause.tv_sec = 0;
+   pause.tv_nsec = 10000000;
+   for(waited = 0; waited < MAX_WAIT; waited += 10) {
+      if(FT_getIndexStatsIn(ft, &stats) != SUCCESS) {
+         fail(round, "could not read the index");
+         return;
+      }
+      if(stats.numPaths == 4)
+         return;
+      (void) nanosleep(&pause, NULL);
+   }
+   fail(round, "the reclaimer did not free the subtree");
+}
+
+int main(void) {
+   FT_T ft;
+   int round;
+
+   /* Every other tree is freed while the reclaimer may still be
+      freeing its removed subtree, and the last is left to it */
+   for(round = 0; round < NUM_ROUNDS; round++) {
+      ft = FT_new();
+      if(ft == NULL || !fill(ft)) {
+         fprintf(stderr, "round %d: could not build the tree\n", round);
+         return EXIT_FAILURE;
+      }
+      removeBig(ft, round);
+      if(round == NUM_ROUNDS - 1)
+         waitForReclaimer(ft, round);
+      else if(round % 2 == 1)
+         drain(ft, round);
+      FT_free(ft);
+   }
+
+   if(numFailures != 0)
+      return EXIT_FAILURE;
+   printf("reclaim ok\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,355 @@
+/*--------------------------------------------------------------------*/
+/* ft_replay.c                                                        */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks the journal and FT_replay. Each round makes random changes
+   to a tree with a journal open, with random group limits, and checks
+   that replaying the journal into a new tree rebuilds the same tree.
+   The journal is then cut short in the middle of its last record,
+   which replaying must drop, leaving the tree as it was before that
+   change and the journal ready to be appended to. Groups must stay
+   in memory until they are full or FT_syncJournal is called, and
+   every change must reach the file at once when either limit is 0.
+   The journal is written to the file named by the optional argument,
+   or to ft_replay.log, and a second argument seeds the changes.
+
+   gcc -I. tests/ft_replay.c ft.c NodeD.c NodeF.c checkerFT.c \
+      indexFT.c storeFT.c dynarray.c -lpthread -o ft_replay
+*/
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of rounds, the most changes made in a round, and the
+   number of different contents, each LENGTH bytes long */
+enum {NUM_ROUNDS = 300, MAX_CHANGES = 80};
+enum {NUM_CONTENTS = 64, LENGTH = 32};
+
+/* The contents that files are given */
+static char contents[NUM_CONTENTS][LENGTH];
+
+/* The state of the pseudo-random sequence */
+static unsigned seed = 1;
+
+/* Returns the next value of the pseudo-random sequence, less than n. */
+static unsigned next(unsigned n) {
+   seed = seed * 1103515245u + 12345u;
+   return (seed >> 8) % n;
+}
+
+/* Writes a random file path below "r" to path. */
+static void makePath(char* path) {
+   unsigned depth;
+   unsigned i;
+
+   depth = next(4);
+   path += sprintf(path, "r");
+   for(i = 0; i < depth; i++)
+      path += sprintf(path, "/d%u", next(3));
+   (void) sprintf(path, "/f%u", next(4));
+}
+
+/* Returns random contents for a file: usually one of contents, but
+   sometimes NULL. */
+static void* makeContents(void) {
+   if(next(5) == 0)
+      return NULL;
+   return contents[next(NUM_CONTENTS)];
+}
+
+/* Makes n random changes to ft, of every kind that is journaled. Many
+   of them fail, and so must not be journaled. */
+static void change(FT_T ft, unsigned n) {
+   static char batchPaths[8][64];
+   char* paths[8];
+   void* batchContents[8];
+   size_t lengths[8];
+   int results[8];
+   char path[64];
+   unsigned kind;
+   unsigned i;
+   size_t j;
+
+   for(i = 0; i < n; i++) {
+      makePath(path);
+      kind = next(100);
+      if(kind < 35)
+         (void) FT_insertFileIn(ft, path, makeContents(),
+                                1 + next(LENGTH - 1));
+      else if(kind < 50) {
+         *strrchr(path, '/') = '\0';
+         (void) FT_insertDirIn(ft, path);
+      }
+      else if(kind < 62)
+         (void) FT_rmFileIn(ft, path);
+      else if(kind < 67) {
+         *strrchr(path, '/') = '\0';
+         (void) FT_rmDirIn(ft, path);
+      }
+      else if(kind < 85)
+         (void) FT_replaceFileContentsIn(ft, path, makeContents(),
+                                         next(LENGTH));
+      else if(kind < 88) {
+         for(j = 0; j < 8; j++) {
+            makePath(batchPaths[j]);
+            paths[j] = batchPaths[j];
+            batchContents[j] = makeContents();
+            lengths[j] = j;
+         }
+         (void) FT_insertBatchIn(ft, paths, batchContents, lengths, 8,
+                                 results);
+      }
+      else if(kind < 89)
+         (void) FT_rmDirIn(ft, "r");
+      else
+         (void) FT_insertDirIn(ft, "r");
+   }
+}
+
+/* Returns TRUE if a and b hold the same hierarchy, and their files the
+   same contents, or otherwise reports the difference, in round round,
+   and returns FALSE. */
+static boolean isSame(FT_T a, FT_T b, int round) {
+   char* listingA;
+   char* listingB;
+   char* line;
+   char* end;
+   void* contentsA;
+   void* contentsB;
+   boolean type;
+   size_t lengthA;
+   size_t lengthB;
+   boolean result;
+
+   listingA = FT_toStringIn(a);
+   listingB = FT_toStringIn(b);
+   result = (boolean) (listingA != NULL && listingB != NULL &&
+                       strcmp(listingA, listingB) == 0);
+   if(!result)
+      fprintf(stderr, "round %d: the trees differ\n", round);
+
+   /* The listing has one path per line */
+   for(line = listingA; result && *line != '\0'; line = end + 1) {
+      end = strchr(line, '\n');
+      *end = '\0';
+      if(!FT_containsFileIn(a, line))
+         continue;
+      contentsA = FT_getFileContentsIn(a, line);
+      contentsB = FT_getFileContentsIn(b, line);
+      if(FT_statIn(a, line, &type, &lengthA) != SUCCESS ||
+         FT_statIn(b, line, &type, &lengthB) != SUCCESS ||
+         lengthA != lengthB ||
+         (contentsA == NULL) != (contentsB == NULL) ||
+         (contentsA != NULL &&
+          memcmp(contentsA, contentsB, lengthA) != 0)) {
+         fprintf(stderr, "round %d: %s differs\n", round, line);
+         result = FALSE;
+      }
+   }
+   free(listingA);
+   free(listingB);
+   return result;
+}
+
+/* Returns the size of the file at path, or -1 if it cannot be read. */
+static long sizeOf(const char* path) {
+   struct stat status;
+
+   if(stat(path, &status) != 0)
+      return -1;
+   return (long) status.st_size;
+}
+
+/* Checks that journaling to the file at journal writes records only
+   when a group fills or is synced, and at once with a limit of 0.
+   Returns TRUE if it does. */
+static boolean checkGroups(const char* journal) {
+   long empty;
+   long size;
+   boolean result = TRUE;
+   FT_T ft;
+
+   (void) remove(journal);
+   ft = FT_new();
+   if(ft == NULL || FT_openJournalIn(ft, journal, 1 << 20, 1 << 30) !=
+      SUCCESS)
+      return FALSE;
+   empty = sizeOf(journal);
+   (void) FT_insertDirIn(ft, "r");
+   (void) FT_insertFileIn(ft, "r/f", contents[0], LENGTH);
+   if(sizeOf(journal) != empty) {
+      fprintf(stderr, "a group was written before it was full\n");
+      result = FALSE;
+   }
+   (void) FT_syncJournalIn(ft);
+   size = sizeOf(journal);
+   if(size <= empty) {
+      fprintf(stderr, "FT_syncJournal wrote nothing\n");
+      result = FALSE;
+   }
+   (void) FT_closeJournalIn(ft);
+
+   /* Either limit 0 syncs every change */
+   if(FT_openJournalIn(ft, journal, 0, 1 << 30) != SUCCESS)
+      return FALSE;
+   (void) FT_rmFileIn(ft, "r/f");
+   if(sizeOf(journal) <= size) {
+      fprintf(stderr, "a change was not written at once\n");
+      result = FALSE;
+   }
+   if(FT_openJournalIn(ft, journal, 0, 0) != INITIALIZATION_ERROR) {
+      fprintf(stderr, "opened a second journal\n");
+      result = FALSE;
+   }
+   (void) FT_closeJournalIn(ft);
+   FT_free(ft);
+   return result;
+}
+
+/* Cuts the last record off the journal at journal, which ft wrote and
+   has closed, and checks that replaying it leaves out that change
+   and that the journal can then be appended to, in round round.
+   Returns TRUE if it does. */
+static boolean checkTornTail(FT_T ft, const char* journal, int round) {
+   FT_T before;
+   FT_T after;
+   long size;
+   boolean result;
+
+   /* The tree before the last change, which needs the root */
+   before = FT_new();
+   if(before == NULL || FT_openJournalIn(ft, journal, 0, 0) != SUCCESS ||
+      FT_insertDirIn(ft, "r") == MEMORY_ERROR ||
+      FT_closeJournalIn(ft) != SUCCESS ||
+      FT_replayIn(before, journal) != SUCCESS)
+      return FALSE;
+
+   /* The last change, cut short as if the process died writing it */
+   if(FT_openJournalIn(ft, journal, 0, 0) != SUCCESS ||
+      FT_insertFileIn(ft, "r/last", contents[1], LENGTH) != SUCCESS ||
+      FT_closeJournalIn(ft) != SUCCESS)
+      return FALSE;
+   size = sizeOf(journal);
+   if(size < 0 || truncate(journal, (off_t) (size - 1 - next(LENGTH)))
+      != 0)
+      return FALSE;
+
+   after = FT_new();
+   if(after == NULL || FT_replayIn(after, journal) != SUCCESS)
+      return FALSE;
+   result = (boolean) (isSame(before, after, round) &&
+                       !FT_containsFileIn(after, "r/last"));
+
+   /* Changes appended after the dropped record replay after the
+      others */
+   if(result) {
+      if(FT_openJournalIn(after, journal, 0, 0) != SUCCESS)
+         return FALSE;
+      change(after, next(MAX_CHANGES / 2));
+      (void) FT_closeJournalIn(after);
+      FT_free(before);
+      before = FT_new();
+      if(before == NULL || FT_replayIn(before, journal) != SUCCESS)
+         return FALSE;
+      result = isSame(after, before, round);
+   }
+   FT_free(before);
+   FT_free(after);
+   return result;
+}
+
+/* Makes a round of random changes to a tree with a journal at
+   journal, checks that replaying it rebuilds the tree, and then
+   checks a torn tail. Returns TRUE if both hold. */
+static boolean checkRound(const char* journal, int round) {
+   FT_T ft;
+   FT_T replayed;
+   size_t syncBytes;
+   size_t syncMillis;
+   boolean result;
+
+   (void) remove(journal);
+   syncBytes = (next(3) == 0) ? 0 : next(4000);
+   syncMillis = (next(3) == 0) ? next(3) : 1000000;
+   ft = FT_new();
+   replayed = FT_new();
+   if(ft == NULL || replayed == NULL ||
+      FT_openJournalIn(ft, journal, syncBytes, syncMillis) != SUCCESS)
+      return FALSE;
+   change(ft, next(MAX_CHANGES));
+   if(FT_syncJournalIn(ft) != SUCCESS ||
+      FT_replayIn(replayed, journal) != SUCCESS) {
+      fprintf(stderr, "round %d: could not replay\n", round);
+      return FALSE;
+   }
+   result = isSame(ft, replayed, round);
+   FT_free(replayed);
+   if(FT_closeJournalIn(ft) != SUCCESS)
+      return FALSE;
+
+   if(result && !checkTornTail(ft, journal, round)) {
+      fprintf(stderr, "round %d: the torn tail was not dropped\n",
+              round);
+      result = FALSE;
+   }
+   FT_free(ft);
+   return result;
+}
+
+int main(int argc, char* argv[]) {
+   const char* journal = "ft_replay.log";
+   FILE* notJournal;
+   int round;
+   int i;
+
+   if(argc > 1)
+      journal = argv[1];
+   if(argc > 2)
+      seed = (unsigned) atoi(argv[2]);
+   for(i = 0; i < NUM_CONTENTS; i++)
+      (void) sprintf(contents[i], "contents %d", i);
+
+   if(!checkGroups(journal))
+      return EXIT_FAILURE;
+   for(round = 0; round < NUM_ROUNDS; round++)
+      if(!checkRound(journal, round))
+         return EXIT_FAILURE;
+
+   /* The errors of FT_replay, and FT_destroy writing the journal */
+   if(FT_replay(journal) != INITIALIZATION_ERROR ||
+      FT_init() != SUCCESS ||
+      FT_replay("no/such/dir/ft_replay.log") != NO_SUCH_PATH) {
+      fprintf(stderr, "replayed without a tree or a journal\n");
+      return EXIT_FAILURE;
+   }
+   notJournal = fopen(journal, "w");
+   if(notJournal == NULL ||
+      fputs("not a journal, but long enough for a header\n",
+            notJournal) == EOF || fclose(notJournal) != 0 ||
+      FT_replay(journal) != PARENT_CHILD_ERROR) {
+      fprintf(stderr, "replayed a file that is not a journal\n");
+      return EXIT_FAILURE;
+   }
+   (void) remove(journal);
+   if(FT_openJournal(journal, 1 << 20, 1 << 30) != SUCCESS ||
+      FT_insertDir("x") != SUCCESS || FT_destroy() != SUCCESS ||
+      FT_init() != SUCCESS || FT_replay(journal) != SUCCESS ||
+      !FT_containsDir("x")) {
+      fprintf(stderr, "FT_destroy did not write the journal\n");
+      return EXIT_FAILURE;
+   }
+   (void) FT_destroy();
+   (void) remove(journal);
+
+   printf("journal ok\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,162 @@
+/*--------------------------------------------------------------------*/
+/* ft_save.c                                                          */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks FT_saveSnapshot and FT_loadSnapshot: that a loaded tree has
+   the hierarchy and contents that were saved, and that a tree loaded
+   from a file can be changed and saved back to that same file, as a
+   checkpoint would, and then loaded again. The image is written to
+   the file named by the optional argument, or to ft_save.img.
+
+   gcc -I. tests/ft_save.c ft.c NodeD.c NodeF.c checkerFT.c \
+      indexFT.c storeFT.c dynarray.c -lpthread -o ft_save
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of files in the tree, and the number of times it is
+   saved back to the file it was loaded from */
+enum {NUM_FILES = 300, NUM_CYCLES = 3};
+
+/* The contents of each file, and their length: a file with no
+   contents has NULL, and some files have contents of length 0 */
+static char* contents[NUM_FILES];
+static size_t lengths[NUM_FILES];
+
+/* Writes the path of file i to path. */
+static void makePath(char* path, int i) {
+   sprintf(path, "r/d%d/e%d/f%d", i % 7, i % 3, i);
+}
+
+/* Gives file i new contents for cycle, replacing any it had, which
+   are freed, and returns them. */
+static char* makeContents(int i, int cycle) {
+   size_t length;
+   size_t j;
+
+   free(contents[i]);
+   contents[i] = NULL;
+   lengths[i] = 0;
+   if((i + cycle) % 10 == 0)
+      return NULL;
+   length = (size_t) ((i * 37 + cycle * 11) % 3000);
+   contents[i] = malloc(length + 1);
+   if(contents[i] == NULL)
+      return NULL;
+   for(j = 0; j < length; j++)
+      contents[i][j] = (char) ('a' + (i + cycle + j) % 26);
+   lengths[i] = length;
+   return contents[i];
+}
+
+/* Returns TRUE if the default tree holds exactly the files and
+   contents of the model, with listing as its listing, and otherwise
+   reports the first difference, in step, and returns FALSE. */
+static boolean check(const char* listing, const char* step) {
+   char path[64];
+   char* found;
+   boolean type;
+   size_t length;
+   int i;
+
+   for(i = 0; i < NUM_FILES; i++) {
+      makePath(path, i);
+      found = FT_getFileContents(path);
+      if(FT_stat(path, &type, &length) != SUCCESS || !type ||
+         length != lengths[i] ||
+         (found == NULL) != (contents[i] == NULL) ||
+         (found != NULL && memcmp(found, contents[i], length) != 0)) {
+         fprintf(stderr, "%s: wrong file %s\n", step, path);
+         return FALSE;
+      }
+   }
+   found = FT_toString();
+   if(found == NULL || strcmp(found, listing) != 0) {
+      fprintf(stderr, "%s: wrong listing\n", step);
+      free(found);
+      return FALSE;
+   }
+   free(found);
+   return TRUE;
+}
+
+/* Destroys the default tree and loads it again from the image at
+   image. Returns TRUE on success, or otherwise reports the failure, in
+   step, and returns FALSE. */
+static boolean reload(const char* image, const char* step) {
+   if(FT_destroy() != SUCCESS || FT_init() != SUCCESS ||
+      FT_loadSnapshot(image) != SUCCESS) {
+      fprintf(stderr, "%s: could not load the image\n", step);
+      return FALSE;
+   }
+   return TRUE;
+}
+
+int main(int argc, char* argv[]) {
+   const char* image = "ft_save.img";
+   char path[64];
+   char* found;
+   char* listing = NULL;
+   boolean ok = TRUE;
+   int cycle;
+   int i;
+
+   if(argc > 1)
+      image = argv[1];
+
+   (void) FT_init();
+   (void) FT_insertDir("r/empty/dir");
+   for(i = 0; i < NUM_FILES; i++) {
+      makePath(path, i);
+      found = makeContents(i, 0);
+      (void) FT_insertFile(path, found, lengths[i]);
+   }
+
+   listing = FT_toString();
+   if(listing == NULL || FT_saveSnapshot(image) != SUCCESS) {
+      fprintf(stderr, "could not save the tree\n");
+      return EXIT_FAILURE;
+   }
+   ok = reload(image, "first load") && check(listing, "first load");
+
+   /* Each cycle changes some files of the loaded tree, whose other
+      files still have their contents in the mapping of image, and
+      saves it over image */
+   for(cycle = 1; ok && cycle <= NUM_CYCLES; cycle++) {
+      for(i = cycle; i < NUM_FILES; i += 4) {
+         makePath(path, i);
+         found = makeContents(i, cycle);
+         (void) FT_replaceFileContents(path, found, lengths[i]);
+      }
+      free(listing);
+      listing = FT_toString();
+      if(listing == NULL || FT_saveSnapshot(image) != SUCCESS) {
+         fprintf(stderr, "cycle %d: could not save the tree\n", cycle);
+         ok = FALSE;
+      }
+      else
+         ok = check(listing, "after saving") &&
+            reload(image, "reload") && check(listing, "reload");
+   }
+
+   if(ok && FT_saveSnapshot("no/such/dir/ft_save.img") != NO_SUCH_PATH) {
+      fprintf(stderr, "saved to a missing directory\n");
+      ok = FALSE;
+   }
+
+   (void) FT_destroy();
+   (void) remove(image);
+   free(listing);
+   for(i = 0; i < NUM_FILES; i++)
+      free(contents[i]);
+   if(!ok)
+      return EXIT_FAILURE;
+   printf("save and load ok\n");
+   return EXIT_SUCCESS;
+}
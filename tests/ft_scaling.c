@@ -0,0 +1,102 @@
+/*--------------------------------------------------------------------*/
+/* ft_scaling.c                                                       */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Measures how the throughput of the default tree scales with the
+   number of threads sharing it, from 1 to 32, on a mix of 95% queries
+   and 5% changes, and prints the operations per second for each
+   number of threads. An optional argument sets the total number of
+   operations for each run.
+
+   gcc -I. -O2 -DNDEBUG tests/ft_scaling.c ft.c NodeD.c NodeF.c \
+      checkerFT.c indexFT.c storeFT.c dynarray.c -lpthread \
+      -o ft_scaling
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ft.h"
+
+/* The most threads a run uses, and the number of directories and of
+   files in each that the operations choose from */
+enum {MAX_THREADS = 32, NUM_DIRS = 200, NUM_FILES = 50};
+
+/* The number of operations each thread of the current run performs */
+static long numOps;
+
+/* Performs numOps operations on random paths, seeded by arg. */
+static void* run(void* arg) {
+   unsigned seed = (unsigned) (long) arg * 2654435761u + 1u;
+   char path[64];
+   boolean type;
+   size_t length;
+   unsigned r;
+   long i;
+
+   for(i = 0; i < numOps; i++) {
+      seed = seed * 1103515245u + 12345u;
+      r = seed >> 4;
+      sprintf(path, "r/d%u/f%u", (r >> 4) % NUM_DIRS,
+              (r >> 12) % NUM_FILES);
+      if(r % 100 < 5) {
+         if((r >> 20) & 1)
+            (void) FT_insertFile(path, NULL, 0);
+         else
+            (void) FT_rmFile(path);
+      }
+      else if(r % 3 == 0)
+         (void) FT_stat(path, &type, &length);
+      else if(r % 3 == 1)
+         (void) FT_containsFile(path);
+      else
+         (void) FT_getFileContents(path);
+   }
+   return NULL;
+}
+
+int main(int argc, char* argv[]) {
+   pthread_t threads[MAX_THREADS];
+   long totalOps = 4000000;
+   char path[64];
+   struct timespec start;
+   struct timespec end;
+   double seconds;
+   long n;
+   long i;
+   int j;
+
+   if(argc > 1)
+      totalOps = atol(argv[1]);
+
+   for(n = 1; n <= MAX_THREADS; n *= 2) {
+      (void) FT_init();
+      (void) FT_insertDir("r");
+      for(i = 0; i < NUM_DIRS; i++)
+         for(j = 0; j < NUM_FILES; j += 2) {
+            sprintf(path, "r/d%ld/f%d", i, j);
+            (void) FT_insertFile(path, NULL, 0);
+         }
+
+      numOps = totalOps / n;
+      (void) clock_gettime(CLOCK_MONOTONIC, &start);
+      for(i = 0; i < n; i++)
+         if(pthread_create(&threads[i], NULL, run, (void*) i) != 0)
+            return EXIT_FAILURE;
+      for(i = 0; i < n; i++)
+         (void) pthread_join(threads[i], NULL);
+      (void) clock_gettime(CLOCK_MONOTONIC, &end);
+
+      seconds = (double) (end.tv_sec - start.tv_sec) +
+         (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+      printf("%2ld threads: %.2f Mops/s\n", n,
+             (double) (numOps * n) / seconds / 1e6);
+      (void) FT_destroy();
+   }
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,243 @@
+/*--------------------------------------------------------------------*/
+/* ft_snapshot_threads.c                                              */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks snapshots under concurrent use. A writer thread keeps
+   changing the default tree, copying the nodes that snapshots share
+   with it, while reader threads each take snapshots of it and query
+   them over and over, checking that every answer stays the one the
+   snapshot gave when it was taken. Build it without NDEBUG, so that
+   the checker reads the shared nodes too, and with ThreadSanitizer:
+
+   gcc -I. -fsanitize=thread tests/ft_snapshot_threads.c ft.c \
+      NodeD.c NodeF.c checkerFT.c indexFT.c storeFT.c dynarray.c \
+      -lpthread -o ft_snapshot_threads
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of reader threads, the number of directories and of
+   files in each, the number of changes the writer makes, and the
+   number of times each reader queries each of its snapshots */
+enum {NUM_READERS = 4, NUM_DIRS = 4, NUM_FILES = 8};
+enum {NUM_CHANGES = 20000, NUM_PASSES = 8};
+
+/* The number of paths that the readers query */
+enum {NUM_PATHS = NUM_DIRS * NUM_FILES};
+
+/* The contents that files are given: contents[i] is i + 1 bytes long
+   wherever it is stored */
+static char contents[NUM_FILES][NUM_FILES];
+
+/* Whether the writer has finished, guarded by doneLock */
+static boolean isDone;
+static pthread_mutex_t doneLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The number of mismatches found, guarded by failureLock */
+static size_t numFailures;
+static pthread_mutex_t failureLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Records a mismatch, described by message, in thread id. */
+static void fail(long id, const char* message) {
+   (void) pthread_mutex_lock(&failureLock);
+   numFailures++;
+   fprintf(stderr, "thread %ld: %s\n", id, message);
+   (void) pthread_mutex_unlock(&failureLock);
+}
+
+/* Returns TRUE if the writer has finished. */
+static boolean isWriterDone(void) {
+   boolean result;
+
+   (void) pthread_mutex_lock(&doneLock);
+   result = isDone;
+   (void) pthread_mutex_unlock(&doneLock);
+   return result;
+}
+
+/* Returns the next value of the pseudo-random sequence at *seed. */
+static unsigned next(unsigned* seed) {
+   *seed = *seed * 1103515245u + 12345u;
+   return *seed >> 8;
+}
+
+/* Writes the path of file i of the paths the readers query to path:
+   "r/d<dir>/f<file>". */
+static void makePath(char* path, int i) {
+   sprintf(path, "r/d%d/f%d", i / NUM_FILES, i % NUM_FILES);
+}
+
+/* Inserts, replaces and removes files of the default tree, removes
+   and restores whole directories, and lists the tree, taking and
+   freeing snapshots of its own now and then. */
+static void* runWriter(void* arg) {
+   unsigned seed = 12345u;
+   FT_T snapshot = NULL;
+   char path[64];
+   char* listing;
+   unsigned r;
+   int change;
+   int c;
+
+   (void) arg;
+
+   for(change = 0; change < NUM_CHANGES; change++) {
+      r = next(&seed);
+      makePath(path, (int) (r % NUM_PATHS));
+      c = (int) ((r >> 6) % NUM_FILES);
+      switch((r >> 10) % 16) {
+         case 0:
+            (void) FT_rmFile(path);
+            break;
+         case 1:
+            sprintf(path, "r/d%d", (int) (r % NUM_DIRS));
+            (void) FT_rmDir(path);
+            (void) FT_insertDir(path);
+            break;
+         case 2:
+            if(change % 32 == 0) {
+               listing = FT_toString();
+               free(listing);
+            }
+            break;
+         case 3:
+            if(snapshot != NULL)
+               FT_free(snapshot);
+            snapshot = FT_snapshot();
+            break;
+         default:
+            if(FT_replaceFileContents(path, contents[c], (size_t) c + 1)
+               == NULL)
+               (void) FT_insertFile(path, contents[c], (size_t) c + 1);
+            break;
+      }
+   }
+   if(snapshot != NULL)
+      FT_free(snapshot);
+
+   (void) pthread_mutex_lock(&doneLock);
+   isDone = TRUE;
+   (void) pthread_mutex_unlock(&doneLock);
+   return NULL;
+}
+
+/* What a snapshot answered when it was taken: the contents of each
+   queried path, and the snapshot's listing */
+struct Expected {
+   void* found[NUM_PATHS];
+   char* listing;
+};
+
+/* Queries snapshot about every path, and lists it, filling in
+   expected. Returns TRUE on success or FALSE if the listing could not
+   be made. */
+static boolean record(FT_T snapshot, struct Expected* expected) {
+   char path[64];
+   int i;
+
+   for(i = 0; i < NUM_PATHS; i++) {
+      makePath(path, i);
+      expected->found[i] = FT_getFileContentsIn(snapshot, path);
+   }
+   expected->listing = FT_toStringIn(snapshot);
+   return (boolean) (expected->listing != NULL);
+}
+
+/* Queries snapshot again as record did, and in other ways that must
+   agree with those answers, reporting every mismatch as thread id's. */
+static void check(long id, FT_T snapshot,
+                  const struct Expected* expected) {
+   char path[64];
+   char* listing;
+   boolean type;
+   size_t length;
+   void* found;
+   int i;
+
+   for(i = 0; i < NUM_PATHS; i++) {
+      makePath(path, i);
+      found = FT_getFileContentsIn(snapshot, path);
+      if(found != expected->found[i])
+         fail(id, "found changed contents");
+      if(FT_containsFileIn(snapshot, path) != (found != NULL))
+         fail(id, "found a changed file");
+      if(found == NULL)
+         continue;
+      if(FT_statIn(snapshot, path, &type, &length) != SUCCESS ||
+         !type || length != (size_t) (*(char*) found - 'a') + 1)
+         fail(id, "found a changed status");
+   }
+   listing = FT_toStringIn(snapshot);
+   if(listing == NULL || strcmp(listing, expected->listing) != 0)
+      fail(id, "found a changed listing");
+   free(listing);
+}
+
+/* Takes snapshots of the default tree, and checks each of them
+   NUM_PASSES times, until the writer has finished; arg is the
+   reader's id. */
+static void* runReader(void* arg) {
+   long id = (long) arg;
+   struct Expected expected;
+   FT_T snapshot;
+   int pass;
+
+   while(!isWriterDone()) {
+      snapshot = FT_snapshot();
+      if(snapshot == NULL) {
+         fail(id, "could not take a snapshot");
+         return NULL;
+      }
+      if(!record(snapshot, &expected))
+         fail(id, "could not list a snapshot");
+      else {
+         for(pass = 0; pass < NUM_PASSES; pass++)
+            check(id, snapshot, &expected);
+         free(expected.listing);
+      }
+      FT_free(snapshot);
+   }
+   return NULL;
+}
+
+int main(void) {
+   pthread_t writer;
+   pthread_t readers[NUM_READERS];
+   char path[64];
+   long i;
+   int c;
+
+   /* Each file's contents begin with a letter that gives their
+      length */
+   for(c = 0; c < NUM_FILES; c++)
+      memset(contents[c], 'a' + c, sizeof(contents[c]));
+
+   (void) FT_init();
+   for(i = 0; i < NUM_PATHS; i++) {
+      makePath(path, (int) i);
+      c = (int) (i % NUM_FILES);
+      (void) FT_insertFile(path, contents[c], (size_t) c + 1);
+   }
+
+   if(pthread_create(&writer, NULL, runWriter, NULL) != 0)
+      return EXIT_FAILURE;
+   for(i = 0; i < NUM_READERS; i++)
+      if(pthread_create(&readers[i], NULL, runReader, (void*) i) != 0)
+         return EXIT_FAILURE;
+   (void) pthread_join(writer, NULL);
+   for(i = 0; i < NUM_READERS; i++)
+      (void) pthread_join(readers[i], NULL);
+
+   (void) FT_destroy();
+   if(numFailures != 0)
+      return EXIT_FAILURE;
+   printf("snapshot threads ok\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+/*--------------------------------------------------------------------*/
+/* ft_teardown.c                                                      */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Measures FT_destroy on trees with one wide directory: a directory of
+   n files and a directory of n empty subdirectories, for n from 25000
+   up to the optional argument, 100000 by default, doubling. It prints
+   the time each teardown takes. Only the functions of ft.h are used,
+   so it builds against any version of the FT.
+
+   gcc -I. -O2 -DNDEBUG tests/ft_teardown.c ft.c NodeD.c NodeF.c \
+      checkerFT.c indexFT.c storeFT.c dynarray.c -lpthread \
+      -o ft_teardown
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ft.h"
+
+/* Returns the milliseconds elapsed since start. */
+static double millisSince(const struct timespec* start) {
+   struct timespec now;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &now);
+   return (double) (now.tv_sec - start->tv_sec) * 1e3 +
+      (double) (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* Builds a default tree whose directory "r/big" has n children, files
+   if isFile is TRUE and otherwise directories, and returns the
+   milliseconds that FT_destroy takes to tear it down. */
+static double tearDown(long n, boolean isFile) {
+   char path[64];
+   struct timespec start;
+   long i;
+
+   (void) FT_init();
+   (void) FT_insertDir("r/big");
+   for(i = 0; i < n; i++) {
+      sprintf(path, "r/big/c%07ld", (i * 7919) % n);
+      if(isFile)
+         (void) FT_insertFile(path, NULL, 0);
+      else
+         (void) FT_insertDir(path);
+   }
+   (void) clock_gettime(CLOCK_MONOTONIC, &start);
+   (void) FT_destroy();
+   return millisSince(&start);
+}
+
+int main(int argc, char* argv[]) {
+   long maxWidth = 100000;
+   double fileMillis;
+   double dirMillis;
+   long n;
+
+   if(argc > 1)
+      maxWidth = atol(argv[1]);
+
+   for(n = 25000; n <= maxWidth; n *= 2) {
+      fileMillis = tearDown(n, TRUE);
+      dirMillis = tearDown(n, FALSE);
+      printf("%7ld children: files %8.1f ms, directories %8.1f ms\n",
+             n, fileMillis, dirMillis);
+   }
+   return EXIT_SUCCESS;
+}
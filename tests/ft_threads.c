@@ -0,0 +1,216 @@
+/*--------------------------------------------------------------------*/
+/* ft_threads.c                                                       */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks the FT under concurrent use. Worker threads share the
+   default tree, each changing only the files of its own directory,
+   which it checks against a model of its own, while querying those
+   of the others and listing the whole tree. Other threads each build
+   and tear down trees of their own made with FT_new. Build it with
+   ThreadSanitizer to check for data races as well:
+
+   gcc -I. -fsanitize=thread tests/ft_threads.c ft.c NodeD.c NodeF.c \
+      checkerFT.c indexFT.c storeFT.c dynarray.c -lpthread \
+      -o ft_threads
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of threads sharing the default tree, the number of
+   threads with trees of their own, the number of files in the
+   directory of each thread, and the number of operations each
+   thread performs */
+enum {NUM_SHARED = 6, NUM_PRIVATE = 2, NUM_FILES = 32};
+enum {NUM_OPS = 10000};
+
+/* The contents that files are given: each file holds one of these,
+   all NUM_FILES bytes long */
+static char contents[NUM_FILES][NUM_FILES];
+
+/* The number of mismatches found, guarded by failureLock */
+static size_t numFailures;
+static pthread_mutex_t failureLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Records a mismatch, described by message, in thread id. */
+static void fail(long id, const char* message) {
+   (void) pthread_mutex_lock(&failureLock);
+   numFailures++;
+   fprintf(stderr, "thread %ld: %s\n", id, message);
+   (void) pthread_mutex_unlock(&failureLock);
+}
+
+/* Returns the next value of the pseudo-random sequence at *seed. */
+static unsigned next(unsigned* seed) {
+   *seed = *seed * 1103515245u + 12345u;
+   return *seed >> 8;
+}
+
+/* Returns TRUE if p is NULL or the beginning of one of contents. */
+static boolean isContents(const void* p) {
+   size_t i;
+
+   if(p == NULL)
+      return TRUE;
+   for(i = 0; i < NUM_FILES; i++)
+      if(p == contents[i])
+         return TRUE;
+   return FALSE;
+}
+
+/* Changes and queries the files of directory "r/t<id>" of the default
+   tree, where <id> is arg, keeping a model of them, and queries those
+   of the other threads. */
+static void* runShared(void* arg) {
+   long id = (long) arg;
+   unsigned seed = (unsigned) id * 2654435761u + 1u;
+   /* the index in contents of each file's contents, or -1 if the
+      file is not in the tree */
+   int model[NUM_FILES];
+   char path[64];
+   boolean type;
+   size_t length;
+   void* found;
+   char* listing;
+   int op;
+   unsigned r;
+   int file;
+   int c;
+
+   for(file = 0; file < NUM_FILES; file++)
+      model[file] = -1;
+
+   for(op = 0; op < NUM_OPS; op++) {
+      r = next(&seed);
+      file = (int) (r % NUM_FILES);
+      c = (int) ((r >> 5) % NUM_FILES);
+      sprintf(path, "r/t%ld/f%d", id, file);
+      switch((r >> 10) % 20) {
+         case 0:
+            if(FT_insertFile(path, contents[c], NUM_FILES) == SUCCESS) {
+               if(model[file] != -1)
+                  fail(id, "inserted a file twice");
+               model[file] = c;
+            }
+            else if(model[file] == -1)
+               fail(id, "could not insert a file");
+            break;
+         case 1:
+            found = FT_replaceFileContents(path, contents[c], NUM_FILES);
+            if(model[file] == -1 ? found != NULL :
+               found != contents[model[file]])
+               fail(id, "replaced the wrong contents");
+            if(model[file] != -1)
+               model[file] = c;
+            break;
+         case 2:
+            if((FT_rmFile(path) == SUCCESS) != (model[file] != -1))
+               fail(id, "removed the wrong file");
+            model[file] = -1;
+            break;
+         case 3:
+            if(op % 16 != 0)
+               break;
+            listing = FT_toString();
+            if(listing == NULL)
+               fail(id, "could not list the tree");
+            free(listing);
+            break;
+         default:
+            /* a file of the thread itself, then one of another */
+            found = FT_getFileContents(path);
+            if(found != (model[file] == -1 ? NULL :
+                         contents[model[file]]))
+               fail(id, "found the wrong contents");
+            if(FT_stat(path, &type, &length) !=
+               (model[file] == -1 ? NO_SUCH_PATH : SUCCESS))
+               fail(id, "found the wrong status");
+            sprintf(path, "r/t%ld/f%d", (long) (r >> 15) % NUM_SHARED,
+                    file);
+            if(!isContents(FT_getFileContents(path)))
+               fail(id, "found contents of no file");
+            (void) FT_containsFile(path);
+            (void) FT_containsDir("r");
+            break;
+      }
+   }
+
+   for(file = 0; file < NUM_FILES; file++) {
+      sprintf(path, "r/t%ld/f%d", id, file);
+      if(FT_containsFile(path) != (model[file] != -1))
+         fail(id, "ended with the wrong files");
+   }
+   return NULL;
+}
+
+/* Builds, lists, changes and frees trees of its own, named for its
+   id, arg. */
+static void* runPrivate(void* arg) {
+   long id = (long) arg;
+   FT_T ft;
+   char path[64];
+   char* listing;
+   int i;
+   int round;
+
+   for(round = 0; round < 20; round++) {
+      ft = FT_new();
+      if(ft == NULL) {
+         fail(id, "could not make a tree");
+         return NULL;
+      }
+      sprintf(path, "p%ld", id);
+      (void) FT_insertDirIn(ft, path);
+      for(i = 0; i < NUM_OPS / 20; i++) {
+         sprintf(path, "p%ld/d%d/f", id, i % 50);
+         (void) FT_insertFileIn(ft, path, contents[0], NUM_FILES);
+         if(i % 3 == 0) {
+            sprintf(path, "p%ld/d%d", id, (i * 7) % 50);
+            (void) FT_rmDirIn(ft, path);
+         }
+         if(i % 100 == 0) {
+            listing = FT_toStringIn(ft);
+            free(listing);
+         }
+      }
+      if(FT_insertDirIn(ft, "x") != CONFLICTING_PATH)
+         fail(id, "inserted a second root");
+      FT_free(ft);
+   }
+   return NULL;
+}
+
+int main(void) {
+   pthread_t threads[NUM_SHARED + NUM_PRIVATE];
+   char path[64];
+   long i;
+
+   memset(contents, 'c', sizeof(contents));
+   (void) FT_init();
+   (void) FT_insertDir("r");
+   for(i = 0; i < NUM_SHARED; i++) {
+      sprintf(path, "r/t%ld", i);
+      (void) FT_insertDir(path);
+   }
+
+   for(i = 0; i < NUM_SHARED; i++)
+      if(pthread_create(&threads[i], NULL, runShared, (void*) i) != 0)
+         return EXIT_FAILURE;
+   for(i = NUM_SHARED; i < NUM_SHARED + NUM_PRIVATE; i++)
+      if(pthread_create(&threads[i], NULL, runPrivate, (void*) i) != 0)
+         return EXIT_FAILURE;
+   for(i = 0; i < NUM_SHARED + NUM_PRIVATE; i++)
+      (void) pthread_join(threads[i], NULL);
+
+   (void) FT_destroy();
+   if(numFailures != 0)
+      return EXIT_FAILURE;
+   printf("threads ok\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,314 @@
+/*--------------------------------------------------------------------*/
+/* ft_views.c                                                         */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Checks FT_acquireContents and FT_releaseContents. Each round makes
+   random changes to a tree, which owns its contents, dedups them, or
+   does neither, while views of its files and of a snapshot of it are
+   acquired and released. Every view must go on showing the contents
+   it was acquired with, however its file is replaced or removed, and
+   a view of a tree that does not own its contents must show the
+   client's own buffer. Some views outlive their tree's files, which
+   are all removed, and are released only after the tree's last
+   changes. Each error of FT_acquireContents is provoked, and views of
+   the default tree must outlive FT_destroy. An optional argument seeds
+   the changes.
+
+   gcc -I. tests/ft_views.c ft.c NodeD.c NodeF.c checkerFT.c \
+      indexFT.c storeFT.c dynarray.c -lpthread -o ft_views
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft.h"
+#include "ftExt.h"
+
+/* The number of rounds, the most changes made in a round, and the
+   number of views held at once */
+enum {NUM_ROUNDS = 300, MAX_CHANGES = 400, NUM_VIEWS = 24};
+
+/* The number of different contents, and the longest contents */
+enum {NUM_CONTENTS = 64, MAX_LENGTH = 3000};
+
+/* The contents that files are given, which never change */
+static char contents[NUM_CONTENTS][MAX_LENGTH];
+
+/* The buffer that owning trees are handed contents in */
+static char buffer[MAX_LENGTH];
+
+/* A view, whether it is held, a copy of what it showed when it was
+   acquired, and whether it was acquired from the snapshot */
+struct View {
+   struct FT_ContentView view;
+   boolean isHeld;
+   char* expected;
+   boolean isOfSnapshot;
+};
+
+/* The views, held or not */
+static struct View views[NUM_VIEWS];
+
+/* The number of mismatches found */
+static size_t numFailures;
+
+/* The state of the pseudo-random sequence */
+static unsigned seed = 1;
+
+/* Returns the next value of the pseudo-random sequence, less than n. */
+static unsigned next(unsigned n) {
+   seed = seed * 1103515245u + 12345u;
+   return (seed >> 8) % n;
+}
+
+/* Records a mismatch, described by what, in round round. */
+static void fail(int round, const char* what) {
+   numFailures++;
+   fprintf(stderr, "round %d: %s\n", round, what);
+}
+
+/* Writes a random file path below "r" to path. */
+static void makePath(char* path) {
+   unsigned depth;
+   unsigned i;
+
+   depth = next(3);
+   path += sprintf(path, "r");
+   for(i = 0; i < depth; i++)
+      path += sprintf(path, "/d%u", next(2));
+   (void) sprintf(path, "/f%u", next(3));
+}
+
+/* Returns a random length: mostly short enough to be kept inside a
+   node, or in a slab, but sometimes longer. */
+static size_t makeLength(void) {
+   unsigned kind;
+
+   kind = next(10);
+   if(kind < 5)
+      return next(40);
+   if(kind < 9)
+      return next(1100);
+   return 1000 + next(MAX_LENGTH - 1000);
+}
+
+/* Returns contents c for a tree that owns its contents if isOwner is
+   TRUE, in buffer, and otherwise the client's own contents. */
+static void* makeContents(unsigned c, boolean isOwner) {
+   if(!isOwner)
+      return contents[c];
+   memcpy(buffer, contents[c], MAX_LENGTH);
+   return buffer;
+}
+
+/* Checks that every held view still shows what it was acquired with,
+   in round round. */
+static void checkViews(int round) {
+   int i;
+
+   for(i = 0; i < NUM_VIEWS; i++)
+      if(views[i].isHeld &&
+         (views[i].view.length != 0 &&
+          memcmp(views[i].view.contents, views[i].expected,
+                 views[i].view.length) != 0))
+         fail(round, "a view changed");
+}
+
+/* Releases view i, if it is held. */
+static void release(int i) {
+   if(!views[i].isHeld)
+      return;
+   FT_releaseContents(&views[i].view);
+   free(views[i].expected);
+   views[i].isHeld = FALSE;
+}
+
+/* Acquires view i of the file at path in ft, which is a snapshot if
+   isSnapshot is TRUE, and checks the result, in round round. A tree
+   that does not own its contents is not isOwner. */
+static void acquire(int i, FT_T ft, const char* path, boolean isSnapshot,
+                    boolean isOwner, int round) {
+   struct View* v = &views[i];
+   boolean isFile;
+   size_t length;
+   int status;
+
+   release(i);
+   status = FT_acquireContentsIn(ft, path, &v->view);
+   if(status == NOT_A_FILE) {
+      if(!FT_containsDirIn(ft, path))
+         fail(round, "NOT_A_FILE for a path that is no directory");
+      return;
+   }
+   if(status == NO_SUCH_PATH) {
+      if(FT_containsFileIn(ft, path) || FT_containsDirIn(ft, path))
+         fail(round, "NO_SUCH_PATH for a path in the tree");
+      return;
+   }
+   if(status != SUCCESS) {
+      fail(round, "could not acquire a view");
+      return;
+   }
+
+   /* The view shows the file's contents, without copying them */
+   if(FT_statIn(ft, path, &isFile, &length) != SUCCESS || !isFile ||
+      length != v->view.length ||
+      (v->view.length != 0 &&
+       memcmp(v->view.contents, FT_getFileContentsIn(ft, path),
+              length) != 0))
+      fail(round, "a view does not show its file");
+   if(!isOwner && v->view.contents != FT_getFileContentsIn(ft, path))
+      fail(round, "a view copied the client's contents");
+   v->expected = malloc(length + 1);
+   if(v->expected == NULL) {
+      FT_releaseContents(&v->view);
+      fail(round, "out of memory");
+      return;
+   }
+   if(length != 0)
+      memcpy(v->expected, v->view.contents, length);
+   v->isHeld = TRUE;
+   v->isOfSnapshot = isSnapshot;
+}
+
+/* Releases every view acquired from the snapshot, and then frees it,
+   if there is one. */
+static void freeSnapshot(FT_T* snapshot) {
+   int i;
+
+   if(*snapshot == NULL)
+      return;
+   for(i = 0; i < NUM_VIEWS; i++)
+      if(views[i].isOfSnapshot)
+         release(i);
+   FT_free(*snapshot);
+   *snapshot = NULL;
+}
+
+/* Makes random changes to a tree, which owns or dedups its contents
+   depending on mode, while views are acquired and released, in round
+   round. Releases the views only after the tree's files are all
+   removed, and then frees the tree. */
+static void checkRound(unsigned mode, int round) {
+   char path[64];
+   FT_T snapshot = NULL;
+   boolean isOwner;
+   unsigned kind;
+   unsigned n;
+   unsigned i;
+   FT_T ft;
+   int j;
+
+   ft = FT_new();
+   isOwner = (boolean) (mode != 0);
+   if(ft == NULL || (mode == 1 && FT_ownContentsIn(ft) != SUCCESS) ||
+      (mode == 2 && FT_dedupContentsIn(ft) != SUCCESS) ||
+      FT_insertDirIn(ft, "r") != SUCCESS) {
+      fail(round, "could not make the tree");
+      return;
+   }
+
+   n = next(MAX_CHANGES);
+   for(i = 0; i < n; i++) {
+      makePath(path);
+      kind = next(100);
+      if(kind < 25)
+         (void) FT_insertFileIn(ft, path,
+                                makeContents(next(NUM_CONTENTS),
+                                             isOwner), makeLength());
+      else if(kind < 40)
+         (void) FT_replaceFileContentsIn(ft, path,
+                                         makeContents(next(NUM_CONTENTS),
+                                                      isOwner),
+                                         makeLength());
+      else if(kind < 48)
+         (void) FT_rmFileIn(ft, path);
+      else if(kind < 51) {
+         *strrchr(path, '/') = '\0';
+         (void) FT_rmDirIn(ft, path);
+      }
+      else if(kind < 75) {
+         if(snapshot != NULL && next(3) == 0)
+            acquire((int) next(NUM_VIEWS), snapshot, path, TRUE, isOwner,
+                    round);
+         else
+            acquire((int) next(NUM_VIEWS), ft, path, FALSE, isOwner,
+                    round);
+      }
+      else if(kind < 78) {
+         *strrchr(path, '/') = '\0';
+         acquire((int) next(NUM_VIEWS), ft, path, FALSE, isOwner, round);
+      }
+      else if(kind < 80) {
+         freeSnapshot(&snapshot);
+         if(next(2) == 0)
+            snapshot = FT_snapshotIn(ft);
+      }
+      else
+         release((int) next(NUM_VIEWS));
+      memset(buffer, 'X', sizeof(buffer));
+      checkViews(round);
+   }
+
+   /* The views outlive every file of the tree */
+   freeSnapshot(&snapshot);
+   (void) FT_rmDirIn(ft, "r");
+   if(FT_containsDirIn(ft, "r") || FT_drainIn(ft) != SUCCESS)
+      fail(round, "could not remove the files");
+   checkViews(round);
+   for(j = 0; j < NUM_VIEWS; j++)
+      release(j);
+   FT_free(ft);
+}
+
+/* Checks the errors of FT_acquireContents, and that a view of the
+   default tree outlives FT_destroy. Returns TRUE if they hold. */
+static boolean checkDefault(void) {
+   struct FT_ContentView view;
+   boolean result = TRUE;
+
+   if(FT_acquireContents("r/f", &view) != INITIALIZATION_ERROR ||
+      FT_init() != SUCCESS || FT_ownContents() != SUCCESS ||
+      FT_insertDir("r") != SUCCESS ||
+      FT_insertFile("r/f", contents[0], MAX_LENGTH) != SUCCESS ||
+      FT_acquireContents("r", &view) != NOT_A_FILE ||
+      FT_acquireContents("r/g", &view) != NO_SUCH_PATH ||
+      FT_acquireContents("r/f/g", &view) != NO_SUCH_PATH) {
+      fprintf(stderr, "FT_acquireContents returned the wrong error\n");
+      result = FALSE;
+   }
+   if(FT_acquireContents("r/f", &view) != SUCCESS ||
+      FT_destroy() != SUCCESS)
+      return FALSE;
+   if(view.length != MAX_LENGTH ||
+      memcmp(view.contents, contents[0], MAX_LENGTH) != 0) {
+      fprintf(stderr, "a view did not outlive FT_destroy\n");
+      result = FALSE;
+   }
+   FT_releaseContents(&view);
+   return result;
+}
+
+int main(int argc, char* argv[]) {
+   int round;
+   int c;
+   size_t j;
+
+   if(argc > 1)
+      seed = (unsigned) atoi(argv[1]);
+   for(c = 0; c < NUM_CONTENTS; c++)
+      for(j = 0; j < MAX_LENGTH; j++)
+         contents[c][j] = (char) ('a' + (c * 7 + (int) j) % 26);
+
+   if(!checkDefault())
+      return EXIT_FAILURE;
+   for(round = 0; round < NUM_ROUNDS; round++)
+      checkRound(next(3), round);
+
+   if(numFailures != 0)
+      return EXIT_FAILURE;
+   printf("views ok\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+/*--------------------------------------------------------------------*/
+/* ft_wide.c                                                          */
+/* Author: Daniel Park and John Hart                                  */
+/*--------------------------------------------------------------------*/
+
+/* Measures inserting into and looking up paths in wide directories: a
+   root with n subdirectories, each holding one file, for n from 1000
+   up to the optional argument, 16000 by default, quadrupling. It
+   prints the time per insertion of a file, and per lookup of a file
+   and of a directory, for each n. Only the functions of ft.h are used,
+   so it builds against any version of the FT.
+
+   gcc -I. -O2 -DNDEBUG tests/ft_wide.c ft.c NodeD.c NodeF.c \
+      checkerFT.c indexFT.c storeFT.c dynarray.c -lpthread -o ft_wide
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ft.h"
+
+/* The most lookups of each kind made for each n */
+enum {MAX_LOOKUPS = 4000};
+
+/* Returns the nanoseconds elapsed since start. */
+static double nanosSince(const struct timespec* start) {
+   struct timespec now;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &now);
+   return (double) (now.tv_sec - start->tv_sec) * 1e9 +
+      (double) (now.tv_nsec - start->tv_nsec);
+}
+
+/* Writes the path of the file of subdirectory i to path. Subdirectories
+   are numbered so that consecutive ones are far apart in sorted
+   order. */
+static void makePath(char* path, long i, long n) {
+   sprintf(path, "r/d%07ld/f", (i * 7919) % n);
+}
+
+int main(int argc, char* argv[]) {
+   long maxWidth = 16000;
+   char path[64];
+   struct timespec start;
+   double insertNanos;
+   double fileNanos;
+   double dirNanos;
+   long lookups;
+   long found;
+   long n;
+   long i;
+
+   if(argc > 1)
+      maxWidth = atol(argv[1]);
+
+   for(n = 1000; n <= maxWidth; n *= 4) {
+      (void) FT_init();
+      (void) FT_insertDir("r");
+      (void) clock_gettime(CLOCK_MONOTONIC, &start);
+      for(i = 0; i < n; i++) {
+         makePath(path, i, n);
+         (void) FT_insertFile(path, NULL, 0);
+      }
+      insertNanos = nanosSince(&start) / (double) n;
+
+      lookups = (n < MAX_LOOKUPS) ? n : MAX_LOOKUPS;
+      found = 0;
+      (void) clock_gettime(CLOCK_MONOTONIC, &start);
+      for(i = 0; i < lookups; i++) {
+         makePath(path, i, n);
+         found += FT_containsFile(path);
+      }
+      fileNanos = nanosSince(&start) / (double) lookups;
+
+      (void) clock_gettime(CLOCK_MONOTONIC, &start);
+      for(i = 0; i < lookups; i++) {
+         makePath(path, i, n);
+         path[10] = '\0';
+         found += FT_containsDir(path);
+      }
+      dirNanos = nanosSince(&start) / (double) lookups;
+
+      printf("%6ld wide: insert %9.0f ns, file lookup %9.0f ns, "
+             "dir lookup %9.0f ns%s\n", n, insertNanos, fileNanos,
+             dirNanos, (found == 2 * lookups) ? "" : " (missing)");
+      (void) FT_destroy();
+   }
+   return EXIT_SUCCESS;
+}